@@ -78,6 +78,10 @@ const PdfFontConfigWrapper & PdfFontConfigWrapper::operator=(const PdfFontConfig
     this->m_pFontConfig = rhs.m_pFontConfig;
     if( m_pFontConfig )
     {
+#if defined(PODOFO_HAVE_FONTCONFIG)
+        // Copies of the wrapper can live in different threads
+        Util::PdfMutexWrapper mutex(m_FcMutex);
+#endif
         this->m_pFontConfig->m_lRefCount++;
     }
 
@@ -87,17 +91,22 @@ const PdfFontConfigWrapper & PdfFontConfigWrapper::operator=(const PdfFontConfig
 
 void PdfFontConfigWrapper::DerefBuffer()
 {
-    if ( m_pFontConfig && !(--m_pFontConfig->m_lRefCount) )
+    if ( m_pFontConfig )
     {
 #if defined(PODOFO_HAVE_FONTCONFIG)
-        if( this->m_pFontConfig->m_bInitialized )
+        // Copies of the wrapper can live in different threads
+        Util::PdfMutexWrapper mutex(m_FcMutex);
+#endif
+
+        if( !(--m_pFontConfig->m_lRefCount) )
         {
-            Util::PdfMutexWrapper mutex(m_FcMutex);
-            FcConfigDestroy( static_cast<FcConfig*>(m_pFontConfig->m_pFcConfig) );
-        }
+#if defined(PODOFO_HAVE_FONTCONFIG)
+            if( this->m_pFontConfig->m_bInitialized )
+                FcConfigDestroy( static_cast<FcConfig*>(m_pFontConfig->m_pFcConfig) );
 #endif
 
-        delete m_pFontConfig;
+            delete m_pFontConfig;
+        }
     }
 
     // Whether or not it still exists, we no longer have anything to do with
@@ -0,0 +1,302 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "batch.hpp"
+#include "md_parser.hpp"
+
+// Qt include.
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+
+BatchResult
+convertFile( const BatchJob & job, const RenderOpts & opts, bool recursive,
+	QTextCodec * codec, FontStore * fonts, PdfRenderer * renderer, const QString & cacheDir,
+	int parserThreads )
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	BatchResult res;
+	res.m_input = job.m_input;
+	res.m_output = job.m_output;
+
+	MD::Parser parser;
+	// Document lives till the end of rendering, so strings may refer to the source.
+	parser.setSourceViews();
+	parser.setCacheDir( cacheDir );
+	parser.setThreadsCount( parserThreads );
+
+	auto doc = parser.parse( job.m_input, recursive, codec );
+
+	if( doc->isEmpty() )
+	{
+		res.m_status = BatchResult::Status::Empty;
+		res.m_message = QStringLiteral( "Markdown file is empty. Nothing saved." );
+	}
+	else
+	{
+		QDir().mkpath( QFileInfo( job.m_output ).absolutePath() );
+
+		QScopedPointer< PdfRenderer > own;
+
+		if( !renderer )
+		{
+			own.reset( new PdfRenderer );
+			renderer = own.data();
+		}
+
+		renderer->setFontStore( fonts );
+
+		bool terminated = false;
+
+		const auto errorConnection = QObject::connect( renderer, &PdfRenderer::error,
+			[&res] ( const QString & msg ) { res.m_message = msg; } );
+		const auto doneConnection = QObject::connect( renderer, &PdfRenderer::done,
+			[&terminated] ( bool t ) { terminated = t; } );
+
+		renderer->renderSync( job.m_output, doc, opts );
+
+		QObject::disconnect( errorConnection );
+		QObject::disconnect( doneConnection );
+
+		if( !res.m_message.isEmpty() )
+			res.m_status = BatchResult::Status::Error;
+		else if( terminated )
+			res.m_status = BatchResult::Status::Terminated;
+		else
+			res.m_status = BatchResult::Status::Ok;
+
+		res.m_pages = renderer->pagesCount();
+		res.m_bytes = QFileInfo( job.m_output ).size();
+	}
+
+	res.m_msecs = timer.elapsed();
+
+	return res;
+}
+
+QString
+statusToString( BatchResult::Status status )
+{
+	switch( status )
+	{
+		case BatchResult::Status::Ok :
+			return QStringLiteral( "ok" );
+
+		case BatchResult::Status::Empty :
+			return QStringLiteral( "empty" );
+
+		case BatchResult::Status::Error :
+			return QStringLiteral( "error" );
+
+		case BatchResult::Status::Terminated :
+			return QStringLiteral( "terminated" );
+	}
+
+	return QString();
+}
+
+
+namespace /* anonymous */ {
+
+//! \return Path of the PDF for the given Markdown file.
+QString
+outputFileName( const QString & rootDir, const QString & mdFile, const QString & outputDir )
+{
+	auto rel = QDir( rootDir ).relativeFilePath( mdFile );
+
+	if( rel.startsWith( QLatin1String( ".." ) ) )
+		rel = QFileInfo( mdFile ).fileName();
+
+	const QFileInfo info( rel );
+
+	return QDir::cleanPath( QDir( outputDir ).absoluteFilePath( info.path() +
+		QLatin1Char( '/' ) + info.completeBaseName() + QLatin1String( ".pdf" ) ) );
+}
+
+//
+// BatchTask
+//
+
+//! Task for thread pool, converts one file.
+class BatchTask final
+	:	public QRunnable
+{
+public:
+	BatchTask( const BatchJob & job, BatchResult * result, const RenderOpts & opts,
+		bool recursive, QTextCodec * codec, FontStore * fonts, const QString & cacheDir )
+		:	m_job( job )
+		,	m_result( result )
+		,	m_opts( opts )
+		,	m_recursive( recursive )
+		,	m_codec( codec )
+		,	m_fonts( fonts )
+		,	m_cacheDir( cacheDir )
+	{
+	}
+
+	void run() override
+	{
+		// Jobs are already concurrent, so the file is parsed in the thread of the job.
+		*m_result = convertFile( m_job, m_opts, m_recursive, m_codec, m_fonts, nullptr,
+			m_cacheDir, 1 );
+	}
+
+private:
+	BatchJob m_job;
+	BatchResult * m_result;
+	const RenderOpts & m_opts;
+	bool m_recursive;
+	QTextCodec * m_codec;
+	FontStore * m_fonts;
+	QString m_cacheDir;
+}; // class BatchTask
+
+} /* namespace anonymous */
+
+
+//
+// BatchConverter
+//
+
+BatchConverter::BatchConverter( const RenderOpts & opts, bool recursive, QTextCodec * codec,
+	int threadsCount )
+	:	m_opts( opts )
+	,	m_recursive( recursive )
+	,	m_codec( codec )
+	,	m_threadsCount( threadsCount > 0 ? threadsCount : QThread::idealThreadCount() )
+{
+}
+
+QVector< BatchJob >
+BatchConverter::collectJobs( const QString & input, const QString & outputDir,
+	QString & error )
+{
+	QVector< BatchJob > jobs;
+
+	const QFileInfo info( input );
+
+	if( info.isDir() )
+	{
+		QStringList files;
+
+		QDirIterator it( info.absoluteFilePath(), { QStringLiteral( "*.md" ) },
+			QDir::Files, QDirIterator::Subdirectories );
+
+		while( it.hasNext() )
+			files.append( it.next() );
+
+		files.sort();
+
+		for( const auto & f : qAsConst( files ) )
+			jobs.append( { f, outputFileName( info.absoluteFilePath(), f, outputDir ) } );
+	}
+	else
+	{
+		QFile manifest( input );
+
+		if( !manifest.open( QIODevice::ReadOnly | QIODevice::Text ) )
+		{
+			error = QStringLiteral( "Unable to open manifest: %1." ).arg( input );
+
+			return jobs;
+		}
+
+		const auto rootDir = info.absolutePath();
+
+		QTextStream stream( &manifest );
+
+		while( !stream.atEnd() )
+		{
+			const auto line = stream.readLine().trimmed();
+
+			if( line.isEmpty() || line.startsWith( QLatin1Char( '#' ) ) )
+				continue;
+
+			const auto f = QDir( rootDir ).absoluteFilePath( line );
+
+			jobs.append( { f, outputFileName( rootDir, f, outputDir ) } );
+		}
+	}
+
+	if( jobs.isEmpty() )
+		error = QStringLiteral( "No Markdown files found in %1." ).arg( input );
+
+	return jobs;
+}
+
+bool
+BatchConverter::writeReport( const QString & fileName, const QVector< BatchResult > & results )
+{
+	QFile file( fileName );
+
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+		return false;
+
+	QTextStream stream( &file );
+	stream.setCodec( "UTF-8" );
+
+	stream << "input\toutput\tstatus\tpages\tbytes\tmsecs\tmessage\n";
+
+	for( const auto & r : results )
+		stream << r.m_input << '\t' << r.m_output << '\t' << statusToString( r.m_status )
+			<< '\t' << r.m_pages << '\t' << r.m_bytes << '\t' << r.m_msecs << '\t'
+			<< r.m_message.simplified() << '\n';
+
+	stream.flush();
+
+	return ( stream.status() == QTextStream::Ok );
+}
+
+QVector< BatchResult >
+BatchConverter::run( const QVector< BatchJob > & jobs )
+{
+	QVector< BatchResult > results( jobs.size() );
+	auto * r = results.data();
+
+	QThreadPool pool;
+	pool.setMaxThreadCount( m_threadsCount );
+
+	for( int i = 0; i < jobs.size(); ++i )
+		pool.start( new BatchTask( jobs.at( i ), r + i, m_opts, m_recursive, m_codec,
+			&m_fonts, m_cacheDir ) );
+
+	pool.waitForDone();
+
+	return results;
+}
+
+void
+BatchConverter::setCacheDir( const QString & dir )
+{
+	m_cacheDir = dir;
+}
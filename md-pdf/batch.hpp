@@ -0,0 +1,127 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_BATCH_HPP_INCLUDED
+#define MD_PDF_BATCH_HPP_INCLUDED
+
+// md-pdf include.
+#include "renderer.hpp"
+#include "font_store.hpp"
+
+// Qt include.
+#include <QVector>
+#include <QTextCodec>
+
+
+//
+// BatchJob
+//
+
+//! Single conversion job.
+struct BatchJob
+{
+	//! Root Markdown file.
+	QString m_input;
+	//! PDF file to write.
+	QString m_output;
+}; // struct BatchJob
+
+
+//
+// BatchResult
+//
+
+//! Result of the conversion job.
+struct BatchResult
+{
+	enum class Status {
+		//! PDF was written.
+		Ok,
+		//! Markdown is empty, nothing saved.
+		Empty,
+		//! Error occured, PDF is broken or not written.
+		Error,
+		//! Rendering was terminated.
+		Terminated
+	}; // enum class Status
+
+	QString m_input;
+	QString m_output;
+	Status m_status = Status::Ok;
+	QString m_message;
+	int m_pages = 0;
+	qint64 m_bytes = 0;
+	qint64 m_msecs = 0;
+}; // struct BatchResult
+
+
+//! Convert one Markdown file to PDF in the calling thread.
+//! \note If \a renderer is given it will be used, so rendering can be terminated
+//! from another thread. If \a cacheDir is not empty parsed files are cached in it.
+//! \a parserThreads limits threads of parsing, see MD::Parser::setThreadsCount().
+BatchResult convertFile( const BatchJob & job, const RenderOpts & opts, bool recursive,
+	QTextCodec * codec, FontStore * fonts, PdfRenderer * renderer = nullptr,
+	const QString & cacheDir = QString(), int parserThreads = 0 );
+
+//! \return String representation of the status.
+QString statusToString( BatchResult::Status status );
+
+
+//
+// BatchConverter
+//
+
+//! Converter of a lot of Markdown files on a pool of threads.
+//! Each file is parsed in the thread of its job, so \a threadsCount bounds all threads.
+class BatchConverter final
+{
+public:
+	BatchConverter( const RenderOpts & opts, bool recursive, QTextCodec * codec,
+		int threadsCount );
+	~BatchConverter() = default;
+
+	//! Collect jobs from the directory tree (all *.md files in it), or from the
+	//! manifest file (root Markdown file per line, relative to the manifest).
+	//! PDFs will be placed into \a outputDir with the same relative paths.
+	static QVector< BatchJob > collectJobs( const QString & input, const QString & outputDir,
+		QString & error );
+	//! Write report with results of the jobs, one tab-separated line per job.
+	static bool writeReport( const QString & fileName, const QVector< BatchResult > & results );
+
+	//! Run jobs and wait for them. \return Results in the order of jobs.
+	QVector< BatchResult > run( const QVector< BatchJob > & jobs );
+
+	//! Set directory of on-disk cache of parsed files, empty - no cache.
+	void setCacheDir( const QString & dir );
+
+private:
+	Q_DISABLE_COPY( BatchConverter )
+
+	RenderOpts m_opts;
+	bool m_recursive;
+	QTextCodec * m_codec;
+	int m_threadsCount;
+	FontStore m_fonts;
+	QString m_cacheDir;
+}; // class BatchConverter
+
+#endif // MD_PDF_BATCH_HPP_INCLUDED
@@ -0,0 +1,317 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "daemon.hpp"
+
+// Qt include.
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+// C++ include.
+#include <iostream>
+#include <string>
+
+
+namespace /* anonymous */ {
+
+//
+// DaemonWorker
+//
+
+//! Worker of the daemon.
+class DaemonWorker final
+	:	public QRunnable
+{
+public:
+	explicit DaemonWorker( Daemon * daemon )
+		:	m_daemon( daemon )
+	{
+	}
+
+	void run() override
+	{
+		m_daemon->work();
+	}
+
+private:
+	Daemon * m_daemon;
+}; // class DaemonWorker
+
+} /* namespace anonymous */
+
+
+//
+// Daemon
+//
+
+Daemon::Daemon( const RenderOpts & opts, bool recursive, QTextCodec * codec,
+	int threadsCount )
+	:	m_opts( opts )
+	,	m_recursive( recursive )
+	,	m_codec( codec )
+	,	m_threadsCount( threadsCount > 0 ? threadsCount : QThread::idealThreadCount() )
+	,	m_counter( 0 )
+	,	m_finished( false )
+{
+}
+
+int
+Daemon::exec()
+{
+	if( !m_out.open( stdout, QIODevice::WriteOnly ) )
+		return 1;
+
+	// Load fontconfig configuration before the first job.
+	m_fonts.fontPath( m_opts.m_textFont, false, false );
+	m_fonts.fontPath( m_opts.m_textFont, true, false );
+	m_fonts.fontPath( m_opts.m_textFont, false, true );
+	m_fonts.fontPath( m_opts.m_textFont, true, true );
+	m_fonts.fontPath( m_opts.m_codeFont, false, false );
+
+	m_pool.setMaxThreadCount( m_threadsCount );
+
+	for( int i = 0; i < m_threadsCount; ++i )
+		m_pool.start( new DaemonWorker( this ) );
+
+	std::string line;
+
+	while( std::getline( std::cin, line ) )
+	{
+		const auto request = QByteArray::fromStdString( line ).trimmed();
+
+		if( !request.isEmpty() )
+			handleRequest( request );
+	}
+
+	{
+		QMutexLocker lock( &m_mutex );
+
+		m_finished = true;
+	}
+
+	m_cond.wakeAll();
+
+	m_pool.waitForDone();
+
+	return 0;
+}
+
+void
+Daemon::work()
+{
+	while( true )
+	{
+		Job job;
+		PdfRenderer pdf;
+
+		if( !takeJob( job, &pdf ) )
+			break;
+
+		// Jobs are already concurrent, so the file is parsed in the thread of the job.
+		const auto res = convertFile( job.m_job, m_opts, job.m_recursive, m_codec,
+			&m_fonts, &pdf, m_cacheDir, 1 );
+
+		{
+			QMutexLocker lock( &m_mutex );
+
+			m_running.remove( job.m_id );
+		}
+
+		if( res.m_status == BatchResult::Status::Terminated )
+			QFile::remove( res.m_output );
+
+		QJsonObject obj;
+		obj.insert( QStringLiteral( "id" ), job.m_id );
+		obj.insert( QStringLiteral( "status" ), statusToString( res.m_status ) );
+		obj.insert( QStringLiteral( "input" ), res.m_input );
+		obj.insert( QStringLiteral( "output" ), res.m_output );
+		obj.insert( QStringLiteral( "pages" ), res.m_pages );
+		obj.insert( QStringLiteral( "bytes" ), res.m_bytes );
+		obj.insert( QStringLiteral( "msecs" ), res.m_msecs );
+
+		if( !res.m_message.isEmpty() )
+			obj.insert( QStringLiteral( "message" ), res.m_message );
+
+		reply( obj );
+	}
+}
+
+void
+Daemon::setCacheDir( const QString & dir )
+{
+	m_cacheDir = dir;
+}
+
+void
+Daemon::handleRequest( const QByteArray & line )
+{
+	QJsonParseError error;
+
+	const auto json = QJsonDocument::fromJson( line, &error );
+
+	if( error.error != QJsonParseError::NoError || !json.isObject() )
+	{
+		replyError( QString(), QStringLiteral( "Wrong request: %1." )
+			.arg( QString::fromUtf8( line ) ) );
+
+		return;
+	}
+
+	const auto obj = json.object();
+
+	if( obj.contains( QStringLiteral( "cancel" ) ) )
+	{
+		cancel( obj.value( QStringLiteral( "cancel" ) ).toVariant().toString() );
+
+		return;
+	}
+
+	Job job;
+	job.m_id = obj.value( QStringLiteral( "id" ) ).toVariant().toString();
+	job.m_recursive = obj.value( QStringLiteral( "recursive" ) ).toBool( m_recursive );
+	job.m_job.m_input = obj.value( QStringLiteral( "input" ) ).toString();
+	job.m_job.m_output = obj.value( QStringLiteral( "output" ) ).toString();
+
+	if( job.m_id.isEmpty() || job.m_job.m_input.isEmpty() )
+	{
+		replyError( job.m_id, QStringLiteral( "Job should have id and input." ) );
+
+		return;
+	}
+
+	if( job.m_job.m_output.isEmpty() )
+	{
+		const QFileInfo info( job.m_job.m_input );
+
+		job.m_job.m_output = info.absolutePath() + QLatin1Char( '/' ) +
+			info.completeBaseName() + QLatin1String( ".pdf" );
+	}
+
+	enqueue( job );
+}
+
+void
+Daemon::enqueue( const Job & job )
+{
+	{
+		QMutexLocker lock( &m_mutex );
+
+		if( !m_queued.contains( job.m_id ) && !m_running.contains( job.m_id ) )
+		{
+			const JobKey key( QFileInfo( job.m_job.m_input ).size(), m_counter++ );
+
+			m_queue.insert( key, job );
+			m_queued.insert( job.m_id, key );
+
+			m_cond.wakeOne();
+
+			return;
+		}
+	}
+
+	replyError( job.m_id, QStringLiteral( "Job with the same id is already in progress." ) );
+}
+
+void
+Daemon::cancel( const QString & id )
+{
+	{
+		QMutexLocker lock( &m_mutex );
+
+		const auto it = m_running.constFind( id );
+
+		if( it != m_running.cend() )
+		{
+			it.value()->terminate();
+
+			return;
+		}
+
+		if( !m_queued.contains( id ) )
+		{
+			lock.unlock();
+
+			replyError( id, QStringLiteral( "There is no such job." ) );
+
+			return;
+		}
+
+		m_queue.remove( m_queued.take( id ) );
+	}
+
+	QJsonObject obj;
+	obj.insert( QStringLiteral( "id" ), id );
+	obj.insert( QStringLiteral( "status" ),
+		statusToString( BatchResult::Status::Terminated ) );
+
+	reply( obj );
+}
+
+bool
+Daemon::takeJob( Job & job, PdfRenderer * renderer )
+{
+	QMutexLocker lock( &m_mutex );
+
+	while( m_queue.isEmpty() && !m_finished )
+		m_cond.wait( &m_mutex );
+
+	if( m_queue.isEmpty() )
+		return false;
+
+	job = m_queue.first();
+	m_queue.erase( m_queue.begin() );
+	m_queued.remove( job.m_id );
+
+	// Job is registered as running right now, so it can't be lost
+	// for cancellation between the queue and the renderer.
+	m_running.insert( job.m_id, renderer );
+
+	return true;
+}
+
+void
+Daemon::reply( const QJsonObject & obj )
+{
+	QMutexLocker lock( &m_outMutex );
+
+	m_out.write( QJsonDocument( obj ).toJson( QJsonDocument::Compact ) );
+	m_out.write( "\n" );
+	m_out.flush();
+}
+
+void
+Daemon::replyError( const QString & id, const QString & msg )
+{
+	QJsonObject obj;
+
+	if( !id.isEmpty() )
+		obj.insert( QStringLiteral( "id" ), id );
+
+	obj.insert( QStringLiteral( "status" ), statusToString( BatchResult::Status::Error ) );
+	obj.insert( QStringLiteral( "message" ), msg );
+
+	reply( obj );
+}
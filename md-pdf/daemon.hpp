@@ -0,0 +1,111 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_DAEMON_HPP_INCLUDED
+#define MD_PDF_DAEMON_HPP_INCLUDED
+
+// md-pdf include.
+#include "batch.hpp"
+
+// Qt include.
+#include <QMap>
+#include <QHash>
+#include <QPair>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QJsonObject>
+
+
+//
+// Daemon
+//
+
+//! Long-lived conversion server. Reads jobs from stdin as line-delimited JSON
+//! and writes results to stdout, one JSON object per line.
+//!
+//! Job: {"id": "1", "input": "a.md", "output": "a.pdf", "recursive": true},
+//! "output" and "recursive" are optional.
+//! Cancellation: {"cancel": "1"}.
+//!
+//! Queued jobs are taken in the order of size of the root Markdown file,
+//! so small documents are not stuck behind huge ones. Fonts lookups are
+//! shared by all jobs during the whole life of the daemon. Each file is
+//! parsed in the thread of its job, so there are no more threads than jobs.
+class Daemon final
+{
+public:
+	Daemon( const RenderOpts & opts, bool recursive, QTextCodec * codec, int threadsCount );
+	~Daemon() = default;
+
+	//! Process requests until the end of input, then wait for queued jobs.
+	//! \return Exit code.
+	int exec();
+
+	//! Take and process jobs until the end of input and empty queue.
+	//! Invoked in worker threads.
+	void work();
+
+	//! Set directory of on-disk cache of parsed files, empty - no cache.
+	void setCacheDir( const QString & dir );
+
+private:
+	Q_DISABLE_COPY( Daemon )
+
+	//! Queued job.
+	struct Job {
+		QString m_id;
+		BatchJob m_job;
+		bool m_recursive = true;
+	}; // struct Job
+
+	//! Key of the job in the queue: size of the input and sequence number.
+	using JobKey = QPair< qint64, quint64 >;
+
+	void handleRequest( const QByteArray & line );
+	void enqueue( const Job & job );
+	void cancel( const QString & id );
+	bool takeJob( Job & job, PdfRenderer * renderer );
+	void reply( const QJsonObject & obj );
+	void replyError( const QString & id, const QString & msg );
+
+private:
+	RenderOpts m_opts;
+	bool m_recursive;
+	QTextCodec * m_codec;
+	int m_threadsCount;
+	FontStore m_fonts;
+	QString m_cacheDir;
+	QMutex m_mutex;
+	QWaitCondition m_cond;
+	QMap< JobKey, Job > m_queue;
+	QHash< QString, JobKey > m_queued;
+	QHash< QString, PdfRenderer* > m_running;
+	quint64 m_counter;
+	bool m_finished;
+	QMutex m_outMutex;
+	QFile m_out;
+	QThreadPool m_pool;
+}; // class Daemon
+
+#endif // MD_PDF_DAEMON_HPP_INCLUDED
@@ -0,0 +1,73 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "font_store.hpp"
+
+// podofo include.
+#include <podofo/base/util/PdfMutexWrapper.h>
+
+
+//
+// FontStore
+//
+
+QString
+FontStore::fontPath( const QString & name, bool bold, bool italic )
+{
+	const auto key = name + QLatin1Char( bold ? 'b' : '-' ) + QLatin1Char( italic ? 'i' : '-' );
+
+	{
+		QReadLocker lock( &m_lock );
+
+		const auto it = m_paths.constFind( key );
+
+		if( it != m_paths.cend() )
+			return it.value();
+	}
+
+	QWriteLocker lock( &m_lock );
+
+	const auto it = m_paths.constFind( key );
+
+	if( it != m_paths.cend() )
+		return it.value();
+
+	QString path;
+
+#if defined( PODOFO_HAVE_FONTCONFIG )
+	{
+		PoDoFo::Util::PdfMutexWrapper fcLock( m_fontConfig.GetFontConfigMutex() );
+
+		path = QString::fromLocal8Bit( PoDoFo::PdfFontCache::GetFontConfigFontPath(
+			static_cast< FcConfig* > ( m_fontConfig.GetFontConfig() ),
+			name.toLocal8Bit().data(), bold, italic ).c_str() );
+	}
+#else
+	Q_UNUSED( bold )
+	Q_UNUSED( italic )
+#endif
+
+	m_paths.insert( key, path );
+
+	return path;
+}
@@ -0,0 +1,61 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_FONT_STORE_HPP_INCLUDED
+#define MD_PDF_FONT_STORE_HPP_INCLUDED
+
+// Qt include.
+#include <QString>
+#include <QHash>
+#include <QReadWriteLock>
+
+// podofo include.
+#include <podofo/podofo.h>
+
+
+//
+// FontStore
+//
+
+//! Font data shared between renderers working in different threads.
+//! Fontconfig is initialized only once for all renderers, and results
+//! of fonts lookups are cached, so every new PDF document doesn't
+//! load fontconfig configuration from scratch.
+class FontStore final
+{
+public:
+	FontStore() = default;
+	~FontStore() = default;
+
+	//! \return Path to the file of the font, or empty string if font wasn't found.
+	//! \note Thread-safe.
+	QString fontPath( const QString & name, bool bold, bool italic );
+
+private:
+	Q_DISABLE_COPY( FontStore )
+
+	QReadWriteLock m_lock;
+	PoDoFo::PdfFontConfigWrapper m_fontConfig;
+	QHash< QString, QString > m_paths;
+}; // class FontStore
+
+#endif // MD_PDF_FONT_STORE_HPP_INCLUDED
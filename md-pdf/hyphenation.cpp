@@ -0,0 +1,382 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "hyphenation.hpp"
+
+// Qt include.
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+// C++ include.
+#include <algorithm>
+
+
+//
+// Hyphenator
+//
+
+bool
+Hyphenator::load( const QString & fileName )
+{
+	QFile f( fileName );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	QTextStream stream( &f );
+	stream.setCodec( "UTF-8" );
+
+	return parse( stream.readAll() );
+}
+
+bool
+Hyphenator::parse( const QString & text )
+{
+	QSharedPointer< Patterns > patterns( new Patterns );
+
+	patterns->m_nodes.append( Patterns::Node() );
+
+	// Comments are till the end of the line.
+	QString data;
+
+	for( const auto & line : text.split( QLatin1Char( '\n' ) ) )
+	{
+		data.append( line.left( line.indexOf( QLatin1Char( '%' ) ) ) );
+		data.append( QLatin1Char( ' ' ) );
+	}
+
+	if( !data.contains( QLatin1Char( '\\' ) ) )
+	{
+		for( const auto & p : data.simplified().split( QLatin1Char( ' ' ), QString::SkipEmptyParts ) )
+			patterns->addPattern( p );
+	}
+	else
+	{
+		int pos = 0;
+
+		while( ( pos = data.indexOf( QLatin1Char( '\\' ), pos ) ) > -1 )
+		{
+			const int open = data.indexOf( QLatin1Char( '{' ), pos );
+			const int close = data.indexOf( QLatin1Char( '}' ), open );
+
+			if( open < 0 || close < 0 )
+				break;
+
+			const auto command = data.midRef( pos + 1, open - pos - 1 ).trimmed();
+			const auto words = data.mid( open + 1, close - open - 1 ).simplified()
+				.split( QLatin1Char( ' ' ), QString::SkipEmptyParts );
+
+			if( command == QLatin1String( "patterns" ) )
+			{
+				for( const auto & p : words )
+					patterns->addPattern( p );
+			}
+			else if( command == QLatin1String( "hyphenation" ) )
+			{
+				for( const auto & w : words )
+					patterns->addException( w );
+			}
+
+			pos = close + 1;
+		}
+	}
+
+	patterns->pack();
+
+	m_patterns = patterns;
+	m_cache.clear();
+
+	return !isEmpty();
+}
+
+bool
+Hyphenator::isEmpty() const
+{
+	return ( !m_patterns ||
+		( m_patterns->m_states.size() < 2 && m_patterns->m_exceptions.isEmpty() ) );
+}
+
+QVector< int >
+Hyphenator::hyphenate( const QStringRef & word )
+{
+	if( !m_patterns )
+		return QVector< int > ();
+
+	const auto key = word.toString();
+	const auto it = m_cache.constFind( key );
+
+	if( it != m_cache.constEnd() )
+		return it.value();
+
+	QVector< int > points;
+
+	// Every sequence of letters is hyphenated alone, so punctuation
+	// and parts of identifiers don't spoil patterns.
+	for( int i = 0; i < word.size(); )
+	{
+		if( !word.at( i ).isLetter() )
+		{
+			++i;
+
+			continue;
+		}
+
+		int j = i;
+
+		while( j < word.size() && word.at( j ).isLetter() )
+			++j;
+
+		const auto letters = word.mid( i, j - i ).toString().toLower();
+
+		for( const auto p : m_patterns->hyphenateLetters( letters ) )
+			points.append( i + p );
+
+		i = j;
+	}
+
+	m_cache.insert( key, points );
+
+	return points;
+}
+
+void
+Hyphenator::Patterns::addPattern( const QString & pattern )
+{
+	int node = 0;
+	// Value before every letter and after the last one.
+	QVector< uchar > values( 1, 0 );
+
+	for( const auto & c : pattern )
+	{
+		if( c.isDigit() )
+			values.last() = static_cast< uchar > ( c.digitValue() );
+		else
+		{
+			const auto letter = c.toLower();
+
+			if( !m_codes.contains( letter ) )
+				m_codes.insert( letter, m_codes.size() + 1 );
+
+			const int code = m_codes.value( letter );
+			const auto child = m_nodes.at( node ).m_children.constFind( code );
+
+			if( child == m_nodes.at( node ).m_children.constEnd() )
+			{
+				m_nodes.append( Node() );
+				m_nodes[ node ].m_children.insert( code, m_nodes.size() - 1 );
+				node = m_nodes.size() - 1;
+			}
+			else
+				node = child.value();
+
+			values.append( 0 );
+		}
+	}
+
+	if( !node )
+		return;
+
+	while( values.size() > 1 && !values.last() )
+		values.removeLast();
+
+	m_nodes[ node ].m_values = m_values.size();
+	m_values.append( static_cast< uchar > ( values.size() ) );
+	m_values.append( values );
+}
+
+void
+Hyphenator::Patterns::addException( const QString & word )
+{
+	QString letters;
+	QVector< int > points;
+
+	for( const auto & c : word )
+	{
+		if( c == QLatin1Char( '-' ) )
+			points.append( letters.size() );
+		else
+			letters.append( c.toLower() );
+	}
+
+	m_exceptions.insert( letters, points );
+}
+
+void
+Hyphenator::Patterns::pack()
+{
+	m_states.resize( 1 );
+	// Root is never a transition, but it's not free.
+	m_states[ 0 ].m_check = 0;
+
+	// Nodes are packed breadth first, pairs of node and its state.
+	QVector< QPair< int, int > > queue = { qMakePair( 0, 0 ) };
+	int firstFree = 1;
+
+	for( int q = 0; q < queue.size(); ++q )
+	{
+		const auto & node = m_nodes.at( queue.at( q ).first );
+		const int state = queue.at( q ).second;
+
+		m_states[ state ].m_values = node.m_values;
+
+		if( node.m_children.isEmpty() )
+			continue;
+
+		const auto codes = node.m_children.keys();
+		const int minCode = *std::min_element( codes.cbegin(), codes.cend() );
+		const int maxCode = *std::max_element( codes.cbegin(), codes.cend() );
+
+		// The first base where all transitions are free.
+		int base = qMax( 0, firstFree - minCode );
+
+		for( bool fits = false; !fits; )
+		{
+			fits = true;
+
+			for( const auto c : codes )
+			{
+				if( base + c < m_states.size() && m_states.at( base + c ).m_check != -1 )
+				{
+					fits = false;
+					++base;
+
+					break;
+				}
+			}
+		}
+
+		if( base + maxCode >= m_states.size() )
+			m_states.resize( base + maxCode + 1 );
+
+		m_states[ state ].m_base = base;
+
+		for( auto it = node.m_children.cbegin(), last = node.m_children.cend(); it != last; ++it )
+		{
+			m_states[ base + it.key() ].m_check = state;
+			queue.append( qMakePair( it.value(), base + it.key() ) );
+		}
+
+		while( firstFree < m_states.size() && m_states.at( firstFree ).m_check != -1 )
+			++firstFree;
+	}
+
+	m_nodes.clear();
+	m_nodes.squeeze();
+}
+
+QVector< int >
+Hyphenator::Patterns::hyphenateLetters( const QString & letters ) const
+{
+	// Exceptions are hyphenated as they are written, whatever length they have.
+	const auto exception = m_exceptions.constFind( letters );
+
+	if( exception != m_exceptions.constEnd() )
+		return exception.value();
+
+	const int length = letters.size();
+
+	if( length < c_leftMin + c_rightMin || m_states.isEmpty() )
+		return QVector< int > ();
+
+	// Word with dots at the edges, as in patterns.
+	QVector< int > codes( length + 2, code( QLatin1Char( '.' ) ) );
+
+	for( int i = 0; i < length; ++i )
+		codes[ i + 1 ] = code( letters.at( i ) );
+
+	QVector< uchar > values( length + 3, 0 );
+
+	for( int i = 0; i < codes.size(); ++i )
+	{
+		int state = 0;
+
+		for( int j = i; j < codes.size() && codes.at( j ); ++j )
+		{
+			const int next = m_states.at( state ).m_base + codes.at( j );
+
+			if( next >= m_states.size() || m_states.at( next ).m_check != state )
+				break;
+
+			state = next;
+
+			const int v = m_states.at( state ).m_values;
+
+			if( v > -1 )
+			{
+				for( int k = 0, count = m_values.at( v ); k < count; ++k )
+					values[ i + k ] = qMax( values.at( i + k ), m_values.at( v + 1 + k ) );
+			}
+		}
+	}
+
+	QVector< int > points;
+
+	// Value before letter of the word is after the leading dot.
+	for( int p = c_leftMin; p <= length - c_rightMin; ++p )
+	{
+		if( values.at( p + 1 ) % 2 )
+			points.append( p );
+	}
+
+	return points;
+}
+
+int
+Hyphenator::Patterns::code( QChar c ) const
+{
+	return m_codes.value( c, 0 );
+}
+
+
+//
+// HyphenationStore
+//
+
+Hyphenator
+HyphenationStore::hyphenator( const QString & fileName )
+{
+	{
+		QReadLocker lock( &m_lock );
+
+		const auto it = m_hyphenators.constFind( fileName );
+
+		if( it != m_hyphenators.cend() )
+			return it.value();
+	}
+
+	QWriteLocker lock( &m_lock );
+
+	const auto it = m_hyphenators.constFind( fileName );
+
+	if( it != m_hyphenators.cend() )
+		return it.value();
+
+	Hyphenator h;
+
+	// Files that can't be loaded are not remembered, they may appear later.
+	if( h.load( fileName ) )
+		m_hyphenators.insert( fileName, h );
+
+	return h;
+}
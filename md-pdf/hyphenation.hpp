@@ -0,0 +1,137 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_HYPHENATION_HPP_INCLUDED
+#define MD_PDF_HYPHENATION_HPP_INCLUDED
+
+// Qt include.
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QSharedPointer>
+#include <QReadWriteLock>
+
+
+//
+// Hyphenator
+//
+
+//! Hyphenation of words with Liang's patterns in TeX format.
+//!
+//! Patterns are kept in packed trie: states of all nodes are in one array,
+//! transition from the state by the letter is the state at base of the state
+//! plus code of the letter, if it's checked to belong to the state.
+//!
+//! Copies of the hyphenator share patterns read-only, hyphenated words
+//! are memoised by every copy on its own.
+class Hyphenator final
+{
+public:
+	Hyphenator() = default;
+
+	//! Load patterns from the file, see parse(). \return false on error.
+	bool load( const QString & fileName );
+	//! Replace patterns with patterns and exceptions from the text, it's
+	//! \\patterns{...} and \\hyphenation{...} of TeX, or one pattern per line.
+	//! \return false if there are no patterns.
+	bool parse( const QString & text );
+
+	//! \return Is there no patterns.
+	bool isEmpty() const;
+
+	//! \return Positions of letters before which the word can be hyphenated.
+	//! Positions are memoised for every word.
+	QVector< int > hyphenate( const QStringRef & word );
+
+	//! Count of letters at the start of the word that are never hyphenated.
+	static const int c_leftMin = 2;
+	//! Count of letters at the end of the word that are never hyphenated.
+	static const int c_rightMin = 3;
+
+private:
+	//! Patterns, they aren't changed after they are packed.
+	struct Patterns {
+		//! Add pattern to the trie being built.
+		void addPattern( const QString & pattern );
+		//! Add hyphenated word from exceptions.
+		void addException( const QString & word );
+		//! Pack the trie being built.
+		void pack();
+		//! \return Positions of letters before which the letters can be hyphenated.
+		QVector< int > hyphenateLetters( const QString & letters ) const;
+		//! \return Code of the character, 0 if it's not in patterns.
+		int code( QChar c ) const;
+
+		//! State of packed trie.
+		struct State {
+			//! Index of the first state of transitions from this state.
+			int m_base = 0;
+			//! State this state is transition from, -1 if it's free.
+			int m_check = -1;
+			//! Index of values of the pattern ending here in m_values, -1 if none.
+			int m_values = -1;
+		}; // struct State
+
+		//! Node of the trie while patterns are loaded.
+		struct Node {
+			QHash< int, int > m_children;
+			int m_values = -1;
+		}; // struct Node
+
+		QHash< QChar, int > m_codes;
+		QVector< State > m_states;
+		//! Values of patterns, count of values and then values.
+		QVector< uchar > m_values;
+		QVector< Node > m_nodes;
+		QHash< QString, QVector< int > > m_exceptions;
+	}; // struct Patterns
+
+	QSharedPointer< const Patterns > m_patterns;
+	QHash< QString, QVector< int > > m_cache;
+}; // class Hyphenator
+
+
+//
+// HyphenationStore
+//
+
+//! Patterns shared between renderers working in different threads.
+//! Every file of patterns is loaded only once, renderers get copies
+//! of its hyphenator with their own memo of hyphenated words.
+class HyphenationStore final
+{
+public:
+	HyphenationStore() = default;
+	~HyphenationStore() = default;
+
+	//! \return Hyphenator with patterns of the file, it's empty on error.
+	//! \note Thread-safe.
+	Hyphenator hyphenator( const QString & fileName );
+
+private:
+	Q_DISABLE_COPY( HyphenationStore )
+
+	QReadWriteLock m_lock;
+	QHash< QString, Hyphenator > m_hyphenators;
+}; // class HyphenationStore
+
+#endif // MD_PDF_HYPHENATION_HPP_INCLUDED
@@ -0,0 +1,628 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "layout.hpp"
+
+
+//! Penalty of every line, paragraph with less lines is better.
+static const double c_linePenalty = 10.0;
+//! Penalty of the line ending with hyphen.
+static const double c_hyphenPenalty = 50.0;
+//! Badness of the line that can't be justified well.
+static const double c_maxBadness = 10000.0;
+//! Spaces of justified line shrink at most by this part of their width.
+static const double c_spaceShrink = 1.0 / 3.0;
+//! Scale of spaces of the line above which the word after it is hyphenated.
+static const double c_looseScale = 150.0;
+//! Max count of breaks the next line may start from.
+static const int c_maxActiveNodes = 128;
+
+
+namespace /* anonymous */ {
+
+//! \return Badness of the line with spaces stretched or shrunk with the given ratio.
+double
+badness( double ratio )
+{
+	return qMin( 100.0 * ratio * ratio * ratio, c_maxBadness );
+}
+
+//! \return Does the box ending at \a x fit into the line.
+//! Box that goes beyond the line less than by 0.01 still fits.
+bool
+fits( double x, double lineWidth )
+{
+	return ( x < lineWidth || qAbs( x - lineWidth ) < 0.01 );
+}
+
+} /* namespace anonymous */
+
+
+//
+// ParagraphLayout
+//
+
+ParagraphLayout::Breaking
+ParagraphLayout::breaking() const
+{
+	return m_breaking;
+}
+
+void
+ParagraphLayout::setBreaking( Breaking b )
+{
+	m_breaking = b;
+}
+
+Hyphenator *
+ParagraphLayout::hyphenator() const
+{
+	return m_hyphenator;
+}
+
+void
+ParagraphLayout::setHyphenator( Hyphenator * h )
+{
+	m_hyphenator = h;
+}
+
+void
+ParagraphLayout::layout( const QVector< LayoutRun > & runs, double lineWidth,
+	LayoutMetrics & metrics )
+{
+	static const QString charsWithoutSpaceBefore = QLatin1String( ".,;" );
+	static const QString space = QLatin1String( " " );
+
+	m_boxes.clear();
+	m_lines.clear();
+	m_hyphenWidths.clear();
+
+	// Words and spaces since the last hard break.
+	QVector< LayoutBox > items;
+	// Last hard break was a line break, so the line counts even without words.
+	bool opened = false;
+
+	auto addItem = [&items] ( int run, int word, bool leading, double width )
+	{
+		LayoutBox box;
+		box.m_run = run;
+		box.m_word = word;
+		box.m_leading = leading;
+		box.m_width = width;
+
+		items.append( box );
+	};
+
+	for( int r = 0, count = runs.size(); r < count; ++r )
+	{
+		const auto & run = runs.at( r );
+
+		switch( run.m_type )
+		{
+			case LayoutRun::Type::LineBreak :
+			{
+				breakSegment( runs, items, run.m_lineHeight, lineWidth, metrics );
+
+				items.clear();
+				opened = true;
+			}
+				break;
+
+			case LayoutRun::Type::Image :
+			{
+				if( opened || !items.isEmpty() )
+					breakSegment( runs, items, run.m_lineHeight, lineWidth, metrics );
+
+				items.clear();
+
+				LayoutLine image;
+				image.m_first = m_boxes.size();
+				image.m_image = r;
+				image.m_height = run.m_lineHeight;
+
+				m_lines.append( image );
+
+				opened = false;
+			}
+				break;
+
+			case LayoutRun::Type::Text :
+			{
+				if( run.m_words.isEmpty() )
+					break;
+
+				if( !items.isEmpty() && !charsWithoutSpaceBefore.contains( word( run, 0 ) ) )
+					addItem( r, -1, true,
+						metrics.stringWidth( run.m_spaceFont, QStringRef( &space ) ) );
+
+				const auto sw = metrics.stringWidth( run.m_font, QStringRef( &space ) );
+
+				for( int i = 0; i < run.m_words.size(); ++i )
+				{
+					if( i > 0 )
+						addItem( r, -1, false, sw );
+
+					addItem( r, i, false, metrics.stringWidth( run.m_font, word( run, i ) ) );
+				}
+			}
+				break;
+		}
+	}
+
+	if( opened || !items.isEmpty() )
+		breakSegment( runs, items, 0.0, lineWidth, metrics );
+}
+
+const QVector< LayoutLine > &
+ParagraphLayout::lines() const
+{
+	return m_lines;
+}
+
+const QVector< LayoutBox > &
+ParagraphLayout::boxes() const
+{
+	return m_boxes;
+}
+
+QStringRef
+ParagraphLayout::word( const LayoutRun & run, int idx )
+{
+	const auto & w = run.m_words.at( idx );
+
+	return run.m_text.midRef( w.first, w.second );
+}
+
+QString
+ParagraphLayout::text( const LayoutRun & run, const LayoutBox & box )
+{
+	if( box.m_word < 0 )
+		return QStringLiteral( " " );
+
+	auto t = word( run, box.m_word ).mid( box.m_from, box.m_length ).toString();
+
+	if( box.m_hyphen )
+		t.append( QLatin1Char( '-' ) );
+
+	return t;
+}
+
+void
+ParagraphLayout::breakSegment( const QVector< LayoutRun > & runs,
+	const QVector< LayoutBox > & items, double lastHeight, double lineWidth,
+	LayoutMetrics & metrics )
+{
+	if( m_breaking == Breaking::TotalFit )
+		breakTotalFit( runs, items, lastHeight, lineWidth, metrics );
+	else
+		breakGreedy( runs, items, lastHeight, lineWidth, metrics );
+}
+
+void
+ParagraphLayout::breakGreedy( const QVector< LayoutRun > & runs,
+	const QVector< LayoutBox > & items, double lastHeight, double lineWidth,
+	LayoutMetrics & metrics )
+{
+	int first = m_boxes.size();
+	double x = 0.0;
+	// Space before the next word.
+	int space = -1;
+
+	auto closeLine = [&] ( bool justify, double height )
+	{
+		addLine( first, justify, height, lineWidth );
+
+		first = m_boxes.size();
+		x = 0.0;
+	};
+
+	auto addBox = [&] ( const LayoutBox & box )
+	{
+		m_boxes.append( box );
+
+		x += box.m_width;
+	};
+
+	for( int i = 0; i < items.size(); ++i )
+	{
+		if( items.at( i ).m_word < 0 )
+		{
+			space = i;
+
+			continue;
+		}
+
+		auto box = items.at( i );
+		const auto & run = runs.at( box.m_run );
+
+		while( true )
+		{
+			// Space is not drawn at the start of the line.
+			const bool withSpace = ( space > -1 && m_boxes.size() > first );
+			const double sw = ( withSpace ? items.at( space ).m_width : 0.0 );
+			LayoutBox tail;
+
+			if( fits( x + sw + box.m_width, lineWidth ) )
+			{
+				if( withSpace )
+					addBox( items.at( space ) );
+
+				addBox( box );
+
+				break;
+			}
+			else if( hyphenate( run, box, lineWidth - x - sw, metrics, tail ) )
+			{
+				if( withSpace )
+					addBox( items.at( space ) );
+
+				addBox( box );
+				closeLine( true, run.m_lineHeight );
+
+				box = tail;
+			}
+			else if( m_boxes.size() > first )
+				closeLine( true, run.m_lineHeight );
+			else
+			{
+				// Word wider than the line takes the line alone.
+				addBox( box );
+				closeLine( true, run.m_lineHeight );
+
+				break;
+			}
+		}
+
+		space = -1;
+	}
+
+	if( m_boxes.size() > first || items.isEmpty() )
+		closeLine( false, lastHeight );
+}
+
+void
+ParagraphLayout::breakTotalFit( const QVector< LayoutRun > & runs,
+	const QVector< LayoutBox > & items, double lastHeight, double lineWidth,
+	LayoutMetrics & metrics )
+{
+	auto breaks = totalFit( runs, items, lineWidth, metrics );
+	const auto * source = &items;
+	QVector< LayoutBox > hyphenated;
+
+	// Words are hyphenated only where lines without hyphens are too loose
+	// or too long, and then lines are broken once again.
+	if( m_hyphenator && !m_hyphenator->isEmpty() )
+	{
+		QVector< bool > toSplit( items.size(), false );
+		bool any = false;
+
+		for( int i = 0; i < breaks.size(); ++i )
+		{
+			const auto & line = breaks.at( i );
+			double words = 0.0;
+			double spaces = 0.0;
+
+			for( int k = line.first; k < line.second; ++k )
+			{
+				if( items.at( k ).m_word > -1 )
+					words += items.at( k ).m_width;
+				else
+					spaces += items.at( k ).m_width;
+			}
+
+			if( spaces <= 0.0 && !fits( words, lineWidth ) )
+			{
+				for( int k = line.first; k < line.second; ++k )
+					toSplit[ k ] = true;
+
+				any = true;
+			}
+			else if( i < breaks.size() - 1 &&
+				( spaces <= 0.0 || 100.0 * ( lineWidth - words ) / spaces > c_looseScale ) )
+			{
+				toSplit[ breaks.at( i + 1 ).first ] = true;
+				any = true;
+			}
+		}
+
+		if( any )
+		{
+			for( int k = 0; k < items.size(); ++k )
+			{
+				if( toSplit.at( k ) && items.at( k ).m_word > -1 )
+					hyphenated.append( split( runs.at( items.at( k ).m_run ), items.at( k ),
+						metrics ) );
+				else
+					hyphenated.append( items.at( k ) );
+			}
+
+			if( hyphenated.size() > items.size() )
+			{
+				source = &hyphenated;
+				breaks = totalFit( runs, hyphenated, lineWidth, metrics );
+			}
+		}
+	}
+
+	for( int i = 0; i < breaks.size(); ++i )
+	{
+		const bool last = ( i == breaks.size() - 1 );
+		const auto & line = breaks.at( i );
+		const int first = m_boxes.size();
+
+		for( int k = line.first; k < line.second; ++k )
+		{
+			m_boxes.append( source->at( k ) );
+			m_boxes.last().m_hyphen = false;
+		}
+
+		// Line broken inside of the word, the next one starts right after it.
+		if( !last && breaks.at( i + 1 ).first == line.second )
+		{
+			auto & box = m_boxes.last();
+			box.m_hyphen = true;
+			box.m_width += hyphenWidth( runs.at( box.m_run ).m_font, metrics );
+		}
+
+		addLine( first, !last, ( last ? lastHeight :
+			runs.at( source->at( breaks.at( i + 1 ).first ).m_run ).m_lineHeight ), lineWidth );
+	}
+}
+
+QVector< QPair< int, int > >
+ParagraphLayout::totalFit( const QVector< LayoutRun > & runs,
+	const QVector< LayoutBox > & items, double lineWidth, LayoutMetrics & metrics )
+{
+	// Break before the line, the first one is the start of the segment.
+	struct Node {
+		//! Index of the first item of the line.
+		int m_pos;
+		//! End of the line broken here.
+		int m_end;
+		//! Index of the node of the previous break.
+		int m_prev;
+		//! Sum of demerits of lines up to this break.
+		double m_demerits;
+	}; // struct Node
+
+	const int count = items.size();
+
+	// Widths of items, widths and count of spaces before the index.
+	QVector< double > widths( count + 1, 0.0 );
+	QVector< double > spaces( count + 1, 0.0 );
+	QVector< int > spacesCount( count + 1, 0 );
+
+	for( int i = 0; i < count; ++i )
+	{
+		const bool isSpace = ( items.at( i ).m_word < 0 );
+
+		widths[ i + 1 ] = widths.at( i ) + items.at( i ).m_width;
+		spaces[ i + 1 ] = spaces.at( i ) + ( isSpace ? items.at( i ).m_width : 0.0 );
+		spacesCount[ i + 1 ] = spacesCount.at( i ) + ( isSpace ? 1 : 0 );
+	}
+
+	QVector< Node > nodes = { { 0, 0, -1, 0.0 } };
+	QVector< int > active = { 0 };
+
+	for( int b = 0; b <= count; ++b )
+	{
+		// Lines are broken on spaces, after pieces of hyphenated words and at the end.
+		const bool hyphen = ( b < count && items.at( b ).m_word > -1 && items.at( b ).m_hyphen );
+
+		if( b < count && items.at( b ).m_word > -1 && !hyphen )
+			continue;
+
+		const int end = ( hyphen ? b + 1 : b );
+		const double extra = ( hyphen ?
+			hyphenWidth( runs.at( items.at( b ).m_run ).m_font, metrics ) : 0.0 );
+		const double penalty = ( hyphen ? c_hyphenPenalty * c_hyphenPenalty : 0.0 );
+
+		int best = -1;
+		double bestDemerits = 0.0;
+
+		for( int a = 0; a < active.size(); )
+		{
+			const auto & node = nodes.at( active.at( a ) );
+			const double width = widths.at( end ) - widths.at( node.m_pos ) + extra;
+			const double stretch = spaces.at( end ) - spaces.at( node.m_pos );
+			double bad = 0.0;
+
+			if( width - lineWidth > 0.01 )
+			{
+				const double shrink = stretch * c_spaceShrink;
+
+				// Longer lines from this break will be too long too. Line without
+				// spaces is left as is, it's the only way to place the word.
+				if( spacesCount.at( end ) > spacesCount.at( node.m_pos ) &&
+					width - lineWidth > shrink )
+				{
+					active.remove( a );
+
+					continue;
+				}
+
+				bad = ( shrink > 0.0 ? badness( ( width - lineWidth ) / shrink ) : c_maxBadness );
+			}
+			else if( b < count )
+				bad = ( stretch > 0.0 ? badness( ( lineWidth - width ) / stretch ) : c_maxBadness );
+
+			const double demerits = node.m_demerits +
+				( c_linePenalty + bad ) * ( c_linePenalty + bad ) + penalty;
+
+			if( best < 0 || demerits < bestDemerits )
+			{
+				best = active.at( a );
+				bestDemerits = demerits;
+			}
+
+			++a;
+		}
+
+		// Line from the previous break is always possible, so the best is found.
+		if( best > -1 )
+		{
+			nodes.append( { b + 1, end, best, bestDemerits } );
+			active.append( nodes.size() - 1 );
+
+			if( active.size() > c_maxActiveNodes )
+				active.remove( 0 );
+		}
+	}
+
+	QVector< QPair< int, int > > breaks;
+
+	for( int n = nodes.size() - 1; n > 0; n = nodes.at( n ).m_prev )
+		breaks.prepend( qMakePair( nodes.at( nodes.at( n ).m_prev ).m_pos, nodes.at( n ).m_end ) );
+
+	return breaks;
+}
+
+bool
+ParagraphLayout::hyphenate( const LayoutRun & run, LayoutBox & box, double width,
+	LayoutMetrics & metrics, LayoutBox & tail )
+{
+	if( !m_hyphenator || m_hyphenator->isEmpty() )
+		return false;
+
+	const auto w = word( run, box.m_word );
+	const int end = ( box.m_length < 0 ? w.size() : box.m_from + box.m_length );
+	const auto points = m_hyphenator->hyphenate( w );
+
+	// The longest head that fits is the best.
+	for( int i = points.size() - 1; i > -1; --i )
+	{
+		const int p = points.at( i );
+
+		if( p <= box.m_from || p >= end )
+			continue;
+
+		const double head = metrics.stringWidth( run.m_font, w.mid( box.m_from, p - box.m_from ) ) +
+			hyphenWidth( run.m_font, metrics );
+
+		if( fits( head, width ) )
+		{
+			tail = box;
+			tail.m_from = p;
+			tail.m_length = ( box.m_length < 0 ? -1 : end - p );
+			tail.m_width = box.m_width - head + hyphenWidth( run.m_font, metrics );
+
+			box.m_length = p - box.m_from;
+			box.m_width = head;
+			box.m_hyphen = true;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+QVector< LayoutBox >
+ParagraphLayout::split( const LayoutRun & run, const LayoutBox & box, LayoutMetrics & metrics )
+{
+	const auto w = word( run, box.m_word );
+	QVector< LayoutBox > pieces;
+	int from = 0;
+	double width = 0.0;
+
+	// Hyphen after the piece marks possible break.
+	for( const auto p : m_hyphenator->hyphenate( w ) )
+	{
+		LayoutBox piece = box;
+		piece.m_from = from;
+		piece.m_length = p - from;
+		piece.m_width = metrics.stringWidth( run.m_font, w.mid( from, p - from ) );
+		piece.m_hyphen = true;
+
+		pieces.append( piece );
+
+		width += piece.m_width;
+		from = p;
+	}
+
+	LayoutBox piece = box;
+	piece.m_from = from;
+	piece.m_width = box.m_width - width;
+
+	pieces.append( piece );
+
+	return pieces;
+}
+
+double
+ParagraphLayout::hyphenWidth( int font, LayoutMetrics & metrics )
+{
+	static const QString hyphen = QLatin1String( "-" );
+
+	auto it = m_hyphenWidths.find( font );
+
+	if( it == m_hyphenWidths.end() )
+		it = m_hyphenWidths.insert( font, metrics.stringWidth( font, QStringRef( &hyphen ) ) );
+
+	return it.value();
+}
+
+void
+ParagraphLayout::addLine( int first, bool justify, double height, double lineWidth )
+{
+	LayoutLine line;
+	line.m_first = first;
+	line.m_count = m_boxes.size() - first;
+	line.m_height = height;
+
+	placeBoxes( line, justify, lineWidth );
+
+	m_lines.append( line );
+}
+
+void
+ParagraphLayout::placeBoxes( LayoutLine & line, bool justify, double lineWidth )
+{
+	double words = 0.0;
+	double spaces = 0.0;
+
+	for( int i = line.m_first, last = line.m_first + line.m_count; i < last; ++i )
+	{
+		if( m_boxes.at( i ).m_word > -1 )
+			words += m_boxes.at( i ).m_width;
+		else
+			spaces += m_boxes.at( i ).m_width;
+	}
+
+	line.m_scale = ( justify && spaces > 0.0 ?
+		100.0 * ( lineWidth - words ) / spaces : 100.0 );
+
+	double x = 0.0;
+
+	for( int i = line.m_first, last = line.m_first + line.m_count; i < last; ++i )
+	{
+		auto & box = m_boxes[ i ];
+
+		if( box.m_word < 0 )
+			box.m_width *= line.m_scale / 100.0;
+
+		box.m_x = x;
+
+		x += box.m_width;
+	}
+}
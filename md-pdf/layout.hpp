@@ -0,0 +1,198 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_LAYOUT_HPP_INCLUDED
+#define MD_PDF_LAYOUT_HPP_INCLUDED
+
+// md-pdf include.
+#include "md_doc.hpp"
+#include "hyphenation.hpp"
+
+// Qt include.
+#include <QString>
+#include <QVector>
+
+
+//
+// LayoutMetrics
+//
+
+//! Measurer of text for the layout. Fonts are IDs given by the caller,
+//! so the layout knows nothing about PDF.
+class LayoutMetrics
+{
+public:
+	virtual ~LayoutMetrics() = default;
+
+	//! \return Width of the string drawn with the font.
+	virtual double stringWidth( int font, const QStringRef & str ) = 0;
+}; // class LayoutMetrics
+
+
+//
+// LayoutRun
+//
+
+//! Piece of inline content of the paragraph drawn with one font.
+struct LayoutRun {
+	enum class Type {
+		//! Words.
+		Text,
+		//! Hard line break.
+		LineBreak,
+		//! Image, it takes lines of its own.
+		Image
+	}; // enum class Type
+
+	Type m_type = Type::Text;
+	QString m_text;
+	MD::WordRuns m_words;
+	//! Font of words and spaces between them.
+	int m_font = -1;
+	//! Font of the space before the run.
+	int m_spaceFont = -1;
+	//! Height of the line the run breaks.
+	double m_lineHeight = 0.0;
+}; // struct LayoutRun
+
+
+//
+// LayoutBox
+//
+
+//! Word or space placed on the line.
+struct LayoutBox {
+	//! Index of the run.
+	int m_run = -1;
+	//! Index of the word in the run, -1 for space.
+	int m_word = -1;
+	//! Is it a space before the run, drawn with space font of the run.
+	bool m_leading = false;
+	//! Position from the start of the line.
+	double m_x = 0.0;
+	//! Width, spaces are scaled with the line.
+	double m_width = 0.0;
+	//! Start of the piece of hyphenated word.
+	int m_from = 0;
+	//! Length of the piece of hyphenated word, -1 is till the end of the word.
+	int m_length = -1;
+	//! Is hyphen drawn after the piece.
+	bool m_hyphen = false;
+}; // struct LayoutBox
+
+
+//
+// LayoutLine
+//
+
+//! Line of the paragraph.
+struct LayoutLine {
+	//! Index of the first box of the line.
+	int m_first = 0;
+	//! Count of boxes on the line.
+	int m_count = 0;
+	//! Scale of spaces in percents, justified lines have it above 100.
+	double m_scale = 100.0;
+	//! Distance to the next line.
+	double m_height = 0.0;
+	//! Index of the image run if the line is an image, otherwise -1.
+	int m_image = -1;
+}; // struct LayoutLine
+
+
+//
+// ParagraphLayout
+//
+
+//! Layout of the paragraph: lines of placed words and spaces ready to be
+//! painted. Lines broken by width are justified, the last line and lines
+//! before hard breaks and images are not. With hyphenator words are
+//! hyphenated only where lines are broken.
+class ParagraphLayout final
+{
+public:
+	//! How lines are broken.
+	enum class Breaking {
+		//! Line is broken as soon as the next word doesn't fit.
+		Greedy,
+		//! Breaks are chosen for the whole paragraph at once (Knuth-Plass)
+		//! so spaces are stretched as evenly as possible.
+		TotalFit
+	}; // enum class Breaking
+
+	ParagraphLayout() = default;
+
+	Breaking breaking() const;
+	void setBreaking( Breaking b );
+
+	//! \return Hyphenator of words at ends of lines, null if words are not hyphenated.
+	Hyphenator * hyphenator() const;
+	//! Set hyphenator, it should outlive layout.
+	void setHyphenator( Hyphenator * h );
+
+	//! Lay out the runs into lines of the given width. Every word is measured once.
+	void layout( const QVector< LayoutRun > & runs, double lineWidth,
+		LayoutMetrics & metrics );
+
+	const QVector< LayoutLine > & lines() const;
+	const QVector< LayoutBox > & boxes() const;
+
+	//! \return Word of the run.
+	static QStringRef word( const LayoutRun & run, int idx );
+	//! \return Text of the box to draw.
+	static QString text( const LayoutRun & run, const LayoutBox & box );
+
+private:
+	//! Break words and spaces up to the hard break into lines,
+	//! \a lastHeight is height of the last line.
+	void breakSegment( const QVector< LayoutRun > & runs, const QVector< LayoutBox > & items,
+		double lastHeight, double lineWidth, LayoutMetrics & metrics );
+	void breakGreedy( const QVector< LayoutRun > & runs, const QVector< LayoutBox > & items,
+		double lastHeight, double lineWidth, LayoutMetrics & metrics );
+	void breakTotalFit( const QVector< LayoutRun > & runs, const QVector< LayoutBox > & items,
+		double lastHeight, double lineWidth, LayoutMetrics & metrics );
+	//! \return Lines with the least demerits, pairs of the first item and the end.
+	QVector< QPair< int, int > > totalFit( const QVector< LayoutRun > & runs,
+		const QVector< LayoutBox > & items, double lineWidth, LayoutMetrics & metrics );
+	//! Cut the word at the longest hyphenation point that fits into \a width,
+	//! \a box becomes the head and \a tail is the rest. \return false if it can't be cut.
+	bool hyphenate( const LayoutRun & run, LayoutBox & box, double width,
+		LayoutMetrics & metrics, LayoutBox & tail );
+	//! \return Pieces of the word between all hyphenation points.
+	QVector< LayoutBox > split( const LayoutRun & run, const LayoutBox & box,
+		LayoutMetrics & metrics );
+	//! \return Width of hyphen, it's measured once for every font.
+	double hyphenWidth( int font, LayoutMetrics & metrics );
+	//! Append line of boxes from \a first to the end.
+	void addLine( int first, bool justify, double height, double lineWidth );
+	//! Set positions of boxes of the line, spaces of justified line fill it.
+	void placeBoxes( LayoutLine & line, bool justify, double lineWidth );
+
+private:
+	Breaking m_breaking = Breaking::Greedy;
+	Hyphenator * m_hyphenator = nullptr;
+	QHash< int, double > m_hyphenWidths;
+	QVector< LayoutBox > m_boxes;
+	QVector< LayoutLine > m_lines;
+}; // class ParagraphLayout
+
+#endif // MD_PDF_LAYOUT_HPP_INCLUDED
@@ -27,13 +27,24 @@
 #include <QString>
 #include <QApplication>
 
+// podofo include.
+#include <podofo/podofo.h>
+
 
 int main( int argc, char ** argv )
 {
 	QApplication app( argc, argv );
 
-	MainWindow w;
-	w.show();
+	int ret = 0;
+
+	{
+		MainWindow w;
+		w.show();
+
+		ret = app.exec();
+	}
+
+	PoDoFo::PdfEncodingFactory::FreeGlobalEncodingInstances();
 
-	return app.exec();
+	return ret;
 }
@@ -0,0 +1,297 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "batch.hpp"
+#include "daemon.hpp"
+
+// Qt include.
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QTextCodec>
+#include <QDir>
+#include <QFileInfo>
+
+static const double c_mmInPt = 25.4 / 72;
+
+
+namespace /* anonymous */ {
+
+//! Print error message to stderr.
+void
+printError( const QString & msg )
+{
+	QTextStream err( stderr );
+	err << msg << endl;
+}
+
+//! Read integer value of the option.
+bool
+readInt( const QCommandLineParser & args, const QCommandLineOption & opt, int & value )
+{
+	bool ok = false;
+
+	value = args.value( opt ).toInt( &ok );
+
+	if( !ok )
+		printError( QStringLiteral( "Wrong value of --%1: %2." )
+			.arg( opt.names().last(), args.value( opt ) ) );
+
+	return ok;
+}
+
+//! Read color value of the option.
+bool
+readColor( const QCommandLineParser & args, const QCommandLineOption & opt, QColor & value )
+{
+	value = QColor( args.value( opt ) );
+
+	if( !value.isValid() )
+		printError( QStringLiteral( "Wrong value of --%1: %2." )
+			.arg( opt.names().last(), args.value( opt ) ) );
+
+	return value.isValid();
+}
+
+} /* namespace anonymous */
+
+
+int main( int argc, char ** argv )
+{
+	QCoreApplication app( argc, argv );
+	QCoreApplication::setApplicationName( QStringLiteral( "md-pdf-cli" ) );
+
+	QCommandLineParser args;
+	args.setApplicationDescription( QStringLiteral( "Converter of Markdown to PDF." ) );
+	args.addHelpOption();
+	args.addPositionalArgument( QStringLiteral( "input" ),
+		QStringLiteral( "Markdown file to convert. In batch mode directory with Markdown files, "
+			"or manifest file with root Markdown file per line." ) );
+	args.addPositionalArgument( QStringLiteral( "output" ),
+		QStringLiteral( "PDF file to write. In batch mode output directory." ) );
+
+	QCommandLineOption textFont( QStringLiteral( "text-font" ),
+		QStringLiteral( "Font of the text." ), QStringLiteral( "family" ),
+		QStringLiteral( "Arial" ) );
+	QCommandLineOption textFontSize( QStringLiteral( "text-font-size" ),
+		QStringLiteral( "Size of the text font." ), QStringLiteral( "size" ),
+		QStringLiteral( "14" ) );
+	QCommandLineOption codeFont( QStringLiteral( "code-font" ),
+		QStringLiteral( "Font of the code." ), QStringLiteral( "family" ),
+		QStringLiteral( "Courier New" ) );
+	QCommandLineOption codeFontSize( QStringLiteral( "code-font-size" ),
+		QStringLiteral( "Size of the code font." ), QStringLiteral( "size" ),
+		QStringLiteral( "12" ) );
+	QCommandLineOption linkColor( QStringLiteral( "link-color" ),
+		QStringLiteral( "Color of the links." ), QStringLiteral( "color" ),
+		QStringLiteral( "#217aff" ) );
+	QCommandLineOption borderColor( QStringLiteral( "border-color" ),
+		QStringLiteral( "Color of the borders." ), QStringLiteral( "color" ),
+		QStringLiteral( "#515151" ) );
+	QCommandLineOption codeBackground( QStringLiteral( "code-background" ),
+		QStringLiteral( "Background color of the code." ), QStringLiteral( "color" ),
+		QStringLiteral( "#dedede" ) );
+	QCommandLineOption left( QStringLiteral( "left" ),
+		QStringLiteral( "Left page margin." ), QStringLiteral( "margin" ),
+		QStringLiteral( "20" ) );
+	QCommandLineOption right( QStringLiteral( "right" ),
+		QStringLiteral( "Right page margin." ), QStringLiteral( "margin" ),
+		QStringLiteral( "20" ) );
+	QCommandLineOption top( QStringLiteral( "top" ),
+		QStringLiteral( "Top page margin." ), QStringLiteral( "margin" ),
+		QStringLiteral( "20" ) );
+	QCommandLineOption bottom( QStringLiteral( "bottom" ),
+		QStringLiteral( "Bottom page margin." ), QStringLiteral( "margin" ),
+		QStringLiteral( "20" ) );
+	QCommandLineOption pt( QStringLiteral( "pt" ),
+		QStringLiteral( "Page margins are in points, not in millimetres." ) );
+	QCommandLineOption encoding( QStringLiteral( "encoding" ),
+		QStringLiteral( "Encoding of Markdown files." ), QStringLiteral( "codec" ),
+		QStringLiteral( "UTF-8" ) );
+	QCommandLineOption notRecursive( QStringLiteral( "not-recursive" ),
+		QStringLiteral( "Don't process linked Markdown files." ) );
+	QCommandLineOption batch( QStringLiteral( "batch" ),
+		QStringLiteral( "Convert a lot of Markdown files on a pool of threads." ) );
+	QCommandLineOption jobs( QStringLiteral( "jobs" ),
+		QStringLiteral( "Count of threads in batch mode, by default count of CPU cores." ),
+		QStringLiteral( "count" ), QStringLiteral( "0" ) );
+	QCommandLineOption daemon( QStringLiteral( "daemon" ),
+		QStringLiteral( "Run as a server: read jobs as line-delimited JSON from stdin, "
+			"write results to stdout. Count of threads is set with --jobs." ) );
+	QCommandLineOption report( QStringLiteral( "report" ),
+		QStringLiteral( "Report of batch mode with status, pages, bytes and time of every job, "
+			"by default report.tsv in output directory." ), QStringLiteral( "file" ) );
+	QCommandLineOption cache( QStringLiteral( "cache" ),
+		QStringLiteral( "Directory of cache of parsed Markdown files, unchanged files "
+			"are not parsed again." ), QStringLiteral( "dir" ) );
+	QCommandLineOption totalFit( QStringLiteral( "total-fit" ),
+		QStringLiteral( "Break lines of paragraph choosing breaks for the whole paragraph "
+			"(Knuth-Plass), spaces are more even, rendering is slower." ) );
+	QCommandLineOption hyphenation( QStringLiteral( "hyphenation" ),
+		QStringLiteral( "File of TeX hyphenation patterns, words at ends of lines are "
+			"hyphenated with them." ), QStringLiteral( "file" ) );
+
+	args.addOptions( { textFont, textFontSize, codeFont, codeFontSize,
+		linkColor, borderColor, codeBackground,
+		left, right, top, bottom, pt, encoding, notRecursive, batch, jobs, report,
+		daemon, cache, totalFit, hyphenation } );
+
+	args.process( app );
+
+	RenderOpts opts;
+	opts.m_textFont = args.value( textFont );
+	opts.m_codeFont = args.value( codeFont );
+	opts.m_totalFitBreaking = args.isSet( totalFit );
+	opts.m_hyphenationPatterns = args.value( hyphenation );
+
+	int l = 0, r = 0, t = 0, b = 0;
+
+	if( !readInt( args, textFontSize, opts.m_textFontSize ) ||
+		!readInt( args, codeFontSize, opts.m_codeFontSize ) ||
+		!readColor( args, linkColor, opts.m_linkColor ) ||
+		!readColor( args, borderColor, opts.m_borderColor ) ||
+		!readColor( args, codeBackground, opts.m_codeBackground ) ||
+		!readInt( args, left, l ) || !readInt( args, right, r ) ||
+		!readInt( args, top, t ) || !readInt( args, bottom, b ) )
+	{
+		return 1;
+	}
+
+	const bool inPt = args.isSet( pt );
+
+	opts.m_left = ( inPt ? l : l / c_mmInPt );
+	opts.m_right = ( inPt ? r : r / c_mmInPt );
+	opts.m_top = ( inPt ? t : t / c_mmInPt );
+	opts.m_bottom = ( inPt ? b : b / c_mmInPt );
+
+	auto * codec = QTextCodec::codecForName( args.value( encoding ).toLatin1() );
+
+	if( !codec )
+	{
+		printError( QStringLiteral( "Unknown encoding: %1." ).arg( args.value( encoding ) ) );
+
+		return 1;
+	}
+
+	int threadsCount = 0;
+
+	if( !readInt( args, jobs, threadsCount ) )
+		return 1;
+
+	if( args.isSet( daemon ) )
+	{
+		Daemon server( opts, !args.isSet( notRecursive ), codec, threadsCount );
+		server.setCacheDir( args.value( cache ) );
+
+		const int ret = server.exec();
+
+		PdfEncodingFactory::FreeGlobalEncodingInstances();
+
+		return ret;
+	}
+
+	const auto files = args.positionalArguments();
+
+	if( files.size() != 2 )
+	{
+		printError( QStringLiteral( "Input and output files should be specified." ) );
+
+		return 1;
+	}
+
+	if( args.isSet( batch ) )
+	{
+		QString error;
+
+		const auto batchJobs = BatchConverter::collectJobs( files.at( 0 ), files.at( 1 ), error );
+
+		if( !error.isEmpty() )
+		{
+			printError( error );
+
+			return 1;
+		}
+
+		BatchConverter converter( opts, !args.isSet( notRecursive ), codec, threadsCount );
+		converter.setCacheDir( args.value( cache ) );
+
+		const auto results = converter.run( batchJobs );
+
+		const auto reportFileName = ( args.isSet( report ) ? args.value( report ) :
+			QDir( files.at( 1 ) ).absoluteFilePath( QStringLiteral( "report.tsv" ) ) );
+
+		QDir().mkpath( QFileInfo( reportFileName ).absolutePath() );
+
+		if( !BatchConverter::writeReport( reportFileName, results ) )
+			printError( QStringLiteral( "Unable to write report: %1." ).arg( reportFileName ) );
+
+		int failed = 0;
+
+		for( const auto & result : results )
+		{
+			if( result.m_status == BatchResult::Status::Error )
+			{
+				printError( QStringLiteral( "%1: %2" ).arg( result.m_input, result.m_message ) );
+
+				++failed;
+			}
+		}
+
+		PdfEncodingFactory::FreeGlobalEncodingInstances();
+
+		return ( failed ? 3 : 0 );
+	}
+
+	QString fileName = files.at( 1 );
+
+	if( !fileName.endsWith( QLatin1String( ".pdf" ), Qt::CaseInsensitive ) )
+		fileName.append( QLatin1String( ".pdf" ) );
+
+	const auto res = convertFile( { files.at( 0 ), fileName }, opts,
+		!args.isSet( notRecursive ), codec, nullptr, nullptr, args.value( cache ) );
+
+	PdfEncodingFactory::FreeGlobalEncodingInstances();
+
+	switch( res.m_status )
+	{
+		case BatchResult::Status::Empty :
+		{
+			printError( QStringLiteral( "Input Markdown file is empty. Nothing saved." ) );
+
+			return 2;
+		}
+
+		case BatchResult::Status::Error :
+		{
+			printError( QStringLiteral( "%1\n\nOutput PDF is broken. Sorry." )
+				.arg( res.m_message ) );
+
+			return 3;
+		}
+
+		default :
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,776 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-pdf include.
+#include "md_cache.hpp"
+
+// Qt include.
+#include <QDataStream>
+#include <QFileInfo>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QHash>
+
+
+namespace MD {
+
+namespace /* anonymous */ {
+
+//! Magic number of cache file.
+static const quint32 c_magic = 0x4D445043;
+
+//! Version of cache format and of parser's output. Should be increased
+//! on every change in them.
+static const quint32 c_version = 3;
+
+//! \return SHA-1 hash of content of the file, empty on error.
+QByteArray
+contentHash( const QString & fileName )
+{
+	QFile f( fileName );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return QByteArray();
+
+	const auto size = f.size();
+
+	uchar * mapped = ( size > 0 ? f.map( 0, size ) : nullptr );
+
+	QByteArray hash;
+
+	if( mapped )
+	{
+		hash = QCryptographicHash::hash( QByteArray::fromRawData(
+			reinterpret_cast< const char* > ( mapped ), static_cast< int > ( size ) ),
+			QCryptographicHash::Sha1 );
+
+		f.unmap( mapped );
+	}
+	else
+		hash = QCryptographicHash::hash( f.readAll(), QCryptographicHash::Sha1 );
+
+	return hash;
+}
+
+
+//
+// Writer
+//
+
+//! Writer of items.
+class Writer final {
+public:
+	explicit Writer( QDataStream & s )
+		:	m_s( s )
+	{
+	}
+
+	void writeItem( const Item * item );
+	void writeItems( const Block::Items & items );
+
+	//! \return Index of the written heading, or -1.
+	qint32 headingIndex( const Item * h ) const
+	{
+		return m_headings.value( h, -1 );
+	}
+
+private:
+	QDataStream & m_s;
+	//! Indexes of headings in the order of writing.
+	QHash< const Item*, qint32 > m_headings;
+}; // class Writer
+
+void
+Writer::writeItem( const Item * item )
+{
+	const auto & span = item->sourceSpan();
+
+	m_s << static_cast< quint8 > ( item->type() ) << span.m_fileName
+		<< static_cast< qint32 > ( span.m_startLine ) << static_cast< qint32 > ( span.m_endLine );
+
+	switch( item->type() )
+	{
+		case ItemType::Anchor :
+			m_s << static_cast< const Anchor* > ( item )->label();
+			break;
+
+		case ItemType::Heading :
+		{
+			auto * h = static_cast< const Heading* > ( item );
+
+			m_headings.insert( item, m_headings.size() );
+
+			m_s << h->text() << static_cast< qint32 > ( h->level() ) << h->label();
+		}
+			break;
+
+		case ItemType::Text :
+		{
+			auto * t = static_cast< const Text* > ( item );
+
+			m_s << t->text() << static_cast< qint32 > ( t->opts() );
+		}
+			break;
+
+		case ItemType::Link :
+		{
+			auto * l = static_cast< const Link* > ( item );
+
+			m_s << l->url() << l->text() << static_cast< qint32 > ( l->textOptions() )
+				<< !l->img().isNull();
+
+			if( !l->img().isNull() )
+				writeItem( l->img().data() );
+		}
+			break;
+
+		case ItemType::Image :
+		{
+			auto * i = static_cast< const Image* > ( item );
+
+			m_s << i->url() << i->text();
+		}
+			break;
+
+		case ItemType::Code :
+		{
+			auto * c = static_cast< const Code* > ( item );
+
+			m_s << c->text() << c->inlined();
+		}
+			break;
+
+		case ItemType::FootnoteRef :
+			m_s << static_cast< const FootnoteRef* > ( item )->id();
+			break;
+
+		case ItemType::ListItem :
+		{
+			auto * i = static_cast< const ListItem* > ( item );
+
+			m_s << static_cast< qint32 > ( i->listType() )
+				<< static_cast< qint32 > ( i->orderedListPreState() );
+
+			writeItems( i->items() );
+		}
+			break;
+
+		case ItemType::Table :
+		{
+			auto * t = static_cast< const Table* > ( item );
+
+			m_s << static_cast< qint32 > ( t->columnsCount() );
+
+			for( int i = 0; i < t->columnsCount(); ++i )
+				m_s << static_cast< qint32 > ( t->columnAlignment( i ) );
+
+			m_s << static_cast< qint32 > ( t->rows().size() );
+
+			for( const auto & r : t->rows() )
+				writeItem( r.data() );
+		}
+			break;
+
+		case ItemType::TableRow :
+		{
+			auto * r = static_cast< const TableRow* > ( item );
+
+			m_s << static_cast< qint32 > ( r->cells().size() );
+
+			for( const auto & c : r->cells() )
+				writeItem( c.data() );
+		}
+			break;
+
+		case ItemType::Paragraph :
+		case ItemType::Blockquote :
+		case ItemType::List :
+		case ItemType::TableCell :
+		case ItemType::Footnote :
+			writeItems( static_cast< const Block* > ( item )->items() );
+			break;
+
+		default :
+			break;
+	}
+}
+
+void
+Writer::writeItems( const Block::Items & items )
+{
+	m_s << static_cast< qint32 > ( items.size() );
+
+	for( const auto & i : items )
+		writeItem( i.data() );
+}
+
+
+//
+// Reader
+//
+
+//! Reader of items.
+class Reader final {
+public:
+	explicit Reader( QDataStream & s )
+		:	m_s( s )
+	{
+	}
+
+	//! \return Read item, or null on error.
+	QSharedPointer< Item > readItem();
+	//! Read items into the block. \return false on error.
+	bool readItems( Block * block );
+
+	//! \return Heading with the given index in the order of reading.
+	QSharedPointer< Heading > heading( qint32 idx ) const
+	{
+		return m_headings.value( idx );
+	}
+
+private:
+	//! \return Is the stream OK.
+	bool ok() const
+	{
+		return ( m_s.status() == QDataStream::Ok );
+	}
+
+private:
+	QDataStream & m_s;
+	QVector< QSharedPointer< Heading > > m_headings;
+}; // class Reader
+
+QSharedPointer< Item >
+Reader::readItem()
+{
+	quint8 type = 0;
+	SourceSpan span;
+	qint32 startLine = -1, endLine = -1;
+
+	m_s >> type >> span.m_fileName >> startLine >> endLine;
+
+	span.m_startLine = startLine;
+	span.m_endLine = endLine;
+
+	if( !ok() )
+		return QSharedPointer< Item > ();
+
+	QSharedPointer< Item > res;
+
+	switch( static_cast< ItemType > ( type ) )
+	{
+		case ItemType::Anchor :
+		{
+			QString label;
+			m_s >> label;
+
+			res.reset( new Anchor( label ) );
+		}
+			break;
+
+		case ItemType::Heading :
+		{
+			QString text, label;
+			qint32 level = 0;
+
+			m_s >> text >> level >> label;
+
+			QSharedPointer< Heading > h( new Heading() );
+			h->setText( text );
+			h->setLevel( level );
+			h->setLabel( label );
+
+			m_headings.append( h );
+
+			res = h;
+		}
+			break;
+
+		case ItemType::Text :
+		{
+			QString text;
+			qint32 opts = 0;
+
+			m_s >> text >> opts;
+
+			QSharedPointer< Text > t( new Text() );
+			t->setText( text );
+			t->setOpts( TextOptions( QFlag( opts ) ) );
+
+			res = t;
+		}
+			break;
+
+		case ItemType::Link :
+		{
+			QString url, text;
+			qint32 opts = 0;
+			bool hasImg = false;
+
+			m_s >> url >> text >> opts >> hasImg;
+
+			QSharedPointer< Link > l( new Link() );
+			l->setUrl( url );
+			l->setText( text );
+			l->setTextOptions( TextOptions( QFlag( opts ) ) );
+
+			if( hasImg )
+			{
+				auto img = readItem();
+
+				if( img.isNull() || img->type() != ItemType::Image )
+					return QSharedPointer< Item > ();
+
+				l->setImg( qSharedPointerCast< Image > ( img ) );
+			}
+
+			res = l;
+		}
+			break;
+
+		case ItemType::Image :
+		{
+			QString url, text;
+
+			m_s >> url >> text;
+
+			QSharedPointer< Image > i( new Image() );
+			i->setUrl( url );
+			i->setText( text );
+
+			res = i;
+		}
+			break;
+
+		case ItemType::Code :
+		{
+			QString text;
+			bool inlined = false;
+
+			m_s >> text >> inlined;
+
+			res.reset( new Code( text, inlined ) );
+		}
+			break;
+
+		case ItemType::FootnoteRef :
+		{
+			QString id;
+			m_s >> id;
+
+			res.reset( new FootnoteRef( id ) );
+		}
+			break;
+
+		case ItemType::ListItem :
+		{
+			qint32 listType = 0, preState = 0;
+
+			m_s >> listType >> preState;
+
+			QSharedPointer< ListItem > i( new ListItem() );
+			i->setListType( static_cast< ListItem::ListType > ( listType ) );
+			i->setOrderedListPreState(
+				static_cast< ListItem::OrderedListPreState > ( preState ) );
+
+			if( !readItems( i.data() ) )
+				return QSharedPointer< Item > ();
+
+			res = i;
+		}
+			break;
+
+		case ItemType::Table :
+		{
+			QSharedPointer< Table > t( new Table() );
+
+			qint32 columns = 0;
+			m_s >> columns;
+
+			for( qint32 i = 0; i < columns && ok(); ++i )
+			{
+				qint32 a = 0;
+				m_s >> a;
+
+				t->setColumnAlignment( i, static_cast< Table::Alignment > ( a ) );
+			}
+
+			qint32 rows = 0;
+			m_s >> rows;
+
+			for( qint32 i = 0; i < rows && ok(); ++i )
+			{
+				auto r = readItem();
+
+				if( r.isNull() || r->type() != ItemType::TableRow )
+					return QSharedPointer< Item > ();
+
+				t->appendRow( qSharedPointerCast< TableRow > ( r ) );
+			}
+
+			res = t;
+		}
+			break;
+
+		case ItemType::TableRow :
+		{
+			QSharedPointer< TableRow > r( new TableRow() );
+
+			qint32 cells = 0;
+			m_s >> cells;
+
+			for( qint32 i = 0; i < cells && ok(); ++i )
+			{
+				auto c = readItem();
+
+				if( c.isNull() || c->type() != ItemType::TableCell )
+					return QSharedPointer< Item > ();
+
+				r->appendCell( qSharedPointerCast< TableCell > ( c ) );
+			}
+
+			res = r;
+		}
+			break;
+
+		case ItemType::Paragraph :
+			res.reset( new Paragraph() );
+			break;
+
+		case ItemType::Blockquote :
+			res.reset( new Blockquote() );
+			break;
+
+		case ItemType::List :
+			res.reset( new List() );
+			break;
+
+		case ItemType::TableCell :
+			res.reset( new TableCell() );
+			break;
+
+		case ItemType::Footnote :
+			res.reset( new Footnote() );
+			break;
+
+		case ItemType::LineBreak :
+			res.reset( new LineBreak() );
+			break;
+
+		case ItemType::PageBreak :
+			res.reset( new PageBreak() );
+			break;
+
+		default :
+			return QSharedPointer< Item > ();
+	}
+
+	switch( res->type() )
+	{
+		case ItemType::Paragraph :
+		case ItemType::Blockquote :
+		case ItemType::List :
+		case ItemType::TableCell :
+		case ItemType::Footnote :
+		{
+			if( !readItems( static_cast< Block* > ( res.data() ) ) )
+				return QSharedPointer< Item > ();
+		}
+			break;
+
+		default :
+			break;
+	}
+
+	res->setSourceSpan( span );
+
+	return ( ok() ? res : QSharedPointer< Item > () );
+}
+
+bool
+Reader::readItems( Block * block )
+{
+	qint32 count = 0;
+	m_s >> count;
+
+	for( qint32 i = 0; i < count && ok(); ++i )
+	{
+		auto item = readItem();
+
+		if( item.isNull() )
+			return false;
+
+		block->appendItem( item );
+	}
+
+	return ok();
+}
+
+} /* namespace anonymous */
+
+
+//
+// DocumentCache
+//
+
+DocumentCache::DocumentCache( const QString & dir )
+	:	m_dir( dir )
+{
+}
+
+QSharedPointer< Document >
+DocumentCache::load( const QString & fileName, const QByteArray & codecName,
+	QStringList & links ) const
+{
+	const QFileInfo fi( fileName );
+	const auto canonical = fi.canonicalFilePath();
+
+	if( canonical.isEmpty() )
+		return QSharedPointer< Document > ();
+
+	QFile f( cacheFileName( canonical ) );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return QSharedPointer< Document > ();
+
+	const auto size = f.size();
+
+	uchar * mapped = ( size > 0 ? f.map( 0, size ) : nullptr );
+
+	const QByteArray data = ( mapped ? QByteArray::fromRawData(
+		reinterpret_cast< const char* > ( mapped ), static_cast< int > ( size ) ) :
+		f.readAll() );
+
+	QDataStream s( data );
+	s.setVersion( QDataStream::Qt_5_6 );
+
+	quint32 magic = 0, version = 0;
+	QString path;
+	QByteArray codec, hash;
+	qint64 modified = 0, fileSize = 0;
+
+	s >> magic >> version >> path >> codec >> modified >> fileSize >> hash;
+
+	QSharedPointer< Document > doc;
+
+	// Content is hashed last, it's the most expensive check.
+	if( s.status() == QDataStream::Ok && magic == c_magic && version == c_version &&
+		path == canonical && codec == codecName &&
+		modified == fi.lastModified().toMSecsSinceEpoch() && fileSize == fi.size() &&
+		hash == contentHash( canonical ) )
+	{
+		QStringList cachedLinks;
+		Targets targets;
+		s >> cachedLinks >> targets;
+
+		// Appeared or removed target is resolved differently.
+		bool targetsChanged = ( s.status() != QDataStream::Ok );
+
+		for( auto it = targets.cbegin(), last = targets.cend();
+			it != last && !targetsChanged; ++it )
+		{
+			targetsChanged = ( QFileInfo::exists( it.key() ) != it.value() );
+		}
+
+		if( !targetsChanged )
+			doc = readDocument( s );
+
+		if( !doc.isNull() )
+			links = cachedLinks;
+	}
+
+	if( mapped )
+		f.unmap( mapped );
+
+	return doc;
+}
+
+bool
+DocumentCache::store( const QString & fileName, const QByteArray & codecName,
+	QSharedPointer< Document > doc, const QStringList & links,
+	const Targets & targets ) const
+{
+	const QFileInfo fi( fileName );
+	const auto canonical = fi.canonicalFilePath();
+
+	if( canonical.isEmpty() || !QDir().mkpath( m_dir ) )
+		return false;
+
+	const auto hash = contentHash( canonical );
+
+	if( hash.isEmpty() )
+		return false;
+
+	QSaveFile f( cacheFileName( canonical ) );
+
+	if( !f.open( QIODevice::WriteOnly ) )
+		return false;
+
+	QDataStream s( &f );
+	s.setVersion( QDataStream::Qt_5_6 );
+
+	s << c_magic << c_version << canonical << codecName
+		<< static_cast< qint64 > ( fi.lastModified().toMSecsSinceEpoch() )
+		<< static_cast< qint64 > ( fi.size() ) << hash << links << targets;
+
+	writeDocument( s, *doc );
+
+	if( s.status() != QDataStream::Ok )
+	{
+		f.cancelWriting();
+
+		return false;
+	}
+
+	return f.commit();
+}
+
+void
+DocumentCache::writeDocument( QDataStream & s, const Document & doc )
+{
+	Writer w( s );
+
+	w.writeItems( doc.items() );
+
+	s << static_cast< qint32 > ( doc.footnotesMap().size() );
+
+	for( auto it = doc.footnotesMap().cbegin(), last = doc.footnotesMap().cend();
+		it != last; ++it )
+	{
+		s << it.key();
+		w.writeItem( it.value().data() );
+	}
+
+	s << static_cast< qint32 > ( doc.labeledLinks().size() );
+
+	for( auto it = doc.labeledLinks().cbegin(), last = doc.labeledLinks().cend();
+		it != last; ++it )
+	{
+		s << it.key();
+		w.writeItem( it.value().data() );
+	}
+
+	s << static_cast< qint32 > ( doc.labeledHeadings().size() );
+
+	for( auto it = doc.labeledHeadings().cbegin(), last = doc.labeledHeadings().cend();
+		it != last; ++it )
+	{
+		// Labeled headings are in the document, so only index is written.
+		const auto idx = w.headingIndex( it.value().data() );
+
+		s << it.key() << idx;
+
+		if( idx < 0 )
+			w.writeItem( it.value().data() );
+	}
+}
+
+QSharedPointer< Document >
+DocumentCache::readDocument( QDataStream & s )
+{
+	QSharedPointer< Document > doc( new Document );
+
+	Reader r( s );
+
+	if( !r.readItems( doc.data() ) )
+		return QSharedPointer< Document > ();
+
+	qint32 count = 0;
+	s >> count;
+
+	for( qint32 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		QString key;
+		s >> key;
+
+		auto fn = r.readItem();
+
+		if( fn.isNull() || fn->type() != ItemType::Footnote )
+			return QSharedPointer< Document > ();
+
+		doc->insertFootnote( key, qSharedPointerCast< Footnote > ( fn ) );
+	}
+
+	count = 0;
+	s >> count;
+
+	for( qint32 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		QString key;
+		s >> key;
+
+		auto lnk = r.readItem();
+
+		if( lnk.isNull() || lnk->type() != ItemType::Link )
+			return QSharedPointer< Document > ();
+
+		doc->insertLabeledLink( key, qSharedPointerCast< Link > ( lnk ) );
+	}
+
+	count = 0;
+	s >> count;
+
+	for( qint32 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		QString key;
+		qint32 idx = -1;
+
+		s >> key >> idx;
+
+		QSharedPointer< Heading > h;
+
+		if( idx < 0 )
+		{
+			auto item = r.readItem();
+
+			if( item.isNull() || item->type() != ItemType::Heading )
+				return QSharedPointer< Document > ();
+
+			h = qSharedPointerCast< Heading > ( item );
+		}
+		else
+			h = r.heading( idx );
+
+		if( h.isNull() )
+			return QSharedPointer< Document > ();
+
+		doc->insertLabeledHeading( key, h );
+	}
+
+	if( s.status() != QDataStream::Ok )
+		return QSharedPointer< Document > ();
+
+	return doc;
+}
+
+QString
+DocumentCache::cacheFileName( const QString & canonicalPath ) const
+{
+	return QDir( m_dir ).absoluteFilePath( QString::fromLatin1( QCryptographicHash::hash(
+		canonicalPath.toUtf8(), QCryptographicHash::Sha1 ).toHex() ) +
+		QLatin1String( ".mdcache" ) );
+}
+
+} /* namespace MD */
@@ -0,0 +1,86 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MD_PDF_MD_CACHE_HPP_INCLUDED
+#define MD_PDF_MD_CACHE_HPP_INCLUDED
+
+// md-pdf include.
+#include "md_doc.hpp"
+
+// Qt include.
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QMap>
+
+QT_BEGIN_NAMESPACE
+class QDataStream;
+QT_END_NAMESPACE
+
+
+namespace MD {
+
+//
+// DocumentCache
+//
+
+//! On-disk cache of parsed Markdown files.
+//!
+//! Every file is stored in its own cache file with items, footnotes,
+//! labeled links and labeled headings of the file, and with the list of
+//! files linked from it. Cache is valid while canonical path, modification
+//! time, size and content of the file, encoding and version of the parser
+//! are the same, and while targets of links and images that the parser
+//! looked for still exist or still don't exist.
+class DocumentCache final {
+public:
+	explicit DocumentCache( const QString & dir );
+
+	//! Paths of targets of links and images of the file that the parser looked
+	//! for, with whether they existed. Parser resolves them differently.
+	typedef QMap< QString, bool > Targets;
+
+	//! \return Parsed file from the cache, or null if there is no valid one.
+	QSharedPointer< Document > load( const QString & fileName, const QByteArray & codecName,
+		QStringList & links ) const;
+	//! Store parsed file. \return false on error.
+	bool store( const QString & fileName, const QByteArray & codecName,
+		QSharedPointer< Document > doc, const QStringList & links,
+		const Targets & targets ) const;
+
+	//! Write items and maps of the document.
+	static void writeDocument( QDataStream & s, const Document & doc );
+	//! Read document. \return null on error.
+	static QSharedPointer< Document > readDocument( QDataStream & s );
+
+private:
+	//! \return Name of cache file of the file.
+	QString cacheFileName( const QString & canonicalPath ) const;
+
+private:
+	QString m_dir;
+}; // class DocumentCache
+
+} /* namespace MD */
+
+#endif // MD_PDF_MD_CACHE_HPP_INCLUDED
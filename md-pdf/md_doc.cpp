@@ -23,6 +23,9 @@
 // md-pdf include
 #include "md_doc.hpp"
 
+// C++ include.
+#include <functional>
+
 
 namespace MD {
 
@@ -37,6 +40,18 @@ Item::type() const
 	return ItemType::Unknown;
 }
 
+const SourceSpan &
+Item::sourceSpan() const
+{
+	return m_span;
+}
+
+void
+Item::setSourceSpan( const SourceSpan & s )
+{
+	m_span = s;
+}
+
 
 //
 // PageBreak
@@ -69,6 +84,18 @@ Anchor::label() const
 	return m_label;
 }
 
+int
+Anchor::labelId() const
+{
+	return m_labelId;
+}
+
+void
+Anchor::setLabelId( int id )
+{
+	m_labelId = id;
+}
+
 
 //
 // Heading
@@ -116,6 +143,18 @@ Heading::label() const
 	return m_label;
 }
 
+int
+Heading::labelId() const
+{
+	return m_labelId;
+}
+
+void
+Heading::setLabelId( int id )
+{
+	m_labelId = id;
+}
+
 void
 Heading::setLabel( const QString & l )
 {
@@ -123,6 +162,40 @@ Heading::setLabel( const QString & l )
 }
 
 
+//
+// WordRuns
+//
+
+WordRuns
+splitWords( const QString & text )
+{
+	WordRuns words;
+
+	const QChar * data = text.constData();
+	const int length = text.length();
+	int start = -1;
+
+	for( int i = 0; i < length; ++i )
+	{
+		if( data[ i ] == QLatin1Char( ' ' ) )
+		{
+			if( start >= 0 )
+			{
+				words.append( qMakePair( start, i - start ) );
+				start = -1;
+			}
+		}
+		else if( start < 0 )
+			start = i;
+	}
+
+	if( start >= 0 )
+		words.append( qMakePair( start, length - start ) );
+
+	return words;
+}
+
+
 //
 // Text
 //
@@ -143,6 +216,13 @@ void
 Text::setText( const QString & t )
 {
 	m_text = t;
+	m_words = splitWords( m_text );
+}
+
+const WordRuns &
+Text::words() const
+{
+	return m_words;
 }
 
 const TextOptions &
@@ -191,6 +271,12 @@ Block::appendItem( QSharedPointer< Item > i )
 	m_items.append( i );
 }
 
+void
+Block::removeItemAt( int idx )
+{
+	m_items.removeAt( idx );
+}
+
 bool
 Block::isEmpty() const
 {
@@ -345,6 +431,13 @@ void
 Link::setText( const QString & t )
 {
 	m_text = t;
+	m_words = splitWords( m_text );
+}
+
+const WordRuns &
+Link::words() const
+{
+	return m_words;
 }
 
 TextOptions
@@ -371,6 +464,18 @@ Link::setImg( QSharedPointer< Image > i )
 	m_img = i;
 }
 
+int
+Link::targetId() const
+{
+	return m_targetId;
+}
+
+void
+Link::setTargetId( int id )
+{
+	m_targetId = id;
+}
+
 
 //
 // Code
@@ -378,6 +483,7 @@ Link::setImg( QSharedPointer< Image > i )
 
 Code::Code( const QString & t, bool inl )
 	:	m_text( t )
+	,	m_words( splitWords( t ) )
 	,	m_inlined( inl )
 {
 }
@@ -398,6 +504,13 @@ void
 Code::setText( const QString & t )
 {
 	m_text = t;
+	m_words = splitWords( m_text );
+}
+
+const WordRuns &
+Code::words() const
+{
+	return m_words;
 }
 
 bool
@@ -576,6 +689,12 @@ Document::insertFootnote( const QString & id, QSharedPointer< Footnote > fn )
 	m_footnotes.insert( id, fn );
 }
 
+void
+Document::removeFootnote( const QString & id )
+{
+	m_footnotes.remove( id );
+}
+
 const Document::LabeledLinks &
 Document::labeledLinks() const
 {
@@ -588,6 +707,12 @@ Document::insertLabeledLink( const QString & label, QSharedPointer< Link > lnk )
 	m_labeledLinks.insert( label, lnk );
 }
 
+void
+Document::removeLabeledLink( const QString & label )
+{
+	m_labeledLinks.remove( label );
+}
+
 const Document::LabeledHeadings &
 Document::labeledHeadings() const
 {
@@ -600,4 +725,259 @@ Document::insertLabeledHeading( const QString & label, QSharedPointer< Heading >
 	m_labeledHeadings.insert( label, h );
 }
 
+void
+Document::removeLabeledHeading( const QString & label )
+{
+	m_labeledHeadings.remove( label );
+}
+
+const Document::Sources &
+Document::sources() const
+{
+	return m_sources;
+}
+
+void
+Document::addSource( const QString & src )
+{
+	m_sources.append( src );
+}
+
+void
+Document::removeUnusedSources()
+{
+	if( m_sources.isEmpty() )
+		return;
+
+	QVector< bool > used( m_sources.size(), false );
+
+	markUsedSources( this, used );
+
+	for( auto it = m_footnotes.cbegin(), last = m_footnotes.cend(); it != last; ++it )
+	{
+		markUsedSource( it.key(), used );
+		markUsedSources( it.value().data(), used );
+	}
+
+	for( auto it = m_labeledLinks.cbegin(), last = m_labeledLinks.cend(); it != last; ++it )
+	{
+		markUsedSource( it.key(), used );
+		markUsedSource( it.value()->url(), used );
+		markUsedSource( it.value()->text(), used );
+		markUsedSource( it.value()->img()->url(), used );
+		markUsedSource( it.value()->img()->text(), used );
+	}
+
+	for( auto it = m_labeledHeadings.cbegin(), last = m_labeledHeadings.cend(); it != last; ++it )
+	{
+		markUsedSource( it.key(), used );
+		markUsedSource( it.value()->text(), used );
+		markUsedSource( it.value()->label(), used );
+	}
+
+	Sources sources;
+
+	for( int i = 0; i < m_sources.size(); ++i )
+	{
+		if( used.at( i ) )
+			sources.append( m_sources.at( i ) );
+	}
+
+	m_sources = sources;
+}
+
+void
+Document::markUsedSources( const Block * block, QVector< bool > & used ) const
+{
+	for( const auto & item : block->items() )
+	{
+		markUsedSource( item->sourceSpan().m_fileName, used );
+
+		switch( item->type() )
+		{
+			case ItemType::Anchor :
+				markUsedSource( static_cast< Anchor* > ( item.data() )->label(), used );
+				break;
+
+			case ItemType::Heading :
+			{
+				auto * h = static_cast< Heading* > ( item.data() );
+				markUsedSource( h->text(), used );
+				markUsedSource( h->label(), used );
+			}
+				break;
+
+			case ItemType::Text :
+				markUsedSource( static_cast< Text* > ( item.data() )->text(), used );
+				break;
+
+			case ItemType::Code :
+				markUsedSource( static_cast< Code* > ( item.data() )->text(), used );
+				break;
+
+			case ItemType::Image :
+			{
+				auto * i = static_cast< Image* > ( item.data() );
+				markUsedSource( i->url(), used );
+				markUsedSource( i->text(), used );
+			}
+				break;
+
+			case ItemType::Link :
+			{
+				auto * l = static_cast< Link* > ( item.data() );
+				markUsedSource( l->url(), used );
+				markUsedSource( l->text(), used );
+				markUsedSource( l->img()->url(), used );
+				markUsedSource( l->img()->text(), used );
+			}
+				break;
+
+			case ItemType::FootnoteRef :
+				markUsedSource( static_cast< FootnoteRef* > ( item.data() )->id(), used );
+				break;
+
+			case ItemType::Table :
+			{
+				for( const auto & row : static_cast< Table* > ( item.data() )->rows() )
+				{
+					for( const auto & cell : row->cells() )
+						markUsedSources( cell.data(), used );
+				}
+			}
+				break;
+
+			case ItemType::Paragraph :
+			case ItemType::Blockquote :
+			case ItemType::List :
+			case ItemType::ListItem :
+			case ItemType::Footnote :
+				markUsedSources( static_cast< Block* > ( item.data() ), used );
+				break;
+
+			default :
+				break;
+		}
+	}
+}
+
+void
+Document::markUsedSource( const QString & str, QVector< bool > & used ) const
+{
+	if( str.isEmpty() )
+		return;
+
+	for( int i = 0; i < m_sources.size(); ++i )
+	{
+		const auto & src = m_sources.at( i );
+
+		if( !std::less< const QChar* > () ( str.constData(), src.constData() ) &&
+			std::less< const QChar* > () ( str.constData(), src.constData() + src.size() ) )
+		{
+			used[ i ] = true;
+
+			return;
+		}
+	}
+}
+
+int
+Document::labelId( const QString & label )
+{
+	auto it = m_labelIds.constFind( label );
+
+	if( it != m_labelIds.constEnd() )
+		return it.value();
+
+	const int id = m_labelIds.size();
+
+	// Label may refer to a source buffer, that can be removed while the label is known.
+	m_labelIds.insert( QString( label.constData(), label.size() ), id );
+
+	return id;
+}
+
+int
+Document::findLabel( const QString & label ) const
+{
+	return m_labelIds.value( label, -1 );
+}
+
+int
+Document::labelsCount() const
+{
+	return m_labelIds.size();
+}
+
+void
+Document::internLabels()
+{
+	internLabels( this );
+
+	for( const auto & f : qAsConst( m_footnotes ) )
+		internLabels( f.data() );
+}
+
+void
+Document::internLabels( Block * block )
+{
+	for( const auto & item : block->items() )
+	{
+		switch( item->type() )
+		{
+			case ItemType::Anchor :
+			{
+				auto * a = static_cast< Anchor* > ( item.data() );
+				a->setLabelId( labelId( a->label() ) );
+			}
+				break;
+
+			case ItemType::Heading :
+			{
+				auto * h = static_cast< Heading* > ( item.data() );
+
+				if( h->isLabeled() )
+					h->setLabelId( labelId( h->label() ) );
+			}
+				break;
+
+			case ItemType::Link :
+			{
+				auto * l = static_cast< Link* > ( item.data() );
+
+				QString url = l->url();
+
+				const auto lit = m_labeledLinks.constFind( url );
+
+				if( lit != m_labeledLinks.constEnd() )
+					url = lit.value()->url();
+
+				l->setTargetId( QUrl( url ).isRelative() ? labelId( url ) : -1 );
+			}
+				break;
+
+			case ItemType::Table :
+			{
+				for( const auto & row : static_cast< Table* > ( item.data() )->rows() )
+				{
+					for( const auto & cell : row->cells() )
+						internLabels( cell.data() );
+				}
+			}
+				break;
+
+			case ItemType::Paragraph :
+			case ItemType::Blockquote :
+			case ItemType::List :
+			case ItemType::ListItem :
+			case ItemType::Footnote :
+				internLabels( static_cast< Block* > ( item.data() ) );
+				break;
+
+			default :
+				break;
+		}
+	}
+}
+
 } /* namespace MD */
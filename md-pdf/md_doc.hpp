@@ -30,7 +30,9 @@
 #include <QSharedPointer>
 #include <QUrl>
 #include <QMap>
+#include <QHash>
 #include <QVector>
+#include <QPair>
 
 
 namespace MD {
@@ -83,6 +85,23 @@ enum class ItemType {
 }; // enum class ItemType
 
 
+//
+// SourceSpan
+//
+
+//! Lines of the source file the item was parsed from.
+struct SourceSpan {
+	//! Absolute path of the file.
+	QString m_fileName;
+	//! First line, counted from 0, -1 if unknown.
+	int m_startLine = -1;
+	//! Last line, blank lines after the item are included.
+	int m_endLine = -1;
+
+	bool isValid() const { return ( m_startLine >= 0 ); }
+}; // struct SourceSpan
+
+
 //
 // Item
 //
@@ -97,7 +116,13 @@ public:
 
 	virtual ItemType type() const;
 
+	//! Span is known for top-level items, footnotes, labeled links and labeled headings.
+	const SourceSpan & sourceSpan() const;
+	void setSourceSpan( const SourceSpan & s );
+
 private:
+	SourceSpan m_span;
+
 	Q_DISABLE_COPY( Item )
 }; // class Item
 
@@ -137,10 +162,15 @@ public:
 
 	const QString & label() const;
 
+	//! \return ID of the label in the document, -1 if it's not interned.
+	int labelId() const;
+	void setLabelId( int id );
+
 private:
 	Q_DISABLE_COPY( Anchor )
 
 	QString m_label;
+	int m_labelId = -1;
 }; // class Anchor
 
 
@@ -168,10 +198,15 @@ public:
 	const QString & label() const;
 	void setLabel( const QString & l );
 
+	//! \return ID of the label in the document, -1 if it's not interned.
+	int labelId() const;
+	void setLabelId( int id );
+
 private:
 	QString m_text;
 	int m_level;
 	QString m_label;
+	int m_labelId = -1;
 
 	Q_DISABLE_COPY( Heading )
 }; // class Heading
@@ -193,6 +228,19 @@ Q_DECLARE_FLAGS( TextOptions, TextOption )
 Q_DECLARE_OPERATORS_FOR_FLAGS( TextOptions )
 
 
+//
+// WordRuns
+//
+
+//! Offset and length of a word in the text.
+typedef QPair< int, int > WordRun;
+//! Words of the text.
+typedef QVector< WordRun > WordRuns;
+
+//! \return Words of the text separated by spaces.
+WordRuns splitWords( const QString & text );
+
+
 //
 // Text
 //
@@ -209,12 +257,15 @@ public:
 
 	const QString & text() const;
 	void setText( const QString & t );
+	//! \return Words of the text, they are found once when the text is set.
+	const WordRuns & words() const;
 
 	const TextOptions & opts() const;
 	void setOpts( const TextOptions & o );
 
 private:
 	QString m_text;
+	WordRuns m_words;
 	TextOptions m_opts;
 
 	Q_DISABLE_COPY( Text )
@@ -259,6 +310,7 @@ public:
 	const Items & items() const;
 	void setItems( const Items & i );
 	void appendItem( QSharedPointer< Item > i );
+	void removeItemAt( int idx );
 
 	bool isEmpty() const;
 
@@ -414,6 +466,8 @@ public:
 
 	const QString & text() const;
 	void setText( const QString & t );
+	//! \return Words of the text, they are found once when the text is set.
+	const WordRuns & words() const;
 
 	TextOptions textOptions() const;
 	void setTextOptions( const TextOptions & o );
@@ -421,11 +475,18 @@ public:
 	QSharedPointer< Image > img() const;
 	void setImg( QSharedPointer< Image > i );
 
+	//! \return ID of the label of the target in the document, -1 if the link
+	//! is external or it's not interned.
+	int targetId() const;
+	void setTargetId( int id );
+
 private:
 	QString m_url;
 	QString m_text;
+	WordRuns m_words;
 	TextOptions m_opts;
 	QSharedPointer< Image > m_img;
+	int m_targetId = -1;
 
 	Q_DISABLE_COPY( Link )
 }; // class Link
@@ -447,12 +508,15 @@ public:
 
 	const QString & text() const;
 	void setText( const QString & t );
+	//! \return Words of the text, they are found once when the text is set.
+	const WordRuns & words() const;
 
 	bool inlined() const;
 	void setInlined( bool on = true );
 
 private:
 	QString m_text;
+	WordRuns m_words;
 	bool m_inlined;
 
 	Q_DISABLE_COPY( Code )
@@ -512,6 +576,11 @@ private:
 //
 
 //! Table.
+/*!
+	Rows keep their cells as items, as cached and reparsed documents share them
+	with the rest of the tree, so large tables aren't stored column-wise here.
+	Renderer bounds memory of large tables by drawing them by chunks of rows.
+*/
 class Table final
 	:	public Item
 {
@@ -612,21 +681,53 @@ public:
 
 	const Footnotes & footnotesMap() const;
 	void insertFootnote( const QString & id, QSharedPointer< Footnote > fn );
+	void removeFootnote( const QString & id );
 
 	typedef QMap< QString, QSharedPointer< Link > > LabeledLinks;
 
 	const LabeledLinks & labeledLinks() const;
 	void insertLabeledLink( const QString & label, QSharedPointer< Link > lnk );
+	void removeLabeledLink( const QString & label );
 
 	typedef QMap< QString, QSharedPointer< Heading > > LabeledHeadings;
 
 	const LabeledHeadings & labeledHeadings() const;
 	void insertLabeledHeading( const QString & label, QSharedPointer< Heading > h );
+	void removeLabeledHeading( const QString & label );
+
+	typedef QVector< QString > Sources;
+
+	//! Source buffers that strings of items may refer to without a copy.
+	const Sources & sources() const;
+	//! Keep source buffer alive while the document is alive.
+	void addSource( const QString & src );
+	//! Remove source buffers that no string of the document refers to any more.
+	void removeUnusedSources();
+
+	//! \return Dense ID of the label of an anchor, a heading or a link target,
+	//! label is added if it's not known yet.
+	int labelId( const QString & label );
+	//! \return ID of the label, -1 if it's not known.
+	int findLabel( const QString & label ) const;
+	//! \return Count of known labels, IDs are less than it.
+	int labelsCount() const;
+	//! Set IDs of labels of anchors, headings and internal links, including
+	//! ones in footnotes. Should be called when items are changed.
+	void internLabels();
+
+private:
+	void internLabels( Block * block );
+	//! Mark sources that strings of items of the block refer to.
+	void markUsedSources( const Block * block, QVector< bool > & used ) const;
+	//! Mark source the string refers to.
+	void markUsedSource( const QString & str, QVector< bool > & used ) const;
 
 private:
 	Footnotes m_footnotes;
 	LabeledLinks m_labeledLinks;
 	LabeledHeadings m_labeledHeadings;
+	Sources m_sources;
+	QHash< QString, int > m_labelIds;
 
 	Q_DISABLE_COPY( Document )
 }; // class Document;
@@ -22,12 +22,22 @@
 
 // md-pdf include
 #include "md_parser.hpp"
+#include "md_cache.hpp"
 
 // Qt include.
 #include <QFileInfo>
 #include <QFile>
 #include <QDir>
 #include <QRegExp>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+#include <QAtomicInt>
+#include <QWaitCondition>
+
+// C++ include.
+#include <functional>
+#include <limits>
 
 
 namespace MD {
@@ -36,160 +46,1329 @@ namespace MD {
 // Parser
 //
 
+namespace /* anonymous */ {
+
+//
+// ParseTask
+//
+
+//! Task to parse one file or a part of it on a thread pool.
+class ParseTask final
+	:	public QRunnable
+{
+public:
+	explicit ParseTask( const std::function< void() > & func )
+		:	m_func( func )
+	{
+	}
+
+	void run() override
+	{
+		m_func();
+	}
+
+private:
+	std::function< void() > m_func;
+}; // class ParseTask
+
+//! \return Is the file a Markdown file that should be parsed.
+bool
+isMarkdownFile( const QFileInfo & fi )
+{
+	return ( fi.exists() && ( fi.suffix().toLower() == QLatin1String( "md" ) ||
+		fi.suffix().toLower() == QLatin1String( "markdown" ) ) );
+}
+
+} /* namespace anonymous */
+
+
 QSharedPointer< Document >
 Parser::parse( const QString & fileName, bool recursive, QTextCodec * codec )
+{
+	return parse( fileName, nullptr, recursive, codec );
+}
+
+QSharedPointer< Document >
+Parser::parse( const QString & fileName, BlockHandler * handler, bool recursive,
+	QTextCodec * codec )
 {
 	QSharedPointer< Document > doc( new Document );
 
-	parseFile( fileName, recursive, doc, codec );
+	const auto absFileName = QFileInfo( fileName ).absoluteFilePath();
+
+	m_handler = handler;
+	m_lastItemType = ItemType::Unknown;
+
+	m_parsedFiles.insert( fileKey( absFileName ) );
+
+	QSet< QString > appendedFiles;
+
+	// Threads of the pool are the only threads besides the calling one.
+	QThreadPool pool;
+	const int threads = threadsCount();
+
+	if( threads > 1 )
+	{
+		pool.setMaxThreadCount( threads - 1 );
+		m_pool = &pool;
+	}
+
+	// Linked files are parsed concurrently into separate fragments...
+	parseFile( absFileName, codec, ( recursive ? m_pool : nullptr ), m_handler != nullptr );
+
+	// ...and are joined as soon as they are ready in the same order as they
+	// would be parsed one by one.
+	appendFile( absFileName, recursive, doc, appendedFiles, codec );
+
+	pool.waitForDone();
+
+	m_pool = nullptr;
+	m_handler = nullptr;
+	m_streamedDoc = nullptr;
 
 	clearCache();
 
+	doc->internLabels();
+
 	return doc;
 }
 
+namespace /* anonymous */ {
+
+//! Remove definitions of the file parsed from lines [from, to), shift definitions
+//! after them. \a shifted - items that are already shifted.
+template< typename MAP, typename REMOVE >
 void
-Parser::parseFile( const QString & fileName, bool recursive, QSharedPointer< Document > doc,
-	QTextCodec * codec )
+updateDefinitions( const MAP & map, const QString & fileName, int from, int to, int delta,
+	QSet< Item* > & shifted, REMOVE remove )
+{
+	QStringList removed;
+
+	for( auto it = map.cbegin(), last = map.cend(); it != last; ++it )
+	{
+		auto span = it.value()->sourceSpan();
+
+		if( !span.isValid() || span.m_fileName != fileName )
+			continue;
+
+		if( span.m_startLine >= to )
+		{
+			if( !shifted.contains( it.value().data() ) )
+			{
+				span.m_startLine += delta;
+				span.m_endLine += delta;
+				it.value()->setSourceSpan( span );
+
+				shifted.insert( it.value().data() );
+			}
+		}
+		else if( span.m_startLine >= from )
+			removed.append( it.key() );
+	}
+
+	for( const auto & key : qAsConst( removed ) )
+		remove( key );
+}
+
+} /* namespace anonymous */
+
+bool
+Parser::reparse( QSharedPointer< Document > doc, const QString & fileName,
+	int firstLine, int lastLine, QTextCodec * codec )
+{
+	const QFileInfo fi( fileName );
+	const auto path = fi.absoluteFilePath();
+
+	const auto & items = doc->items();
+
+	int first = -1;
+
+	for( int i = 0; i < items.size(); ++i )
+	{
+		if( items.at( i )->type() == ItemType::Anchor &&
+			static_cast< Anchor* > ( items.at( i ).data() )->label() == path )
+		{
+			first = i + 1;
+
+			break;
+		}
+	}
+
+	if( first < 0 )
+		return false;
+
+	FileStream stream;
+
+	if( !stream.load( path, codec ) )
+		return false;
+
+	// Top-level items of the file are [first, last).
+	int last = first;
+
+	while( last < items.size() && items.at( last )->sourceSpan().isValid() &&
+		items.at( last )->sourceSpan().m_fileName == path )
+	{
+		++last;
+	}
+
+	// Last item of the file ends with the last line of the file.
+	const int oldCount = ( last > first ? items.at( last - 1 )->sourceSpan().m_endLine + 1 : 0 );
+	const int delta = stream.size() - oldCount;
+	const int lastOldLine = lastLine - delta;
+
+	// Block before the edited one is parsed too, as the edit may join them.
+	int from = first;
+
+	for( int i = first; i < last && items.at( i )->sourceSpan().m_startLine <= firstLine; ++i )
+		from = i;
+
+	if( from > first )
+		--from;
+
+	const int start = ( from > first ? items.at( from )->sourceSpan().m_startLine : 0 );
+
+	QSet< int > resync;
+
+	for( int i = from; i < last; ++i )
+	{
+		const int line = items.at( i )->sourceSpan().m_startLine;
+
+		if( line > lastOldLine )
+			resync.insert( line + delta );
+	}
+
+	QSharedPointer< Document > part( new Document );
+	QStringList linksToParse;
+
+	// Strings of the part refer to the text of the file as it's now.
+	if( m_sourceViews )
+		part->addSource( stream.text() );
+
+	stream.seek( start );
+
+	parse( stream, part, part, linksToParse, fi.absolutePath() + QDir::separator(),
+		fi.fileName(), &resync );
+
+	{
+		QThreadPool pool;
+		const int threads = threadsCount();
+
+		if( threads > 1 )
+		{
+			pool.setMaxThreadCount( threads - 1 );
+			m_pool = &pool;
+		}
+
+		parseInlines( part, linksToParse );
+
+		pool.waitForDone();
+
+		m_pool = nullptr;
+	}
+
+	// Part of the file is not cached.
+	if( !m_cacheDir.isEmpty() )
+	{
+		QMutexLocker lock( &m_mutex );
+
+		m_targets.remove( fi.absolutePath() + QDir::separator() + fi.fileName() );
+	}
+
+	// Old lines [start, oldStop) are replaced.
+	const int oldStop = ( stream.atEnd() ? std::numeric_limits< int >::max() :
+		stream.pos() - delta );
+
+	int to = from;
+
+	while( to < last && items.at( to )->sourceSpan().m_startLine < oldStop )
+		++to;
+
+	QSet< Item* > shifted;
+
+	for( int i = to; i < last; ++i )
+	{
+		auto span = items.at( i )->sourceSpan();
+		span.m_startLine += delta;
+		span.m_endLine += delta;
+		items.at( i )->setSourceSpan( span );
+
+		shifted.insert( items.at( i ).data() );
+	}
+
+	updateDefinitions( doc->footnotesMap(), path, start, oldStop, delta, shifted,
+		[&doc] ( const QString & key ) { doc->removeFootnote( key ); } );
+	updateDefinitions( doc->labeledLinks(), path, start, oldStop, delta, shifted,
+		[&doc] ( const QString & key ) { doc->removeLabeledLink( key ); } );
+	updateDefinitions( doc->labeledHeadings(), path, start, oldStop, delta, shifted,
+		[&doc] ( const QString & key ) { doc->removeLabeledHeading( key ); } );
+
+	for( auto it = part->footnotesMap().cbegin(), lastIt = part->footnotesMap().cend();
+		it != lastIt; ++it )
+	{
+		doc->insertFootnote( it.key(), it.value() );
+	}
+
+	for( auto it = part->labeledLinks().cbegin(), lastIt = part->labeledLinks().cend();
+		it != lastIt; ++it )
+	{
+		doc->insertLabeledLink( it.key(), it.value() );
+	}
+
+	for( auto it = part->labeledHeadings().cbegin(), lastIt = part->labeledHeadings().cend();
+		it != lastIt; ++it )
+	{
+		doc->insertLabeledHeading( it.key(), it.value() );
+	}
+
+	Block::Items result = items.mid( 0, from );
+	result.append( part->items() );
+	result.append( items.mid( to ) );
+
+	const int fileEnd = from + part->items().size() + ( last - to );
+
+	// Keep the last line of the file in the span of its last item.
+	if( fileEnd > first )
+	{
+		auto span = result.at( fileEnd - 1 )->sourceSpan();
+		span.m_endLine = stream.size() - 1;
+		result.at( fileEnd - 1 )->setSourceSpan( span );
+	}
+
+	doc->setItems( result );
+
+	// Text of the file is kept only if new items refer to it, and texts only
+	// replaced items referred to are dropped, so edits don't pile up copies.
+	if( m_sourceViews )
+	{
+		for( const auto & src : part->sources() )
+			doc->addSource( src );
+
+		doc->removeUnusedSources();
+	}
+
+	doc->internLabels();
+
+	return true;
+}
+
+void
+Parser::setSourceViews( bool on )
+{
+	m_sourceViews = on;
+}
+
+bool
+Parser::sourceViews() const
+{
+	return m_sourceViews;
+}
+
+void
+Parser::setThreadsCount( int count )
+{
+	m_threadsCount = qMax( 0, count );
+}
+
+int
+Parser::threadsCount() const
+{
+	return ( m_threadsCount > 0 ? m_threadsCount : qMax( 1, QThread::idealThreadCount() ) );
+}
+
+void
+Parser::setCacheDir( const QString & dir )
+{
+	m_cacheDir = dir;
+}
+
+const QString &
+Parser::cacheDir() const
+{
+	return m_cacheDir;
+}
+
+void
+Parser::parseFile( const QString & fileName, QTextCodec * codec, QThreadPool * pool,
+	bool streamItems )
 {
 	QFileInfo fi( fileName );
 
-	if( fi.exists() && ( fi.suffix().toLower() == QLatin1String( "md" ) ||
-		fi.suffix().toLower() == QLatin1String( "markdown" ) ) )
+	if( isMarkdownFile( fi ) )
 	{
-		QFile f( fileName );
+		Fragment fragment;
 
-		if( f.open( QIODevice::ReadOnly ) )
+		const auto codecName = ( codec ? codec->name() : QByteArray() );
+
+		if( !m_cacheDir.isEmpty() )
+			fragment.m_doc = DocumentCache( m_cacheDir ).load( fi.absoluteFilePath(),
+				codecName, fragment.m_links );
+
+		FileStream stream;
+
+		if( fragment.m_doc.isNull() && stream.load( fileName, codec ) )
 		{
 			QStringList linksToParse;
 
-			QTextStream s( &f );
-			s.setCodec( codec );
+			fragment.m_doc.reset( new Document );
+
+			auto & doc = fragment.m_doc;
+
+			if( m_sourceViews )
+				doc->addSource( stream.text() );
 
 			doc->appendItem( QSharedPointer< Anchor > ( new Anchor( fi.absoluteFilePath() ) ) );
 
-			TextStream stream( s );
+			// Top-level items of the main file are handed over while it's parsed.
+			if( streamItems )
+				m_streamedDoc = doc.data();
 
 			parse( stream, doc, doc, linksToParse,
 				fi.absolutePath() + QDir::separator(), fi.fileName() );
 
-			f.close();
+			parseInlines( doc, linksToParse );
 
-			m_parsedFiles.append( fi.absoluteFilePath() );
+			// The last item ends with the file, even if definitions follow it.
+			if( !doc->items().isEmpty() && doc->items().last()->sourceSpan().isValid() )
+			{
+				auto span = doc->items().last()->sourceSpan();
+				span.m_endLine = stream.size() - 1;
+				doc->items().last()->setSourceSpan( span );
+			}
 
-			if( recursive && !linksToParse.isEmpty() )
+			for( auto nextFileName : qAsConst( linksToParse ) )
 			{
-				while( !linksToParse.isEmpty() )
+				if( nextFileName.startsWith( QLatin1Char( '#' ) ) )
 				{
-					auto nextFileName = linksToParse.first();
-					linksToParse.removeFirst();
+					// Labeled links are keyed with the file name, so label is
+					// always defined in this file.
+					if( doc->labeledLinks().contains( nextFileName ) )
+						nextFileName = doc->labeledLinks()[ nextFileName ]->url();
+					else
+						continue;
+				}
 
-					if( nextFileName.startsWith( QLatin1Char( '#' ) ) )
-					{
-						if( doc->labeledLinks().contains( nextFileName ) )
-							nextFileName = doc->labeledLinks()[ nextFileName ]->url();
-						else
-							continue;
-					}
+				fragment.m_links.append( QFileInfo( nextFileName ).absoluteFilePath() );
+			}
+
+			if( !m_cacheDir.isEmpty() )
+			{
+				DocumentCache::Targets targets;
+
+				{
+					QMutexLocker lock( &m_mutex );
+
+					targets = m_targets.take( fi.absolutePath() + QDir::separator() +
+						fi.fileName() );
+				}
 
-					QFileInfo nextFile( nextFileName );
+				// Streamed items are already handed over, so such fragment is incomplete.
+				if( !streamItems )
+					DocumentCache( m_cacheDir ).store( fi.absoluteFilePath(), codecName,
+						doc, fragment.m_links, targets );
+			}
+		}
 
-					if( !m_parsedFiles.contains( nextFile.absoluteFilePath() ) )
+		if( !fragment.m_doc.isNull() )
+		{
+			if( pool )
+			{
+				for( const auto & next : qAsConst( fragment.m_links ) )
+				{
+					if( isMarkdownFile( QFileInfo( next ) ) )
 					{
-						if( !doc->isEmpty() && doc->items().last()->type() != ItemType::PageBreak )
-							doc->appendItem( QSharedPointer< PageBreak > ( new PageBreak() ) );
+						const auto key = fileKey( next );
 
-						parseFile( nextFile.absoluteFilePath(), recursive, doc, codec );
+						QMutexLocker lock( &m_mutex );
+
+						if( !m_parsedFiles.contains( key ) )
+						{
+							m_parsedFiles.insert( key );
+
+							pool->start( new ParseTask(
+								[this, next, codec, pool] () { parseFile( next, codec, pool ); } ) );
+						}
 					}
 				}
 			}
+
+			QMutexLocker lock( &m_mutex );
+
+			m_fragments.insert( fileKey( fi.absoluteFilePath() ), fragment );
 		}
 	}
+
+	QMutexLocker lock( &m_mutex );
+
+	m_finishedFiles.insert( fileKey( fi.absoluteFilePath() ) );
+
+	m_fileFinished.wakeAll();
+}
+
+void
+Parser::appendItem( QSharedPointer< Document > doc, QSharedPointer< Item > item )
+{
+	m_lastItemType = item->type();
+
+	if( m_handler )
+		m_handler->onItem( item );
+	else
+		doc->appendItem( item );
+}
+
+void
+Parser::flushStreamedItems()
+{
+	for( const auto & item : m_streamedDoc->items() )
+	{
+		m_lastItemType = item->type();
+
+		m_handler->onItem( item );
+	}
+
+	m_streamedDoc->setItems( Block::Items() );
 }
 
-Parser::BlockType
-Parser::whatIsTheLine( const QString & str, bool inList ) const
+void
+Parser::appendFile( const QString & fileName, bool recursive, QSharedPointer< Document > doc,
+	QSet< QString > & appendedFiles, QTextCodec * codec )
 {
-	const auto s = str.simplified();
-	static const QRegExp olr( QLatin1String( "^\\d+\\.\\s+.*" ) );
+	const auto key = fileKey( fileName );
+
+	Fragment fragment;
 
-	if( inList )
+	// Linked Markdown files are not started on the pool only if there is no pool.
+	if( recursive && isMarkdownFile( QFileInfo( fileName ) ) )
 	{
-		if( ( ( s.startsWith( QLatin1Char( '-' ) ) ||
-			s.startsWith( QLatin1Char( '+' ) ) ||
-			s.startsWith( QLatin1Char( '*' ) ) ) && s.length() > 1 && s[ 1 ].isSpace() ) ||
-				olr.exactMatch( s ) )
-		{
-			return BlockType::List;
-		}
-		else if( str.startsWith( QLatin1String( "    " ) ) ||
-			str.startsWith( QLatin1Char( '\t' ) ) )
+		bool parseHere = false;
+
 		{
-			if( str.startsWith( QLatin1String( "        " ) ) ||
-				str.startsWith( QLatin1String( "\t\t" ) ) )
+			QMutexLocker lock( &m_mutex );
+
+			if( !m_parsedFiles.contains( key ) )
 			{
-				return BlockType::CodeIndentedBySpaces;
+				m_parsedFiles.insert( key );
+				parseHere = true;
 			}
-			else if( s.startsWith( QLatin1Char( '>' ) ) )
-				return BlockType::Blockquote;
-			else if( s.startsWith( QLatin1String( "```" ) ) ||
-				s.startsWith( QLatin1String( "~~~" ) ) )
+		}
+
+		if( parseHere )
+			parseFile( fileName, codec, nullptr );
+	}
+
+	{
+		QMutexLocker lock( &m_mutex );
+
+		if( !m_parsedFiles.contains( key ) )
+			return;
+
+		while( !m_finishedFiles.contains( key ) )
+			m_fileFinished.wait( &m_mutex );
+
+		if( !m_fragments.contains( key ) )
+			return;
+
+		// Joined file is not needed anymore.
+		fragment = m_fragments.take( key );
+	}
+
+	for( const auto & i : fragment.m_doc->items() )
+		appendItem( doc, i );
+
+	for( auto fit = fragment.m_doc->footnotesMap().cbegin(),
+		last = fragment.m_doc->footnotesMap().cend(); fit != last; ++fit )
+	{
+		doc->insertFootnote( fit.key(), fit.value() );
+	}
+
+	for( auto lit = fragment.m_doc->labeledLinks().cbegin(),
+		last = fragment.m_doc->labeledLinks().cend(); lit != last; ++lit )
+	{
+		doc->insertLabeledLink( lit.key(), lit.value() );
+	}
+
+	for( auto hit = fragment.m_doc->labeledHeadings().cbegin(),
+		last = fragment.m_doc->labeledHeadings().cend(); hit != last; ++hit )
+	{
+		doc->insertLabeledHeading( hit.key(), hit.value() );
+	}
+
+	for( const auto & src : fragment.m_doc->sources() )
+		doc->addSource( src );
+
+	appendedFiles.insert( key );
+
+	if( recursive )
+	{
+		for( const auto & nextFileName : fragment.m_links )
+		{
+			if( !appendedFiles.contains( fileKey( nextFileName ) ) )
 			{
-				return BlockType::Code;
+				if( m_lastItemType != ItemType::Unknown && m_lastItemType != ItemType::PageBreak )
+					appendItem( doc, QSharedPointer< PageBreak > ( new PageBreak() ) );
+
+				appendFile( nextFileName, recursive, doc, appendedFiles, codec );
 			}
-			else if( s.isEmpty() )
-				return BlockType::Unknown;
-			else if( s.startsWith( QLatin1Char( '#' ) ) )
-				return BlockType::Heading;
-			else
-				return BlockType::Text;
 		}
-		else
-			return BlockType::Text;
 	}
-	else
+}
+
+QString
+Parser::fileKey( const QString & fileName )
+{
+	const auto canonical = QFileInfo( fileName ).canonicalFilePath();
+
+	return ( canonical.isEmpty() ? fileName : canonical );
+}
+
+namespace /* anonymous */ {
+
+//! Classes of ASCII characters.
+enum CharClass : unsigned char {
+	SpaceChar = 1,
+	DigitChar = 2,
+	BulletChar = 4,
+	SpecialChar = 8
+}; // enum CharClass
+
+//! Lookup table of classes of ASCII characters.
+struct CharClasses {
+	unsigned char m_classes[ 128 ];
+
+	constexpr CharClasses()
+		:	m_classes()
 	{
-		if( ( ( s.startsWith( QLatin1Char( '-' ) ) ||
-			s.startsWith( QLatin1Char( '+' ) ) ||
-			s.startsWith( QLatin1Char( '*' ) ) ) && s.length() > 1 && s[ 1 ].isSpace() ) ||
-				olr.exactMatch( s ) )
+		for( int c = 0; c < 128; ++c )
 		{
-			return BlockType::List;
+			unsigned char v = 0;
+
+			if( c == ' ' || ( c >= 0x09 && c <= 0x0D ) )
+				v |= SpaceChar;
+
+			if( c >= '0' && c <= '9' )
+				v |= DigitChar;
+
+			if( c == '*' || c == '-' || c == '+' )
+				v |= BulletChar;
+
+			m_classes[ c ] = v;
 		}
-		else if( str.startsWith( QLatin1String( "    " ) ) ||
-			str.startsWith( QLatin1Char( '\t' ) ) )
+
+		for( const char * c = "\\`*_{}[]()#+-.!|~<>"; *c; ++c )
+			m_classes[ static_cast< unsigned char > ( *c ) ] |= SpecialChar;
+	}
+}; // struct CharClasses
+
+static constexpr CharClasses c_charClasses;
+
+//! \return Is the character a white space, the same as QChar::isSpace().
+inline bool
+isSpaceChar( QChar c )
+{
+	const auto u = c.unicode();
+
+	return ( u < 128 ? ( c_charClasses.m_classes[ u ] & SpaceChar ) != 0 : c.isSpace() );
+}
+
+//! \return Is the character a digit, the same as QChar::isDigit().
+inline bool
+isDigitChar( QChar c )
+{
+	const auto u = c.unicode();
+
+	return ( u < 128 ? ( c_charClasses.m_classes[ u ] & DigitChar ) != 0 : c.isDigit() );
+}
+
+//! \return Is the character a marker of unordered list.
+inline bool
+isBulletChar( QChar c )
+{
+	const auto u = c.unicode();
+
+	return ( u < 128 && ( c_charClasses.m_classes[ u ] & BulletChar ) != 0 );
+}
+
+//! \return Is the character special for inline formatting of the text.
+inline bool
+isSpecialChar( QChar c )
+{
+	const auto u = c.unicode();
+
+	return ( u < 128 && ( c_charClasses.m_classes[ u ] & SpecialChar ) != 0 );
+}
+
+//! \return Position of the first special character starting from \a pos, or \a length.
+inline int
+nextSpecialChar( const QChar * data, int pos, int length )
+{
+	while( pos < length && !isSpecialChar( data[ pos ] ) )
+		++pos;
+
+	return pos;
+}
+
+//! \return Is the data in one of source buffers of the document.
+bool
+isSourceData( const Document & doc, const QChar * data )
+{
+	for( const auto & src : doc.sources() )
+	{
+		if( !std::less< const QChar* > () ( data, src.constData() ) &&
+			std::less< const QChar* > () ( data, src.constData() + src.size() ) )
 		{
-			return BlockType::CodeIndentedBySpaces;
+			return true;
 		}
-		else if( s.startsWith( QLatin1Char( '>' ) ) )
-			return BlockType::Blockquote;
-		else if( s.startsWith( QLatin1String( "```" ) ) ||
-			s.startsWith( QLatin1String( "~~~" ) ) )
+	}
+
+	return false;
+}
+
+//! \return Part of the string, \a pos and \a length should be in bounds of the string.
+//! Refers to source buffer of the document if the string does, or is a copy otherwise.
+QString
+sourceSlice( const Document & doc, const QString & str, int pos, int length )
+{
+	if( length > 0 && isSourceData( doc, str.constData() ) )
+		return QString::fromRawData( str.constData() + pos, length );
+	else
+		return str.mid( pos, length );
+}
+
+//! \return String of the line. Refers to source buffer of the document if the line
+//! does, or is a copy otherwise.
+QString
+lineString( const Document & doc, const QStringRef & line )
+{
+	if( !line.isEmpty() && isSourceData( doc, line.unicode() ) )
+		return QString::fromRawData( line.unicode(), line.size() );
+	else
+		return line.toString();
+}
+
+//! \return Strings of lines, see lineString().
+QStringList
+lineStrings( const Document & doc, const QVector< QStringRef > & lines )
+{
+	QStringList res;
+	res.reserve( lines.size() );
+
+	for( const auto & line : lines )
+		res.append( lineString( doc, line ) );
+
+	return res;
+}
+
+//! \return Is the line a horizontal rule, i.e. "***", "---" or "___".
+bool
+isHorizontalRule( const QString & str )
+{
+	const int length = str.length();
+
+	if( length < 3 || ( str[ 0 ] != QLatin1Char( '*' ) && str[ 0 ] != QLatin1Char( '-' ) &&
+		str[ 0 ] != QLatin1Char( '_' ) ) )
+	{
+		return false;
+	}
+
+	for( int i = 1; i < length; ++i )
+	{
+		if( str[ i ] != str[ 0 ] )
+			return false;
+	}
+
+	return true;
+}
+
+//! \return Position of the first non-space character starting from \a pos.
+inline int
+skipSpaceChars( const QChar * data, int pos, int length )
+{
+	while( pos < length && isSpaceChar( data[ pos ] ) )
+		++pos;
+
+	return pos;
+}
+
+//! \return Is the line an underline of alternative syntax of heading, i.e. two or more
+//! \a c characters with optional spaces around.
+bool
+isSetextUnderline( const QStringRef & str, QChar c )
+{
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	const int start = skipSpaceChars( data, 0, length );
+	int i = start;
+
+	while( i < length && data[ i ] == c )
+		++i;
+
+	return ( i - start >= 2 && skipSpaceChars( data, i, length ) == length );
+}
+
+//! \return Position right after list item marker ("*", "-", "+" or "1.") at \a pos,
+//! if it's followed by a space, or -1.
+int
+listMarkerEnd( const QStringRef & str, int pos )
+{
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	if( pos < 0 || pos >= length )
+		return -1;
+
+	int i = pos;
+
+	if( isBulletChar( data[ i ] ) )
+		++i;
+	else if( isDigitChar( data[ i ] ) )
+	{
+		while( i < length && isDigitChar( data[ i ] ) )
+			++i;
+
+		if( i < length && data[ i ] == QLatin1Char( '.' ) )
+			++i;
+		else
+			return -1;
+	}
+	else
+		return -1;
+
+	return ( i < length && isSpaceChar( data[ i ] ) ? i : -1 );
+}
+
+//! \return Length of leading spaces, list item marker and spaces after it, or -1.
+int
+listItemPrefixLength( const QStringRef & str )
+{
+	const int end = listMarkerEnd( str,
+		skipSpaceChars( str.unicode(), 0, str.length() ) );
+
+	return ( end > -1 ? skipSpaceChars( str.unicode(), end, str.length() ) : -1 );
+}
+
+//! \return Is the line a delimiter between header and content of the table.
+bool
+isTableDelimiter( const QStringRef & str )
+{
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	int i = skipSpaceChars( data, 0, length );
+
+	if( i < length && data[ i ] == QLatin1Char( '|' ) )
+		++i;
+
+	while( true )
+	{
+		i = skipSpaceChars( data, i, length );
+
+		if( i < length && data[ i ] == QLatin1Char( ':' ) )
+			++i;
+
+		int dashes = 0;
+
+		while( i < length && data[ i ] == QLatin1Char( '-' ) )
 		{
-			return BlockType::Code;
+			++dashes;
+			++i;
+		}
+
+		if( dashes < 3 )
+			return false;
+
+		if( i < length && data[ i ] == QLatin1Char( ':' ) )
+			++i;
+
+		i = skipSpaceChars( data, i, length );
+
+		if( i == length )
+			return true;
+
+		if( data[ i ] != QLatin1Char( '|' ) )
+			return false;
+
+		i = skipSpaceChars( data, i + 1, length );
+
+		if( i == length )
+			return true;
+	}
+}
+
+} /* namespace anonymous */
+
+Parser::LineInfo
+Parser::classifyLine( const Line & str )
+{
+	LineInfo info;
+
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	const int pos = skipSpaceChars( data, 0, length );
+
+	const bool indentedBySpaces = ( str.startsWith( QLatin1String( "    " ) ) ||
+		str.startsWith( QLatin1Char( '\t' ) ) );
+
+	if( pos == length )
+	{
+		if( indentedBySpaces )
+			info.type = BlockType::CodeIndentedBySpaces;
+
+		return info;
+	}
+
+	info.indent = pos;
+
+	const QChar c = data[ pos ];
+
+	const int markerEnd = listMarkerEnd( str, pos );
+
+	// List item should have something after the marker.
+	if( markerEnd > -1 && skipSpaceChars( data, markerEnd, length ) < length )
+	{
+		info.listMarkerEnd = markerEnd;
+
+		if( isBulletChar( c ) )
+			info.listMarker = c;
+		else
+		{
+			info.listMarker = QLatin1Char( '.' );
+			info.listNumber = str.mid( pos, markerEnd - pos - 1 ).toInt();
+		}
+	}
+
+	if( ( c == QLatin1Char( '`' ) || c == QLatin1Char( '~' ) ) && pos + 2 < length &&
+		data[ pos + 1 ] == c && data[ pos + 2 ] == c )
+	{
+		info.fence = c;
+	}
+
+	if( !info.listMarker.isNull() )
+		info.type = BlockType::List;
+	else if( indentedBySpaces )
+		info.type = BlockType::CodeIndentedBySpaces;
+	else if( c == QLatin1Char( '>' ) )
+		info.type = BlockType::Blockquote;
+	else if( !info.fence.isNull() )
+		info.type = BlockType::Code;
+	else if( c == QLatin1Char( '#' ) )
+		info.type = BlockType::Heading;
+	else
+		info.type = BlockType::Text;
+
+	return info;
+}
+
+int
+Parser::firstNonSpace( const Line & str )
+{
+	const int pos = skipSpaceChars( str.unicode(), 0, str.length() );
+
+	return ( pos < str.length() ? pos : -1 );
+}
+
+Parser::Line
+Parser::stripPrefix( const Line & str, int length )
+{
+	return ( length > 0 ? str.mid( length ) : str );
+}
+
+bool
+Parser::isFootnote( const Line & str )
+{
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	int i = skipSpaceChars( data, 0, length );
+
+	if( i + 1 >= length || data[ i ] != QLatin1Char( '[' ) || data[ i + 1 ] != QLatin1Char( '^' ) )
+		return false;
+
+	// Footnote's id can't contain spaces, and is ended with "]:".
+	for( i += 2; i + 1 < length && !isSpaceChar( data[ i ] ); ++i )
+	{
+		if( data[ i ] == QLatin1Char( ']' ) && data[ i + 1 ] == QLatin1Char( ':' ) )
+			return true;
+	}
+
+	return false;
+}
+
+Parser::BlockType
+Parser::whatIsTheLine( const Line & str, bool inList ) const
+{
+	return whatIsTheLine( classifyLine( str ), str, inList );
+}
+
+Parser::BlockType
+Parser::whatIsTheLine( const LineInfo & info, const Line & str, bool inList ) const
+{
+	if( !inList || info.type == BlockType::List )
+		return info.type;
+
+	if( str.startsWith( QLatin1String( "    " ) ) || str.startsWith( QLatin1Char( '\t' ) ) )
+	{
+		if( str.startsWith( QLatin1String( "        " ) ) ||
+			str.startsWith( QLatin1String( "\t\t" ) ) )
+		{
+			return BlockType::CodeIndentedBySpaces;
 		}
-		else if( s.isEmpty() )
+		else if( info.indent < 0 )
 			return BlockType::Unknown;
-		else if( s.startsWith( QLatin1Char( '#' ) ) )
+		else if( str.at( info.indent ) == QLatin1Char( '>' ) )
+			return BlockType::Blockquote;
+		else if( !info.fence.isNull() )
+			return BlockType::Code;
+		else if( str.at( info.indent ) == QLatin1Char( '#' ) )
 			return BlockType::Heading;
 		else
 			return BlockType::Text;
 	}
+	else
+		return BlockType::Text;
+}
+
+void
+Parser::groupLine( Grouping & g, const Line & line, const std::function< void() > & pf ) const
+{
+	// Parse fragment and clear internal cache.
+	auto flush = [&]()
+		{
+			pf();
+
+			g.m_fragment.clear();
+			g.m_type = BlockType::Unknown;
+			g.m_emptyLineInList = false;
+		};
+
+	// Eat footnote.
+	if( g.m_footnote )
+	{
+		if( line.isEmpty() || line.startsWith( QLatin1String( "    " ) ) ||
+			line.startsWith( QLatin1Char( '\t' ) ) )
+		{
+			g.m_fragment.append( line );
+		}
+		else
+		{
+			flush();
+
+			g.m_footnote = false;
+			g.m_type = whatIsTheLine( line );
+			g.m_fragment.append( line );
+		}
+
+		return;
+	}
+
+	const auto info = classifyLine( line );
+	const bool blank = ( info.indent < 0 );
+
+	BlockType lineType = whatIsTheLine( info, line, g.m_emptyLineInList );
+
+	// First line of the fragment.
+	if( !blank && g.m_type == BlockType::Unknown )
+	{
+		g.m_type = lineType;
+
+		g.m_fragment.append( line );
+
+		if( g.m_type == BlockType::Heading )
+			flush();
+
+		return;
+	}
+	else if( blank && g.m_type == BlockType::Unknown )
+		return;
+
+	// Got new empty line.
+	if( blank )
+	{
+		switch( g.m_type )
+		{
+			case BlockType::Text :
+			{
+				if( isFootnote( g.m_fragment.first() ) )
+				{
+					g.m_fragment.append( Line() );
+
+					g.m_footnote = true;
+				}
+				else
+					flush();
+
+				return;
+			}
+
+			case BlockType::Blockquote :
+			{
+				flush();
+
+				return;
+			}
+
+			case BlockType::CodeIndentedBySpaces :
+			{
+				if( line.startsWith( QLatin1String( "    " ) ) ||
+					line.startsWith( QLatin1Char( '\t' ) ) )
+				{
+					g.m_fragment.append( line );
+				}
+				else
+					flush();
+
+				return;
+			}
+
+			case BlockType::Code :
+			{
+				g.m_fragment.append( line );
+
+				return;
+			}
+
+			case BlockType::List :
+			{
+				g.m_emptyLineInList = true;
+
+				return;
+			}
+
+			default :
+				break;
+		}
+	}
+	//! Empty new line in list.
+	else if( g.m_emptyLineInList )
+	{
+		if( line.startsWith( QLatin1String( "    " ) ) ||
+			line.startsWith( QLatin1Char( '\t' ) )  ||
+			lineType == BlockType::List )
+		{
+			g.m_fragment.append( Line() );
+			g.m_fragment.append( line );
+
+			g.m_emptyLineInList = false;
+		}
+		else
+		{
+			flush();
+
+			g.m_type = lineType;
+			g.m_fragment.append( line );
+		}
+
+		return;
+	}
+
+	// Something new and this is not a code block or a list.
+	if( g.m_type != lineType && g.m_type != BlockType::Code && g.m_type != BlockType::List )
+	{
+		flush();
+
+		g.m_type = lineType;
+
+		if( !line.isEmpty() )
+			g.m_fragment.append( line );
+	}
+	// End of code block.
+	else if( g.m_type == BlockType::Code && g.m_type == lineType )
+	{
+		g.m_fragment.append( line );
+
+		flush();
+	}
+	else
+		g.m_fragment.append( line );
+}
+
+void
+Parser::finishGrouping( Grouping & g, const std::function< void() > & pf ) const
+{
+	if( !g.m_fragment.isEmpty() )
+		pf();
+
+	g.m_fragment.clear();
+	g.m_type = BlockType::Unknown;
+	g.m_emptyLineInList = false;
+	g.m_footnote = false;
+}
+
+void
+Parser::parseNestedBlocks( QSharedPointer< Block > root, QSharedPointer< Document > doc,
+	QStringList & linksToParse, const QString & workingPath, const QString & fileName,
+	ParseState & state )
+{
+	// Next block of the document is the last job, so jobs are taken in the
+	// order of the document. Depth of nesting is limited by memory only.
+	QVector< BlockJob > jobs;
+
+	auto takeNewJobs = [&]()
+		{
+			for( int i = state.m_newJobs.size() - 1; i >= 0; --i )
+				jobs.append( state.m_newJobs.at( i ) );
+
+			state.m_newJobs.clear();
+		};
+
+	takeNewJobs();
+
+	while( !jobs.isEmpty() )
+	{
+		auto & job = jobs.last();
+
+		state.m_listNesting = job.m_listNesting;
+
+		bool finished = true;
+
+		if( job.m_list )
+			parseList( job.m_lines, job.m_block, doc, linksToParse, workingPath, fileName,
+				state );
+		else
+		{
+			auto pf = [&]()
+				{
+					parseFragment( job.m_grouping.m_fragment, job.m_block, doc, linksToParse,
+						workingPath, fileName, state );
+				};
+
+			// Nested blocks found in the line are parsed before the next line.
+			while( job.m_pos < job.m_lines.size() && state.m_newJobs.isEmpty() )
+			{
+				auto line = job.m_lines.at( job.m_pos++ );
+
+				// Tabs in lines of the list are already expanded by parseList().
+				if( job.m_skipSpaces )
+				{
+					if( job.m_pos == 1 )
+						job.m_spaces = firstNonSpace( line );
+
+					line = stripPrefix( line, job.m_spaces );
+				}
+
+				groupLine( job.m_grouping, line, pf );
+			}
+
+			if( state.m_newJobs.isEmpty() )
+				finishGrouping( job.m_grouping, pf );
+			else
+				finished = false;
+		}
+
+		if( finished )
+			jobs.removeLast();
+
+		takeNewJobs();
+	}
+
+	state.m_listNesting = 0;
+
+	// Empty containers are removed starting from the innermost ones, so containers
+	// of empty ones are removed too. Each container is rebuilt at most once.
+	QSet< const Item* > removed;
+	QSet< const Block* > changed;
+
+	for( int i = state.m_containers.size() - 1; i >= 0; --i )
+	{
+		const auto & c = state.m_containers.at( i );
+
+		if( changed.contains( c.m_block.data() ) )
+		{
+			Block::Items items;
+
+			for( const auto & item : c.m_block->items() )
+			{
+				if( !removed.contains( item.data() ) )
+					items.append( item );
+			}
+
+			c.m_block->setItems( items );
+		}
+
+		if( c.m_block->isEmpty() && c.m_parent )
+		{
+			removed.insert( c.m_block.data() );
+			changed.insert( c.m_parent );
+		}
+	}
+
+	// Top-level container is the last item of the root.
+	if( changed.contains( root.data() ) )
+		root->removeItemAt( root->items().size() - 1 );
+
+	QSharedPointer< Item > spanItem;
+
+	if( !state.m_containers.isEmpty() && state.m_containers.first().m_parent &&
+		!removed.contains( state.m_containers.first().m_block.data() ) )
+	{
+		spanItem = state.m_containers.first().m_block;
+	}
+
+	// ID and replaced footnote of each added footnote.
+	QHash< const Block*, QPair< QString, QSharedPointer< Footnote > > > footnotes;
+
+	for( const auto & f : qAsConst( state.m_footnotes ) )
+	{
+		if( !f.second->isEmpty() )
+		{
+			footnotes.insert( f.second.data(),
+				qMakePair( f.first, doc->footnotesMap().value( f.first ) ) );
+
+			doc->insertFootnote( f.first, f.second );
+
+			state.m_footnotesAdded = true;
+
+			if( !spanItem )
+				spanItem = f.second;
+		}
+	}
+
+	// Deferred inline content may leave containers empty, so they are kept
+	// till it's parsed. Its definitions take span of the fragment.
+	if( isInlinesDeferred( doc ) && spanItem )
+	{
+		QMutexLocker lock( &m_mutex );
+
+		auto & inlines = m_inlineJobs[ doc.data() ];
+
+		for( const auto & c : qAsConst( state.m_containers ) )
+		{
+			if( !c.m_block->isEmpty() )
+			{
+				InlineContainer & ic = inlines.m_containers[ c.m_block.data() ];
+				ic.m_block = c.m_block;
+				ic.m_parent = c.m_parent;
+
+				const auto f = footnotes.value( c.m_block.data() );
+				ic.m_footnote = f.first;
+				ic.m_replaced = f.second;
+			}
+		}
+
+		for( int i = inlines.m_jobs.size() - 1;
+			i >= 0 && !inlines.m_jobs.at( i ).m_spanItem; --i )
+		{
+			inlines.m_jobs[ i ].m_spanItem = spanItem;
+		}
+	}
+
+	state.m_containers.clear();
+	state.m_footnotes.clear();
 }
 
 void
-Parser::parseFragment( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseFragment( Lines & fr, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
+	const QString & workingPath, const QString & fileName, ParseState & state )
 {
 	switch( whatIsTheLine( fr.first() ) )
 	{
 		case BlockType::Text :
-			parseText( fr, parent, doc, linksToParse, workingPath, fileName );
+			parseText( fr, parent, doc, linksToParse, workingPath, fileName, state );
 			break;
 
 		case BlockType::Blockquote :
-			parseBlockquote( fr, parent, doc, linksToParse, workingPath, fileName );
+			parseBlockquote( fr, parent, doc, linksToParse, workingPath, fileName, state );
 			break;
 
 		case BlockType::Code :
@@ -212,7 +1391,7 @@ Parser::parseFragment( QStringList & fr, QSharedPointer< Block > parent,
 			break;
 
 		case BlockType::List :
-			parseList( fr, parent, doc, linksToParse, workingPath, fileName );
+			parseList( fr, parent, doc, linksToParse, workingPath, fileName, state );
 			break;
 
 		default :
@@ -220,25 +1399,104 @@ Parser::parseFragment( QStringList & fr, QSharedPointer< Block > parent,
 	}
 }
 
+namespace /* anonymous */ {
+
+//! Decode content of the file.
+QString
+decode( const QByteArray & data, QTextCodec * codec )
+{
+	// Unicode BOM is detected like QTextStream does.
+	codec = QTextCodec::codecForUtfText( data, codec );
+
+	static const int c_utf8Mib = 106;
+
+	// QString::fromUtf8() has vectorized fast path for ASCII.
+	QString text = ( codec->mibEnum() == c_utf8Mib ? QString::fromUtf8( data ) :
+		codec->toUnicode( data ) );
+
+	if( text.startsWith( QChar( 0xFEFF ) ) )
+		text.remove( 0, 1 );
+
+	if( text.contains( QChar() ) )
+		text.remove( QChar() );
+
+	return text;
+}
+
+} /* namespace anonymous */
+
+bool
+Parser::FileStream::load( const QString & fileName, QTextCodec * codec )
+{
+	QFile f( fileName );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	const auto size = f.size();
+
+	uchar * mapped = ( size > 0 ? f.map( 0, size ) : nullptr );
+
+	if( mapped )
+	{
+		m_text = decode( QByteArray::fromRawData( reinterpret_cast< const char* > ( mapped ),
+			static_cast< int > ( size ) ), codec );
+
+		f.unmap( mapped );
+	}
+	else
+		m_text = decode( f.readAll(), codec );
+
+	f.close();
+
+	m_lines.clear();
+	m_pos = 0;
+
+	const QChar * data = m_text.constData();
+	const int length = m_text.length();
+	int start = 0;
+
+	// Lines are ended with "\r\n", "\n" or "\r".
+	for( int i = 0; i < length; ++i )
+	{
+		const auto c = data[ i ].unicode();
+
+		if( c == '\n' || c == '\r' )
+		{
+			m_lines.append( qMakePair( start, i - start ) );
+
+			if( c == '\r' && i + 1 < length && data[ i + 1 ].unicode() == '\n' )
+				++i;
+
+			start = i + 1;
+		}
+	}
+
+	if( start < length )
+		m_lines.append( qMakePair( start, length - start ) );
+
+	return true;
+}
+
 void
 Parser::clearCache()
 {
 	m_parsedFiles.clear();
+	m_finishedFiles.clear();
+	m_fragments.clear();
+	m_inlineJobs.clear();
+	m_targets.clear();
 }
 
 void
-Parser::parseText( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseText( Lines & fr, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
+	const QString & workingPath, const QString & fileName, ParseState & state )
 {
-	static const QRegExp fnr( QLatin1String( "\\s*\\[\\^[^\\s]*\\]:.*" ) );
-	static const QRegExp thr( QLatin1String( "\\s*\\|\\s*" ) );
-	static const QRegExp tcr( QLatin1String(
-		"^\\s*\\|?(\\s*:?-{3,}:?\\s*\\|)*\\s*:?-{3,}:?\\s*\\|?\\s*$" ) );
-
-	if( fnr.exactMatch( fr.first() ) )
-		parseFootnote( fr, parent, doc, linksToParse, workingPath, fileName );
-	else if( thr.indexIn( fr.first() ) > -1 && fr.size() > 1 && tcr.exactMatch( fr.at( 1 ) ) )
+	if( isFootnote( fr.first() ) )
+		parseFootnote( fr, parent, doc, linksToParse, workingPath, fileName, state );
+	else if( fr.first().contains( QLatin1Char( '|' ) ) && fr.size() > 1 &&
+		isTableDelimiter( fr.at( 1 ) ) )
 		parseTable( fr, parent, doc, linksToParse, workingPath, fileName );
 	else
 		parseParagraph( fr, parent, doc, linksToParse, workingPath, fileName );
@@ -250,42 +1508,88 @@ namespace /* anonymous */ {
 int
 skipSpaces( int i, const QString & line )
 {
-	const int length = line.length();
+	return skipSpaceChars( line.constData(), i, line.length() );
+}; // skipSpaces
 
-	while( i < length && line[ i ].isSpace() )
-		++i;
+//! \return Is the text the same as simplified one.
+bool
+isSimplified( const QChar * data, int length )
+{
+	if( length == 0 )
+		return true;
 
-	return i;
-}; // skipSpaces
+	if( isSpaceChar( data[ 0 ] ) || isSpaceChar( data[ length - 1 ] ) )
+		return false;
+
+	for( int i = 1; i < length - 1; ++i )
+	{
+		if( isSpaceChar( data[ i ] ) &&
+			( data[ i ] != QLatin1Char( ' ' ) || isSpaceChar( data[ i + 1 ] ) ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
 
 // Read text of the link. I.e. in [...]
-QString readLinkText( int & i, const QString & line )
+QString readLinkText( int & i, const QStringRef & line )
 {
 	const int length = line.length();
-	QString t;
+	const int start = i;
 
-	while( i < length )
+	// Escaped character is skipped with the backslash, so the line is scanned only once.
+	while( i < length && line.at( i ) != QLatin1Char( ']' ) )
 	{
-		if( line[ i ] != QLatin1Char( ']' ) && line[ i - 1 ] != QLatin1Char( '\\' ) )
-			t.append( line[ i ] );
-		else
-			break;
+		if( line.at( i ) == QLatin1Char( '\\' ) )
+			++i;
 
 		++i;
 	}
 
-	++i;
+	if( i < length )
+	{
+		++i;
 
-	if( i - 1 < length && line[ i - 1 ] == QLatin1Char( ']' ) )
-		return t;
+		return line.mid( start, i - 1 - start ).toString();
+	}
 	else
+	{
+		i = length + 1;
+
 		return QString();
+	}
+}; // readLinkText
+
+QString readLinkText( int & i, const QString & line )
+{
+	return readLinkText( i, QStringRef( &line ) );
 }; // readLinkText
 
+//! \return Text of the heading made of text items of the paragraph.
+QString
+headingText( const Block & p )
+{
+	QString text;
+
+	for( auto it = p.items().cbegin(), last = p.items().cend(); it != last; ++it )
+	{
+		if( (*it)->type() == ItemType::Text )
+		{
+			auto t = static_cast< Text* > ( it->data() );
+
+			text.append( t->text() + QLatin1Char( ' ' ) );
+		}
+	}
+
+	return text.simplified();
+}
+
 } /* namespace anonymous */
 
 void
-Parser::parseHeading( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseHeading( Lines & fr, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
 	const QString & workingPath, const QString & fileName )
 {
@@ -293,7 +1597,7 @@ Parser::parseHeading( QStringList & fr, QSharedPointer< Block > parent,
 	{
 		auto line = fr.first();
 		int pos = 0;
-		pos = skipSpaces( pos, line );
+		pos = skipSpaceChars( line.unicode(), pos, line.length() );
 
 		if( pos > 0 )
 			line = line.mid( pos );
@@ -301,27 +1605,27 @@ Parser::parseHeading( QStringList & fr, QSharedPointer< Block > parent,
 		pos = 0;
 		int lvl = 0;
 
-		while( pos < line.length() && line[ pos ] == QLatin1Char( '#' ) )
+		while( pos < line.length() && line.at( pos ) == QLatin1Char( '#' ) )
 		{
 			++lvl;
 			++pos;
 		}
 
-		pos = skipSpaces( pos, line );
+		pos = skipSpaceChars( line.unicode(), pos, line.length() );
 
-		fr.first() = line.mid( pos );
+		QString content = lineString( *doc, line.mid( pos ) );
 
-		static const QRegExp labelRegExp( QLatin1String( "(\\{#.*\\})" ) );
+		static thread_local const QRegExp labelRegExp( QLatin1String( "(\\{#.*\\})" ) );
 
 		QString label;
 
-		pos = labelRegExp.indexIn( fr.first() );
+		pos = labelRegExp.indexIn( content );
 
 		if( pos > -1 )
 		{
-			label = fr.first().mid( pos, labelRegExp.matchedLength() );
+			label = content.mid( pos, labelRegExp.matchedLength() );
 
-			fr.first().remove( pos, labelRegExp.matchedLength() );
+			content.remove( pos, labelRegExp.matchedLength() );
 		}
 
 		QSharedPointer< Heading > h( new Heading() );
@@ -334,216 +1638,548 @@ Parser::parseHeading( QStringList & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Paragraph > p( new Paragraph() );
 
 		QStringList tmp;
-		tmp << fr.first();
+		tmp << content;
+
+		fr.removeFirst();
+
+		// Text of the heading is taken later, when inline content is parsed.
+		if( isInlinesDeferred( doc ) )
+		{
+			parent->appendItem( h );
+
+			InlineJob job;
+			job.m_lines = tmp;
+			job.m_target = p;
+			job.m_item = h;
+			job.m_heading = h;
+
+			deferInlines( job, parent, doc, linksToParse, workingPath, fileName );
+
+			return;
+		}
 
 		parseFormattedTextLinksImages( tmp, p, doc, linksToParse, workingPath, fileName );
 
+		h->setText( headingText( *p ) );
+
+		if( !h->text().isEmpty() )
+		{
+			if( h->isLabeled() )
+				doc->insertLabeledHeading( h->label(), h );
+
+			parent->appendItem( h );
+		}
+	}
+}
+
+void
+Parser::parseFootnote( Lines & fr, QSharedPointer< Block >,
+	QSharedPointer< Document > doc, QStringList & linksToParse,
+	const QString & workingPath, const QString & fileName, ParseState & state )
+{
+	if( !fr.isEmpty() )
+	{
+		QSharedPointer< Footnote > f( new Footnote() );
+
+		Line line = fr.first();
 		fr.removeFirst();
 
-		if( !p->isEmpty() )
-		{
-			QString text;
+		int pos = skipSpaceChars( line.unicode(), 0, line.length() );
+
+		if( pos > 0 )
+			line = line.mid( pos );
+
+		if( line.startsWith( QLatin1String( "[^" ) ) )
+		{
+			pos = 2;
+
+			QString id = readLinkText( pos, line );
+
+			if( !id.isEmpty() && line.at( pos ) == QLatin1Char( ':' ) )
+			{
+				++pos;
+
+				for( auto it = fr.begin(), last = fr.end(); it != last; ++it )
+				{
+					if( it->startsWith( QLatin1String( "    " ) ) )
+						*it = stripPrefix( *it, 4 );
+					else if( it->startsWith( QLatin1Char( '\t' ) ) )
+						*it = stripPrefix( *it, 1 );
+				}
+
+				fr.prepend( line.mid( pos ) );
+
+				state.m_containers.append( { f, nullptr } );
+				state.m_footnotes.append( qMakePair( QString::fromLatin1( "#" ) + id +
+					QDir::separator() + workingPath + fileName, f ) );
+				state.addJob( fr, f );
+			}
+		}
+	}
+}
+
+void
+Parser::parseTable( Lines & fr, QSharedPointer< Block > parent,
+	QSharedPointer< Document > doc, QStringList & linksToParse,
+	const QString & workingPath, const QString & fileName )
+{
+	static const QChar sep( '|' );
+
+	if( fr.size() >= 2 )
+	{
+		QSharedPointer< Table > table( new Table() );
+		const bool deferred = isInlinesDeferred( doc );
+
+		auto parseTableRow = [&] ( const Line & row )
+		{
+			auto line = lineString( *doc, row ).simplified();
+
+			if( line.startsWith( sep ) )
+				line.remove( 0, 1 );
+
+			if( line.endsWith( sep ) )
+				line.remove( line.length() - 1, 1 );
+
+			// Cells beyond count of columns are not drawn, so they are not even split,
+			// one huge line can't make a lot of cells.
+			QStringList columns;
+
+			for( int start = 0; columns.size() < table->columnsCount(); )
+			{
+				const int end = line.indexOf( sep, start );
+
+				columns.append( line.mid( start, end > -1 ? end - start : -1 ) );
+
+				if( end == -1 )
+					break;
+
+				start = end + 1;
+			}
+
+			QSharedPointer< TableRow > tr( new TableRow() );
+
+			for( auto it = columns.begin(), last = columns.end(); it != last; ++it )
+			{
+				QSharedPointer< TableCell > c( new TableCell() );
+
+				if( !it->isEmpty() )
+				{
+					it->replace( QLatin1String( "&#124;" ), sep );
+
+					QStringList fragment;
+					fragment.append( *it );
+
+					if( deferred )
+					{
+						InlineJob job;
+						job.m_lines = fragment;
+						job.m_target = c;
+						job.m_item = table;
+
+						deferInlines( job, parent, doc, linksToParse, workingPath,
+							fileName );
+					}
+					else
+						parseFormattedTextLinksImages( fragment, c, doc,
+							linksToParse, workingPath, fileName );
+				}
+
+				tr->appendCell( c );
+			}
+
+			if( !tr->isEmpty() )
+				table->appendRow( tr );
+		};
+
+		{
+			auto fmt = lineString( *doc, fr.at( 1 ) );
+
+			auto columns = fmt.split( sep, QString::SkipEmptyParts );
+
+			for( auto it = columns.begin(), last = columns.end(); it != last; ++it )
+			{
+				*it = it->simplified();
+
+				if( !it->isEmpty() )
+				{
+					Table::Alignment a = Table::AlignLeft;
+
+					if( it->endsWith( QLatin1Char( ':' ) ) && it->startsWith( QLatin1Char( ':' ) ) )
+						a = Table::AlignCenter;
+					else if( it->endsWith( QLatin1Char( ':' ) ) )
+						a = Table::AlignRight;
+
+					table->setColumnAlignment( table->columnsCount(), a );
+				}
+			}
+		}
+
+		fr.removeAt( 1 );
+
+		for( const auto & line : qAsConst( fr ) )
+			parseTableRow( line );
+
+		if( !table->isEmpty() )
+			parent->appendItem( table );
+	}
+}
+
+void
+Parser::parseParagraph( Lines & fr, QSharedPointer< Block > parent,
+	QSharedPointer< Document > doc, QStringList & linksToParse,
+	const QString & workingPath, const QString & fileName )
+{
+	// Check for alternative syntax of H1 and H2 headings. Headings are taken in a loop,
+	// so a lot of them in one paragraph doesn't go deep into the stack.
+	int first = 0;
+
+	while( fr.size() - first >= 2 )
+	{
+		QString label;
+
+		if( isSetextUnderline( fr.at( first + 1 ), QLatin1Char( '=' ) ) )
+			label = QLatin1String( "# " );
+		else if( isSetextUnderline( fr.at( first + 1 ), QLatin1Char( '-' ) ) )
+			label = QLatin1String( "## " );
+		else
+			break;
+
+		const QString heading = label + lineString( *doc, fr.at( first ) );
+
+		Lines tmp;
+		tmp.append( Line( &heading ) );
+
+		parseHeading( tmp, parent, doc, linksToParse, workingPath, fileName );
+
+		first += 2;
+	}
+
+	if( first > 0 )
+		fr.remove( 0, first );
+
+	if( fr.isEmpty() )
+		return;
+
+	QSharedPointer< Paragraph > p( new Paragraph() );
+
+	// Inline content is parsed later, all at once.
+	if( isInlinesDeferred( doc ) )
+	{
+		parent->appendItem( p );
+
+		InlineJob job;
+		job.m_lines = lineStrings( *doc, fr );
+		job.m_target = p;
+		job.m_item = p;
+
+		deferInlines( job, parent, doc, linksToParse, workingPath, fileName );
+
+		return;
+	}
+
+	QStringList lines = lineStrings( *doc, fr );
+
+	parseFormattedTextLinksImages( lines, p, doc, linksToParse, workingPath, fileName );
+
+	if( !p->isEmpty() )
+		parent->appendItem( p );
+}
+
+namespace /* anonymous */ {
+
+//! Set span to values of the map that don't have it.
+template< typename MAP >
+void
+setMissingSpans( const MAP & map, const SourceSpan & span,
+	QVector< QSharedPointer< Item > > & opened )
+{
+	for( auto it = map.cbegin(), last = map.cend(); it != last; ++it )
+	{
+		if( !it.value()->sourceSpan().isValid() )
+		{
+			it.value()->setSourceSpan( span );
+			opened.append( it.value() );
+		}
+	}
+}
+
+} /* namespace anonymous */
 
-			for( auto it = p->items().cbegin(), last = p->items().cend(); it != last; ++it )
-			{
-				if( (*it)->type() == ItemType::Text )
-				{
-					auto t = static_cast< Text* > ( it->data() );
+void
+Parser::setSourceSpans( Document & doc, int firstItem, int definitions,
+	const SourceSpan & span, QVector< QSharedPointer< Item > > & opened )
+{
+	for( int i = firstItem; i < doc.items().size(); ++i )
+	{
+		doc.items().at( i )->setSourceSpan( span );
+		opened.append( doc.items().at( i ) );
+	}
 
-					text.append( t->text() + QLatin1Char( ' ' ) );
-				}
-			}
+	if( definitionsCount( doc ) != definitions )
+	{
+		setMissingSpans( doc.footnotesMap(), span, opened );
+		setMissingSpans( doc.labeledLinks(), span, opened );
+		setMissingSpans( doc.labeledHeadings(), span, opened );
+	}
+}
 
-			text = text.simplified();
+void
+Parser::closeSourceSpans( QVector< QSharedPointer< Item > > & opened, int endLine )
+{
+	for( const auto & item : qAsConst( opened ) )
+	{
+		auto span = item->sourceSpan();
+		span.m_endLine = endLine;
+		item->setSourceSpan( span );
+	}
 
-			if( !text.isEmpty() )
-			{
-				h->setText( text );
+	opened.clear();
+}
 
-				if( h->isLabeled() )
-					doc->insertLabeledHeading( h->label(), h );
+int
+Parser::definitionsCount( const Document & doc )
+{
+	return doc.footnotesMap().size() + doc.labeledLinks().size() +
+		doc.labeledHeadings().size();
+}
 
-				parent->appendItem( h );
-			}
-		}
-	}
+bool
+Parser::isInlinesDeferred( QSharedPointer< Document > doc ) const
+{
+	// Items of the streamed file are handed over as soon as they are parsed.
+	return ( doc.data() != m_streamedDoc );
 }
 
 void
-Parser::parseFootnote( QStringList & fr, QSharedPointer< Block >,
+Parser::deferInlines( InlineJob & job, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
 	const QString & workingPath, const QString & fileName )
 {
-	if( !fr.isEmpty() )
+	job.m_parent = parent.data();
+	job.m_workingPath = workingPath;
+	job.m_fileName = fileName;
+	job.m_linksPos = linksToParse.size();
+
+	// Nested content takes span of its fragment when nested blocks are parsed.
+	if( parent == doc )
+		job.m_spanItem = job.m_item;
+
+	QMutexLocker lock( &m_mutex );
+
+	m_inlineJobs[ doc.data() ].m_jobs.append( job );
+}
+
+void
+Parser::parseInlines( QSharedPointer< Document > doc, QStringList & linksToParse )
+{
+	QVector< InlineJob > jobs;
+	QHash< const Block*, InlineContainer > containers;
+
 	{
-		QSharedPointer< Footnote > f( new Footnote() );
+		QMutexLocker lock( &m_mutex );
 
-		QString line = fr.first();
-		fr.removeFirst();
+		auto inlines = m_inlineJobs.take( doc.data() );
 
-		int pos = skipSpaces( 0, line );
+		jobs.swap( inlines.m_jobs );
+		containers.swap( inlines.m_containers );
+	}
 
-		if( pos > 0 )
-			line = line.mid( pos );
+	if( jobs.isEmpty() )
+		return;
+
+	//! State shared with helper threads, it may outlive this call if a helper
+	//! starts late, such helper does nothing.
+	struct State {
+		QMutex m_mutex;
+		QWaitCondition m_finished;
+		int m_active = 0;
+		bool m_closed = false;
+		QAtomicInt m_next;
+		std::function< void() > m_work;
+	}; // struct State
+
+	InlineJob * data = jobs.data();
+	const int count = jobs.size();
+	QSharedPointer< State > state( new State );
+
+	// Labeled links go to separate documents, and linked files to separate
+	// lists, so jobs don't share anything.
+	state->m_work = [&]()
+	{
+		int i = 0;
 
-		if( line.startsWith( QLatin1String( "[^" ) ) )
+		while( ( i = state->m_next.fetchAndAddRelaxed( 1 ) ) < count )
 		{
-			pos = 2;
+			auto & job = data[ i ];
 
-			QString id = readLinkText( pos, line );
+			job.m_labels.reset( new Document );
 
-			if( !id.isEmpty() && line[ pos ] == QLatin1Char( ':' ) )
-			{
-				++pos;
+			for( const auto & src : doc->sources() )
+				job.m_labels->addSource( src );
 
-				line = line.mid( pos );
+			parseFormattedTextLinksImages( job.m_lines, job.m_target, job.m_labels,
+				job.m_links, job.m_workingPath, job.m_fileName );
+		}
+	};
 
-				for( auto it = fr.begin(), last = fr.end(); it != last; ++it )
+	static const int c_minJobsForThreads = 32;
+
+	// Helpers run on the pool of the parsing, so they are counted in its limit.
+	const int helpers = ( m_pool && count >= c_minJobsForThreads ?
+		qMin( m_pool->maxThreadCount() + 1, count ) - 1 : 0 );
+
+	for( int i = 0; i < helpers; ++i )
+	{
+		m_pool->start( new ParseTask( [state] ()
+			{
 				{
-					if( it->startsWith( QLatin1String( "    " ) ) )
-						*it = it->mid( 4 );
-					else if( it->startsWith( QLatin1Char( '\t' ) ) )
-						*it = it->mid( 1 );
+					QMutexLocker lock( &state->m_mutex );
+
+					if( state->m_closed )
+						return;
+
+					++state->m_active;
 				}
 
-				fr.prepend( line );
+				state->m_work();
 
-				StringListStream stream( fr );
+				QMutexLocker lock( &state->m_mutex );
 
-				parse( stream, f, doc, linksToParse, workingPath, fileName, false );
+				--state->m_active;
 
-				if( !f->isEmpty() )
-					doc->insertFootnote( QString::fromLatin1( "#" ) + id +
-						QDir::separator() + workingPath + fileName, f );
-			}
-		}
+				state->m_finished.wakeAll();
+			} ) );
 	}
-}
 
-void
-Parser::parseTable( QStringList & fr, QSharedPointer< Block > parent,
-	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
-{
-	static const QChar sep( '|' );
+	// This thread works too, and doesn't wait for helpers that didn't start.
+	state->m_work();
 
-	if( fr.size() >= 2 )
 	{
-		QSharedPointer< Table > table( new Table() );
+		QMutexLocker lock( &state->m_mutex );
 
-		auto parseTableRow = [&] ( const QString & row )
-		{
-			auto line = row.simplified();
+		state->m_closed = true;
 
-			if( line.startsWith( sep ) )
-				line.remove( 0, 1 );
+		while( state->m_active > 0 )
+			state->m_finished.wait( &state->m_mutex );
+	}
 
-			if( line.endsWith( sep ) )
-				line.remove( line.length() - 1, 1 );
+	// Join results in the order of the document.
+	for( int i = count - 1; i >= 0; --i )
+	{
+		int pos = data[ i ].m_linksPos;
 
-			auto columns = line.split( sep );
+		for( const auto & l : qAsConst( data[ i ].m_links ) )
+			linksToParse.insert( pos++, l );
+	}
 
-			QSharedPointer< TableRow > tr( new TableRow() );
+	// Items that end up empty are removed, and so are containers left empty by them.
+	QSet< const Item* > removed;
+	QHash< Block*, int > removedCount;
+	QVector< InlineContainer > removedFootnotes;
 
-			for( auto it = columns.begin(), last = columns.end(); it != last; ++it )
-			{
-				QSharedPointer< TableCell > c( new TableCell() );
+	auto remove = [&] ( const Item * item, Block * parent )
+	{
+		while( true )
+		{
+			removed.insert( item );
 
-				if( !it->isEmpty() )
-				{
-					it->replace( QLatin1String( "&#124;" ), sep );
+			if( ++removedCount[ parent ] < parent->items().size() )
+				break;
 
-					QStringList fragment;
-					fragment.append( *it );
+			const auto it = containers.constFind( parent );
 
-					parseFormattedTextLinksImages( fragment, c, doc,
-						linksToParse, workingPath, fileName );
-				}
+			if( it == containers.cend() )
+				break;
 
-				tr->appendCell( c );
+			if( !it->m_parent )
+			{
+				removed.insert( parent );
+				removedFootnotes.append( *it );
+
+				break;
 			}
 
-			if( !tr->isEmpty() )
-				table->appendRow( tr );
-		};
+			item = parent;
+			parent = it->m_parent;
+		}
+	};
+
+	for( int i = 0; i < count; ++i )
+	{
+		auto & job = data[ i ];
+		const auto span = job.m_spanItem->sourceSpan();
+		const auto & labels = job.m_labels->labeledLinks();
 
+		for( auto it = labels.cbegin(), last = labels.cend(); it != last; ++it )
 		{
-			auto fmt = fr.at( 1 );
+			// Definition takes lines of its block.
+			it.value()->setSourceSpan( span );
 
-			auto columns = fmt.split( sep, QString::SkipEmptyParts );
+			doc->insertLabeledLink( it.key(), it.value() );
+		}
 
-			for( auto it = columns.begin(), last = columns.end(); it != last; ++it )
-			{
-				*it = it->simplified();
+		bool empty = job.m_target->isEmpty();
 
-				if( !it->isEmpty() )
-				{
-					Table::Alignment a = Table::AlignLeft;
+		if( job.m_heading )
+		{
+			job.m_heading->setText( headingText( *job.m_target ) );
 
-					if( it->endsWith( QLatin1Char( ':' ) ) && it->startsWith( QLatin1Char( ':' ) ) )
-						a = Table::AlignCenter;
-					else if( it->endsWith( QLatin1Char( ':' ) ) )
-						a = Table::AlignRight;
+			empty = job.m_heading->text().isEmpty();
 
-					table->setColumnAlignment( table->columnsCount(), a );
-				}
+			if( !empty && job.m_heading->isLabeled() )
+			{
+				if( !job.m_heading->sourceSpan().isValid() )
+					job.m_heading->setSourceSpan( span );
+
+				doc->insertLabeledHeading( job.m_heading->label(), job.m_heading );
 			}
 		}
 
-		fr.removeAt( 1 );
-
-		for( const auto & line : qAsConst( fr ) )
-			parseTableRow( line );
-
-		if( !table->isEmpty() )
-			parent->appendItem( table );
+		if( empty && job.m_item->type() != ItemType::Table )
+			remove( job.m_item.data(), job.m_parent );
 	}
-}
 
-void
-Parser::parseParagraph( QStringList & fr, QSharedPointer< Block > parent,
-	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
-{
-	static const QRegExp h1r( QLatin1String( "^\\s*===*\\s*$" ) );
-	static const QRegExp h2r( QLatin1String( "^\\s*---*\\s*$" ) );
-
-	auto ph = [&]( const QString & label )
+	// Blocks that are removed themselves are not rebuilt, as their children may
+	// be already freed.
+	for( auto it = removedCount.cbegin(), last = removedCount.cend(); it != last; ++it )
 	{
-		QStringList tmp = fr.mid( 0, 1 );
-		tmp.first().prepend( label );
-
-		parseHeading( tmp, parent, doc, linksToParse, workingPath, fileName );
+		if( removed.contains( it.key() ) )
+			continue;
 
-		for( int idx = 0; idx < 2; ++idx )
-			fr.removeFirst();
+		Block::Items items;
+		items.reserve( it.key()->items().size() - it.value() );
 
-		parseParagraph( fr, parent, doc, linksToParse, workingPath, fileName );
-	};
-	\
-	// Check for alternative syntax of H1 and H2 headings.
-	if( fr.size() >= 2 )
-	{
-		if( h1r.exactMatch( fr.at( 1 ) ) )
+		for( const auto & item : it.key()->items() )
 		{
-			ph( QLatin1String( "# " ) );
-
-			return;
+			if( !removed.contains( item.data() ) )
+				items.append( item );
 		}
-		else if( h2r.exactMatch( fr.at( 1 ) ) )
-		{
-			ph( QLatin1String( "## " ) );
 
-			return;
-		}
+		it.key()->setItems( items );
 	}
 
-	QSharedPointer< Paragraph > p( new Paragraph() );
+	// Footnote that ends up empty doesn't replace one with the same ID.
+	for( const auto & f : qAsConst( removedFootnotes ) )
+	{
+		if( doc->footnotesMap().value( f.m_footnote ) != f.m_block )
+			continue;
 
-	parseFormattedTextLinksImages( fr, p, doc, linksToParse, workingPath, fileName );
+		auto replaced = f.m_replaced;
 
-	if( !p->isEmpty() )
-		parent->appendItem( p );
+		while( replaced && removed.contains( replaced.data() ) )
+			replaced = containers.value( replaced.data() ).m_replaced;
+
+		if( replaced )
+		{
+			// Footnote replaced in the same fragment didn't get a span.
+			if( !replaced->sourceSpan().isValid() )
+				replaced->setSourceSpan( f.m_block->sourceSpan() );
+
+			doc->insertFootnote( f.m_footnote, replaced );
+		}
+		else
+			doc->removeFootnote( f.m_footnote );
+	}
 }
 
 void
@@ -552,8 +2188,6 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 	const QString & fileName )
 
 {
-	static const QString specialChars( QLatin1String( "\\`*_{}[]()#+-.!|~<>" ) );
-
 	enum class Lex {
 		Bold,
 		Italic,
@@ -594,17 +2228,16 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 
 		if( i < length )
 		{
-			QString lnk;
+			const int start = i;
 
-			while( i < length && !line[ i ].isSpace() &&
+			while( i < length && !isSpaceChar( line[ i ] ) &&
 				( line[ i ] != QLatin1Char( ')' ) && line[ i - 1 ] != QLatin1Char( '\\' ) )
 				&& line[ i ] != QLatin1Char( ']' ) )
 			{
-				lnk.append( line[ i ] );
 				++i;
 			}
 
-			return lnk;
+			return sourceSlice( *doc, line, start, i - start );
 		}
 		else
 			return QString();
@@ -642,11 +2275,7 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				if( i < length )
 				{
 					if( line[ i ] == QLatin1Char( ')' ) )
-					{
-						++i;
-
 						return true;
-					}
 				}
 				else
 					return false;
@@ -697,7 +2326,8 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 						if( !QUrl( lnk ).isRelative() )
 							img->setUrl( lnk );
 						else
-							img->setUrl( fileExists( lnk, workingPath ) ? workingPath + lnk : lnk );
+							img->setUrl( fileExists( lnk, workingPath, fileName ) ?
+								workingPath + lnk : lnk );
 
 						data.img.append( img );
 
@@ -818,7 +2448,7 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				{
 					if( QUrl( url ).isRelative() )
 					{
-						if( fileExists( url, workingPath ) )
+						if( fileExists( url, workingPath, fileName ) )
 						{
 							url = QFileInfo( workingPath + url ).absoluteFilePath();
 
@@ -858,7 +2488,7 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 							{
 								if( QUrl( url ).isRelative() )
 								{
-									if( fileExists( url, workingPath ) )
+									if( fileExists( url, workingPath, fileName ) )
 									{
 										url = QFileInfo( workingPath + url ).absoluteFilePath();
 
@@ -898,8 +2528,6 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 							QDir::separator() + workingPath + fileName;
 
 						linksToParse.append( url );
-
-						++i;
 					}
 					else
 					{
@@ -985,37 +2613,38 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 			}
 		}
 
-		QString code;
+		const int start = i;
+		int end = length;
 		bool finished = false;
 
-		while( i < length )
+		while( ( i = line.indexOf( QLatin1Char( '`' ), i ) ) != -1 )
 		{
-			if( line[ i ] == QLatin1Char( '`' ) )
+			if( !quoted )
 			{
-				if( !quoted )
-				{
-					finished = true;
+				finished = true;
+				end = i;
 
-					++i;
+				++i;
 
-					break;
-				}
-				else if( i + 1 < length && line[ i + 1 ] == QLatin1Char( '`' ) )
-				{
-					finished = true;
+				break;
+			}
+			else if( i + 1 < length && line[ i + 1 ] == QLatin1Char( '`' ) )
+			{
+				finished = true;
+				end = i;
 
-					i += 2;
+				i += 2;
 
-					break;
-				}
+				break;
 			}
 
-			code.append( line[ i ] );
-
 			++i;
 		}
 
-		createTextObj( code );
+		if( !finished )
+			i = length;
+
+		createTextObj( sourceSlice( *doc, line, start, end - start ) );
 
 		if( finished )
 			data.lexems.append( quoted ? Lex::StartOfQuotedCode : Lex::StartOfCode );
@@ -1035,27 +2664,15 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 
 		const int length = line.length();
 
-		bool done = false;
-		QString url;
-
-		while( i < length )
-		{
-			if( line[ i ] != QLatin1Char( '>' ) )
-				url.append( line[ i ] );
-			else
-			{
-				done = true;
-				++i;
-				break;
-			}
+		const int end = line.indexOf( QLatin1Char( '>' ), i );
+		const bool done = ( end != -1 );
 
-			++i;
-		}
+		i = ( done ? end + 1 : length );
 
 		if( done )
 		{
 			QSharedPointer< Link > lnk( new Link() );
-			lnk->setUrl( url.simplified() );
+			lnk->setUrl( line.mid( start + 1, end - start - 1 ).simplified() );
 			data.lnk.append( lnk );
 			data.lexems.append( Lex::Link );
 		}
@@ -1080,34 +2697,94 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				return prev;
 		}
 
-		static const QRegExp nonSpace( QLatin1String( "[^\\s]" ) );
-
-		const int ns = nonSpace.indexIn( line );
-
-		if( ns > 0 )
-			line = line.right( line.length() - ns );
+		const int ns = skipSpaceChars( line.constData(), 0, line.length() );
 
-		static const QRegExp horRule( QLatin1String( "^(\\*{3,}|\\-{3,}|_{3,})$" ) );
+		if( ns > 0 && ns < line.length() )
+			line = sourceSlice( *doc, line, ns, line.length() - ns );
 
 		// Will skip horizontal rules, for now at least...
-		if( !horRule.exactMatch( line ) )
+		if( !isHorizontalRule( line ) )
 		{
 			QString text;
+			const QChar * chars = line.constData();
+
+			// Plain text that is not copied yet. It's taken as is if it's not mixed
+			// with escaped characters and doesn't need to be simplified.
+			int viewStart = -1;
+			int viewEnd = -1;
+
+			auto flushView = [&]()
+			{
+				if( viewStart > -1 )
+				{
+					text.append( chars + viewStart, viewEnd - viewStart );
+
+					viewStart = -1;
+				}
+			}; // flushView
+
+			auto appendPlain = [&]( int from, int to )
+			{
+				if( text.isEmpty() && viewStart < 0 )
+				{
+					viewStart = from;
+					viewEnd = to;
+				}
+				else if( viewStart > -1 && viewEnd == from )
+					viewEnd = to;
+				else
+				{
+					flushView();
+
+					text.append( chars + from, to - from );
+				}
+			}; // appendPlain
+
+			auto takeText = [&]() -> QString
+			{
+				if( viewStart > -1 )
+				{
+					const int start = viewStart;
+					const int length = viewEnd - viewStart;
+
+					viewStart = -1;
+
+					if( isSimplified( chars + start, length ) )
+						return sourceSlice( *doc, line, start, length );
+					else
+						return QString( chars + start, length ).simplified();
+				}
+
+				const auto res = text.simplified();
+
+				text.clear();
+
+				return res;
+			}; // takeText
 
 			for( int i = pos, length = line.length(); i < length; ++i )
 			{
-				if( line[ i ] == QLatin1Char( '\\' ) && i + 1 < length &&
-					specialChars.contains( line[ i + 1 ] ) )
+				if( !isSpecialChar( chars[ i ] ) )
+				{
+					// Plain text goes at once till the next special character.
+					const int next = nextSpecialChar( chars, i + 1, length );
+
+					appendPlain( i, next );
+
+					i = next - 1;
+				}
+				else if( line[ i ] == QLatin1Char( '\\' ) && i + 1 < length &&
+					isSpecialChar( line[ i + 1 ] ) )
 				{
 					++i;
 
+					flushView();
 					text.append( line[ i ] );
 				}
 				else if( line[ i ] == QLatin1Char( '!' ) && i + 1 < length &&
 					line[ i + 1 ] == QLatin1Char( '[' ) )
 				{
-					createTextObj( text.simplified() );
-					text.clear();
+					createTextObj( takeText() );
 
 					bool ok = false;
 
@@ -1120,14 +2797,12 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				}
 				else if( line[ i ] == QLatin1Char( '[' ) )
 				{
-					createTextObj( text.simplified() );
-					text.clear();
+					createTextObj( takeText() );
 					i = parseLnk( i, line, text );
 				}
 				else if( line[ i ] == QLatin1Char( '`' ) )
 				{
-					createTextObj( text.simplified() );
-					text.clear();
+					createTextObj( takeText() );
 					i = parseCode( i, line, prev ) - 1;
 
 					if( prev != LineParsingState::Finished )
@@ -1135,61 +2810,55 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				}
 				else if( line[ i ] == QLatin1Char( '<' ) )
 				{
-					createTextObj( text.simplified() );
-					text.clear();
+					createTextObj( takeText() );
 					i = parseUrl( i, line, text ) - 1;
 				}
 				else if( line[ i ] == QLatin1Char( '*' ) || line[ i ] == QLatin1Char( '_' ) )
 				{
-					QString style;
+					const int start = i;
 
 					while( i < length &&
 						( line[ i ] == QLatin1Char( '*' ) || line[ i ] == QLatin1Char( '_' ) ) )
 					{
-						style.append( line[ i ] );
 						++i;
 					}
 
-					if( !style.isEmpty() )
-						--i;
+					const auto style = line.midRef( start, i - start );
+
+					--i;
 
 					if( style == QLatin1String( "*" ) || style == QLatin1String( "_" ) )
 					{
-						createTextObj( text.simplified() );
-						text.clear();
+						createTextObj( takeText() );
 						data.lexems.append( Lex::Italic );
 					}
 					else if( style == QLatin1String( "**" ) || style == QLatin1String( "__" ) )
 					{
-						createTextObj( text.simplified() );
-						text.clear();
+						createTextObj( takeText() );
 						data.lexems.append( Lex::Bold );
 					}
 					else if( style == QLatin1String( "***" ) || style == QLatin1String( "___" ) ||
 						style == QLatin1String( "_**" ) || style == QLatin1String( "**_" ) ||
 						style == QLatin1String( "*__" ) || style == QLatin1String( "__*" ) )
 					{
-						createTextObj( text.simplified() );
-						text.clear();
+						createTextObj( takeText() );
 						data.lexems.append( Lex::BoldAndItalic );
 					}
 					else
-						text.append( style );
+						appendPlain( start, i + 1 );
 				}
 				else if( line[ i ] == QLatin1Char( '~' ) && i + 1 < length &&
 					line[ i + 1 ] == QLatin1Char( '~' ) )
 				{
 					++i;
-					createTextObj( text.simplified() );
-					text.clear();
+					createTextObj( takeText() );
 					data.lexems.append( Lex::Strikethrough );
 				}
 				else
-					text.append( line[ i ] );
+					appendPlain( i, i + 1 );
 			}
 
-			createTextObj( text.simplified() );
-			text.clear();
+			createTextObj( takeText() );
 
 			if( hasBreakLine )
 				data.lexems.append( Lex::BreakLine );
@@ -1284,20 +2953,20 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 				{
 					++it;
 
-					QSharedPointer< Code > c( new Code( QString(), true ) );
+					QString code;
 
 					for( ; it != end; ++it )
 					{
-						c->setText( c->text() + data.txt[ data.processedText ]->text() +
-							QLatin1Char( ' ' ) );
+						code.append( data.txt[ data.processedText ]->text() );
+						code.append( QLatin1Char( ' ' ) );
 
 						++data.processedText;
 					}
 
-					if( c->text().endsWith( QLatin1Char( ' ' ) ) )
-						c->setText( c->text().left( c->text().length() - 1 ) );
+					if( code.endsWith( QLatin1Char( ' ' ) ) )
+						code.chop( 1 );
 
-					parent->appendItem( c );
+					parent->appendItem( QSharedPointer< Code > ( new Code( code, true ) ) );
 				}
 				else
 				{
@@ -1356,49 +3025,48 @@ Parser::parseFormattedTextLinksImages( QStringList & fr, QSharedPointer< Block >
 }
 
 void
-Parser::parseBlockquote( QStringList & fr, QSharedPointer< Block > parent,
-	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
+Parser::parseBlockquote( Lines & fr, QSharedPointer< Block > parent,
+	QSharedPointer< Document >, QStringList &, const QString &, const QString &,
+	ParseState & state )
 {
-	QSharedPointer< Blockquote > bq( new Blockquote() );
-
 	const int indent = fr.first().indexOf( QLatin1Char( '>' ) );
 
-	StringListStream stream( fr );
-
 	if( indent > -1 )
 	{
+		QSharedPointer< Blockquote > bq( new Blockquote() );
+
 		for( auto it = fr.begin(), last = fr.end(); it != last; ++it )
-			*it = it->mid( indent + 1 );
+			*it = stripPrefix( *it, indent + 1 );
 
-		parse( stream, bq, doc, linksToParse, workingPath, fileName );
+		state.addContainer( bq, parent );
+		state.addJob( fr, bq );
 	}
-
-	if( !bq->isEmpty() )
-		parent->appendItem( bq );
 }
 
 void
-Parser::parseList( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseList( Lines & fr, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
+	const QString & workingPath, const QString & fileName, ParseState & state )
 {
 	for( auto it = fr.begin(), last  = fr.end(); it != last; ++it )
-		it->replace( QLatin1Char( '\t' ), QLatin1String( "    " ) );
-
-	static const QRegExp space( QLatin1String( "[^\\s]+" ) );
-	static const QRegExp item( QLatin1String( "^(\\*|\\-|\\+|(\\d+)\\.)\\s" ) );
+	{
+		if( it->contains( QLatin1Char( '\t' ) ) )
+			*it = state.keep( it->toString().replace( QLatin1Char( '\t' ),
+				QLatin1String( "    " ) ) );
+	}
 
-	const int indent = space.indexIn( fr.first() );
+	const int indent = firstNonSpace( fr.first() );
 
 	if( indent > -1 )
 	{
 		QSharedPointer< List > list( new List() );
 
-		QStringList listItem;
+		state.addContainer( list, parent );
+
+		Lines listItem;
 		auto it = fr.begin();
 
-		*it = it->right( it->length() - indent );
+		*it = stripPrefix( *it, indent );
 
 		listItem.append( *it );
 
@@ -1406,16 +3074,15 @@ Parser::parseList( QStringList & fr, QSharedPointer< Block > parent,
 
 		for( auto last = fr.end(); it != last; ++it )
 		{
-			int s = space.indexIn( *it );
+			int s = firstNonSpace( *it );
 			s = ( s > indent ? indent : s );
 
-			*it = it->right( it->length() - s );
-
-			const int i = item.indexIn( *it );
+			*it = stripPrefix( *it, s );
 
-			if( i == 0 )
+			if( listMarkerEnd( *it, 0 ) > -1 )
 			{
-				parseListItem( listItem, list, doc, linksToParse, workingPath, fileName );
+				parseListItem( listItem, list, doc, linksToParse, workingPath, fileName,
+					state );
 				listItem.clear();
 			}
 
@@ -1423,26 +3090,32 @@ Parser::parseList( QStringList & fr, QSharedPointer< Block > parent,
 		}
 
 		if( !listItem.isEmpty() )
-			parseListItem( listItem, list, doc, linksToParse, workingPath, fileName );
-
-		if( !list->isEmpty() )
-			parent->appendItem( list );
+			parseListItem( listItem, list, doc, linksToParse, workingPath, fileName,
+				state );
 	}
 }
 
 void
-Parser::parseListItem( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseListItem( Lines & fr, QSharedPointer< Block > parent,
 	QSharedPointer< Document > doc, QStringList & linksToParse,
-	const QString & workingPath, const QString & fileName )
+	const QString & workingPath, const QString & fileName, ParseState & state )
 {
-	static const QRegExp unorderedRegExp( QLatin1String( "^[\\*|\\-|\\+]\\s+.*" ) );
-	static const QRegExp orderedRegExp( QLatin1String( "^(\\d+)\\.\\s+.*" ) );
-	static const QRegExp itemRegExp( QLatin1String( "^\\s*(\\*|\\-|\\+|(\\d+)\\.)\\s+" ) );
+	// Items nested deeper than this are taken as paragraphs, so a line like
+	// "* * * ... * text" doesn't make a list for each character.
+	static const int c_maxListNesting = 32;
+
+	const int nesting = state.m_listNesting + 1;
+	const bool tooDeep = ( nesting > c_maxListNesting );
 
 	QSharedPointer< ListItem > item( new ListItem() );
 
-	if( unorderedRegExp.exactMatch( fr.first() ) )
+	const auto & first = fr.first();
+
+	if( first.length() > 1 && isSpaceChar( first.at( 1 ) ) &&
+		( first.at( 0 ) == QLatin1Char( '|' ) || isBulletChar( first.at( 0 ) ) ) )
+	{
 		item->setListType( ListItem::Unordered );
+	}
 	else
 		item->setListType( ListItem::Ordered );
 
@@ -1450,45 +3123,52 @@ Parser::parseListItem( QStringList & fr, QSharedPointer< Block > parent,
 
 	if( item->listType() == ListItem::Ordered )
 	{
-		if( orderedRegExp.indexIn( fr.first() ) > -1 )
-			i = orderedRegExp.cap( 1 ).toInt();
+		const int markerEnd = listMarkerEnd( first, 0 );
+
+		if( markerEnd > 1 && isDigitChar( first.at( 0 ) ) )
+			i = first.mid( 0, markerEnd - 1 ).toInt();
 
 		item->setOrderedListPreState( i == 1 ? ListItem::Start : ListItem::Continue );
 	}
 
-	QStringList data;
+	state.addContainer( item, parent );
+
+	// Text of the item and the nested list are parsed one after another
+	// after the current fragment.
+	auto addDataJob = [&] ( const Lines & data )
+		{
+			auto & job = state.addJob( data, item );
+			job.m_skipSpaces = true;
+			job.m_listNesting = nesting;
+		};
+
+	Lines data;
 
 	auto it = fr.begin();
 	++it;
 
 	int pos = 1;
 
-	itemRegExp.indexIn( fr.first() );
-
-	data.append( fr.first().right( fr.first().length() - itemRegExp.matchedLength() ) );
+	data.append( stripPrefix( fr.first(), listItemPrefixLength( fr.first() ) ) );
 
 	for( auto last = fr.end(); it != last; ++it, ++pos )
 	{
-		const int i = itemRegExp.indexIn( *it );
-
-		if( i > -1 )
+		if( !tooDeep && listItemPrefixLength( *it ) > -1 )
 		{
-			StringListStream stream( data );
-
-			parse( stream, item, doc, linksToParse, workingPath, fileName, true );
+			addDataJob( data );
 
 			data.clear();
 
-			QStringList nestedList = fr.mid( pos );
-
-			parseList( nestedList, item, doc, linksToParse, workingPath, fileName );
+			auto & job = state.addJob( fr.mid( pos ), item );
+			job.m_list = true;
+			job.m_listNesting = nesting;
 
 			break;
 		}
 		else
 		{
 			if( it->startsWith( QLatin1String( "    " ) ) )
-				*it = it->right( it->length() - 4 );
+				*it = stripPrefix( *it, 4 );
 
 			data.append( *it );
 		}
@@ -1496,21 +3176,17 @@ Parser::parseListItem( QStringList & fr, QSharedPointer< Block > parent,
 
 	if( !data.isEmpty() )
 	{
-		StringListStream stream( data );
-
-		parse( stream, item, doc, linksToParse, workingPath, fileName, true );
+		if( tooDeep )
+			parseParagraph( data, item, doc, linksToParse, workingPath, fileName );
+		else
+			addDataJob( data );
 	}
-
-	if( !item->isEmpty() )
-		parent->appendItem( item );
 }
 
 void
-Parser::parseCode( QStringList & fr, QSharedPointer< Block > parent, int indent )
+Parser::parseCode( Lines & fr, QSharedPointer< Block > parent, int indent )
 {
-	static const QRegExp nonSpace( QLatin1String( "[^\\s]" ) );
-
-	const int i = nonSpace.indexIn( fr.first() );
+	const int i = firstNonSpace( fr.first() );
 
 	if( i > -1 )
 		indent += i;
@@ -1522,14 +3198,17 @@ Parser::parseCode( QStringList & fr, QSharedPointer< Block > parent, int indent
 }
 
 void
-Parser::parseCodeIndentedBySpaces( QStringList & fr, QSharedPointer< Block > parent,
+Parser::parseCodeIndentedBySpaces( Lines & fr, QSharedPointer< Block > parent,
 	int indent )
 {
 	QString code;
 
 	for( const auto & l : qAsConst( fr ) )
-		code.append( ( indent > 0 ? l.right( l.length() - indent ) + QLatin1Char( '\n' ) :
-			l + QLatin1Char( '\n' ) ) );
+	{
+		// Line shorter than the indent is taken as is.
+		code.append( ( indent > 0 && indent <= l.length() ? l.mid( indent ) : l ) );
+		code.append( QLatin1Char( '\n' ) );
+	}
 
 	if( !code.isEmpty() )
 	{
@@ -1540,9 +3219,20 @@ Parser::parseCodeIndentedBySpaces( QStringList & fr, QSharedPointer< Block > par
 }
 
 bool
-Parser::fileExists( const QString & fileName, const QString & workingPath ) const
+Parser::fileExists( const QString & fileName, const QString & workingPath,
+	const QString & sourceFile )
 {
-	return QFileInfo::exists( workingPath + fileName );
+	const auto path = workingPath + fileName;
+	const bool exists = QFileInfo::exists( path );
+
+	if( !m_cacheDir.isEmpty() )
+	{
+		QMutexLocker lock( &m_mutex );
+
+		m_targets[ workingPath + sourceFile ].insert( path, exists );
+	}
+
+	return exists;
 }
 
 } /* namespace MD */
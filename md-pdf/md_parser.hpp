@@ -25,14 +25,44 @@
 
 // md-pdf include.
 #include "md_doc.hpp"
+#include "md_cache.hpp"
 
 // Qt include.
 #include <QTextStream>
 #include <QTextCodec>
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QPair>
+#include <QLinkedList>
+
+// C++ include.
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QThreadPool;
+QT_END_NAMESPACE
 
 
 namespace MD {
 
+//
+// BlockHandler
+//
+
+//! Receiver of top-level items of the document while it's parsed.
+class BlockHandler {
+public:
+	virtual ~BlockHandler() = default;
+
+	//! Top-level item is complete. Items come in the order of the document
+	//! on the thread that called Parser::parse().
+	virtual void onItem( QSharedPointer< Item > item ) = 0;
+}; // class BlockHandler
+
+
 //
 // Parser
 //
@@ -47,10 +77,70 @@ public:
 	QSharedPointer< Document > parse( const QString & fileName, bool recursive = true,
 		QTextCodec * codec = QTextCodec::codecForName( "UTF-8" ) );
 
+	//! Parse and hand top-level items to \a handler as soon as they are complete,
+	//! the main file while it's read and linked files as soon as they are parsed.
+	//! Items are not kept in the returned document, it has only footnotes,
+	//! labeled links and labeled headings, that are complete when this method
+	//! returns. Items refer to them by labels, so they may be resolved afterwards.
+	QSharedPointer< Document > parse( const QString & fileName, BlockHandler * handler,
+		bool recursive = true,
+		QTextCodec * codec = QTextCodec::codecForName( "UTF-8" ) );
+
+	//! Parse again top-level blocks of \a fileName in \a doc affected by the edit of
+	//! lines from \a firstLine to \a lastLine (counted from 0 in the edited file, empty
+	//! range for removed lines), and replace them in the document. Parsing stops at
+	//! the first unchanged block after the edit. Footnotes, labeled links and labeled
+	//! headings of the file are updated, linked files are not parsed.
+	//! \return false if the file isn't in the document or can't be read.
+	bool reparse( QSharedPointer< Document > doc, const QString & fileName,
+		int firstLine, int lastLine,
+		QTextCodec * codec = QTextCodec::codecForName( "UTF-8" ) );
+
+	//! Keep decoded Markdown in the document and let strings of items refer to it
+	//! instead of copying. Then strings of items, and their copies, are valid only
+	//! while the document is alive.
+	void setSourceViews( bool on = true );
+	bool sourceViews() const;
+
+	//! Keep parsed files in \a dir and reuse them while files are not changed.
+	//! Empty directory, the default, turns the cache off.
+	void setCacheDir( const QString & dir );
+	const QString & cacheDir() const;
+
+	//! Limit count of threads that parse one document, the calling thread included.
+	//! 0, the default, is QThread::idealThreadCount(), 1 parses in the calling thread.
+	void setThreadsCount( int count );
+	int threadsCount() const;
+
 private:
-	void parseFile( const QString & fileName, bool recursive, QSharedPointer< Document > doc,
-		QTextCodec * codec );
+	//! Parse file into fragment, \a streamItems - hand top-level items to the handler
+	//! while parsing.
+	void parseFile( const QString & fileName, QTextCodec * codec, QThreadPool * pool,
+		bool streamItems = false );
+	//! Join parsed file and linked files to the document, waits till they are parsed.
+	//! Linked files that are not parsed on the pool are parsed here.
+	void appendFile( const QString & fileName, bool recursive, QSharedPointer< Document > doc,
+		QSet< QString > & appendedFiles, QTextCodec * codec );
+	//! Append top-level item to the document or hand it to the handler.
+	void appendItem( QSharedPointer< Document > doc, QSharedPointer< Item > item );
+	//! Hand parsed top-level items of the main file to the handler.
+	void flushStreamedItems();
+	//! Parse deferred inline content of the file on a pool of threads, and remove
+	//! paragraphs, headings and containers that end up empty.
+	void parseInlines( QSharedPointer< Document > doc, QStringList & linksToParse );
+	//! Set \a span to top-level items starting from \a firstItem and, if count of
+	//! definitions has changed, to new footnotes, labeled links and labeled headings.
+	//! Negative \a definitions means the count is not known. These items are
+	//! appended to \a opened.
+	static void setSourceSpans( Document & doc, int firstItem, int definitions,
+		const SourceSpan & span, QVector< QSharedPointer< Item > > & opened );
+	//! Set last line of \a opened items and clear them.
+	static void closeSourceSpans( QVector< QSharedPointer< Item > > & opened, int endLine );
+	//! \return Count of footnotes, labeled links and labeled headings.
+	static int definitionsCount( const Document & doc );
 	void clearCache();
+	//! \return Key of the file in the cache of parsed files.
+	static QString fileKey( const QString & fileName );
 
 	enum class BlockType {
 		Unknown,
@@ -62,43 +152,176 @@ private:
 		Heading
 	}; // enum BlockType
 
-	BlockType whatIsTheLine( const QString & str, bool inList = false ) const;
-	void parseFragment( QStringList & fr, QSharedPointer< Block > parent,
+	//! Line of the file. It refers to the decoded text of the file or to the changed
+	//! copy of the line, so prefixes of nested blocks are stripped without copying.
+	typedef QStringRef Line;
+	//! Lines of the fragment.
+	typedef QVector< Line > Lines;
+
+	//! State of grouping of lines into fragments of blocks, see groupLine().
+	struct Grouping {
+		Lines m_fragment;
+		BlockType m_type = BlockType::Unknown;
+		bool m_emptyLineInList = false;
+		//! The fragment is a footnote, indented lines after the empty one go to it.
+		bool m_footnote = false;
+	}; // struct Grouping
+
+	//! Nested block which lines are parsed after the fragment that contains it.
+	struct BlockJob {
+		//! Lines of the block without prefix of the block.
+		Lines m_lines;
+		//! Index of the next line.
+		int m_pos = 0;
+		QSharedPointer< Block > m_block;
+		//! Lines are a list nested in the list item after text of the item.
+		bool m_list = false;
+		//! Lines are shifted left by the indent of the first line (list item).
+		bool m_skipSpaces = false;
+		int m_spaces = 0;
+		//! Count of enclosing list items.
+		int m_listNesting = 0;
+		Grouping m_grouping;
+	}; // struct BlockJob
+
+	//! Container created while parsing the top-level fragment.
+	struct Container {
+		QSharedPointer< Block > m_block;
+		//! Block the container is appended to, null for footnote.
+		Block * m_parent = nullptr;
+	}; // struct Container
+
+	//! State of parsing of the file shared by its nested blocks.
+	struct ParseState {
+		//! Copies of lines changed while parsing, i.e. without comments or with
+		//! expanded tabs. They don't move, so lines may refer to them.
+		QLinkedList< QString > m_changedLines;
+		//! Nested blocks of the last parsed fragment in the order of the document.
+		QVector< BlockJob > m_newJobs;
+		//! Containers of the top-level fragment in the order of creation.
+		QVector< Container > m_containers;
+		//! Footnotes of the top-level fragment, they are added if not empty.
+		QVector< QPair< QString, QSharedPointer< Footnote > > > m_footnotes;
+		//! Count of list items enclosing the fragment being parsed.
+		int m_listNesting = 0;
+		//! Footnotes were added by the last fragment. They may replace ones with
+		//! the same IDs, so count of definitions may stay the same.
+		bool m_footnotesAdded = false;
+
+		//! \return Line that refers to the kept copy of \a line.
+		Line keep( const QString & line )
+		{
+			m_changedLines.append( line );
+
+			return Line( &m_changedLines.last() );
+		}
+
+		//! Parse \a lines into \a block after the current fragment.
+		//! \return Job for the block.
+		BlockJob & addJob( const Lines & lines, QSharedPointer< Block > block )
+		{
+			BlockJob job;
+			job.m_lines = lines;
+			job.m_block = block;
+			job.m_listNesting = m_listNesting;
+
+			m_newJobs.append( job );
+
+			return m_newJobs.last();
+		}
+
+		//! Append container to \a parent, it's removed if it stays empty.
+		void addContainer( QSharedPointer< Block > block, QSharedPointer< Block > parent )
+		{
+			parent->appendItem( block );
+
+			m_containers.append( { block, parent.data() } );
+		}
+	}; // struct ParseState
+
+	//! Information about the line, collected in one pass by classifyLine().
+	struct LineInfo {
+		//! Type of the block started with this line outside of list.
+		BlockType type = BlockType::Unknown;
+		//! Position of the first non-space character, -1 for blank line.
+		int indent = -1;
+		//! Marker of list item ('*', '-', '+', or '.' for ordered list), null if this is not a list item.
+		QChar listMarker;
+		//! Number of ordered list item.
+		int listNumber = 0;
+		//! Position right after list item marker.
+		int listMarkerEnd = -1;
+		//! Character of code fence ('`' or '~'), null if this is not a fence.
+		QChar fence;
+	}; // struct LineInfo
+
+	static LineInfo classifyLine( const Line & str );
+	//! \return Position of the first non-space character, -1 if there is no such.
+	static int firstNonSpace( const Line & str );
+	static bool isFootnote( const Line & str );
+	//! \return Line without first \a length characters.
+	static Line stripPrefix( const Line & str, int length );
+
+	BlockType whatIsTheLine( const Line & str, bool inList = false ) const;
+	BlockType whatIsTheLine( const LineInfo & info, const Line & str,
+		bool inList = false ) const;
+	//! Append \a line to the fragment, \a pf parses the fragment when it's complete.
+	void groupLine( Grouping & g, const Line & line, const std::function< void() > & pf ) const;
+	//! Parse the rest of the fragment when there are no more lines.
+	void finishGrouping( Grouping & g, const std::function< void() > & pf ) const;
+	//! Parse nested blocks of the top-level fragment, in the order of the document and
+	//! without recursion, remove empty containers of the fragment from \a root and
+	//! add footnotes.
+	void parseNestedBlocks( QSharedPointer< Block > root, QSharedPointer< Document > doc,
+		QStringList & linksToParse, const QString & workingPath,
+		const QString & fileName, ParseState & state );
+	void parseFragment( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
-		const QString & fileName );
-	void parseText( QStringList & fr, QSharedPointer< Block > parent,
+		const QString & fileName, ParseState & state );
+	void parseText( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
-		const QString & fileName );
-	void parseBlockquote( QStringList & fr, QSharedPointer< Block > parent,
+		const QString & fileName, ParseState & state );
+	void parseBlockquote( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
-		const QString & fileName );
-	void parseList( QStringList & fr, QSharedPointer< Block > parent,
+		const QString & fileName, ParseState & state );
+	void parseList( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
-		const QString & fileName );
-	void parseCode( QStringList & fr, QSharedPointer< Block > parent, int indent = 0 );
-	void parseCodeIndentedBySpaces( QStringList & fr, QSharedPointer< Block > parent,
+		const QString & fileName, ParseState & state );
+	void parseCode( Lines & fr, QSharedPointer< Block > parent, int indent = 0 );
+	void parseCodeIndentedBySpaces( Lines & fr, QSharedPointer< Block > parent,
 		int indent = 4 );
-	void parseListItem( QStringList & fr, QSharedPointer< Block > parent,
+	void parseListItem( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
-		const QString & fileName );
-	void parseHeading( QStringList & fr, QSharedPointer< Block > parent,
+		const QString & fileName, ParseState & state );
+	void parseHeading( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
 		const QString & fileName );
-	void parseFootnote( QStringList & fr, QSharedPointer< Block > parent,
+	void parseFootnote( Lines & fr, QSharedPointer< Block > parent,
+		QSharedPointer< Document > doc,
+		QStringList & linksToParse, const QString & workingPath,
+		const QString & fileName, ParseState & state );
+	void parseTable( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
 		const QString & fileName );
-	void parseTable( QStringList & fr, QSharedPointer< Block > parent,
+	void parseParagraph( Lines & fr, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
 		const QString & fileName );
-	void parseParagraph( QStringList & fr, QSharedPointer< Block > parent,
+
+	struct InlineJob;
+
+	//! \return Is inline content of blocks of the document parsed after the whole file.
+	bool isInlinesDeferred( QSharedPointer< Document > doc ) const;
+	//! Schedule parsing of inline content of \a job after the whole file,
+	//! the job's item is in \a parent.
+	void deferInlines( InlineJob & job, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
 		const QString & fileName );
@@ -106,349 +329,264 @@ private:
 		QSharedPointer< Document > doc,
 		QStringList & linksToParse, const QString & workingPath,
 		const QString & fileName );
-	bool fileExists( const QString & fileName, const QString & workingPath ) const;
+	//! \return Does target of link or image exist. It's recorded for the cache of
+	//! \a sourceFile in \a workingPath.
+	bool fileExists( const QString & fileName, const QString & workingPath,
+		const QString & sourceFile );
 
-	// Read line from stream.
+	//! Read line from stream without comments. Lines that are entirely in a comment
+	//! are skipped, so comment may be of any length.
 	template< typename STREAM >
-	QString readLine( STREAM & stream, bool & commentFound )
+	Line readLine( STREAM & stream, bool & commentFound, ParseState & state )
 	{
 		static const QString c_startComment = QLatin1String( "<!--" );
 		static const QString c_endComment = QLatin1String( "-->" );
 
-		auto line = stream.readLine();
-
-		bool searchEndFromBegining = commentFound;
-
-		auto cs = line.indexOf( c_startComment );
-
-		if( !commentFound && cs > -1 )
-			commentFound = true;
-
-		if( cs == -1 )
-			cs = 0;
-
-		while( commentFound && !stream.atEnd() )
+		while( true )
 		{
-			auto ce = line.indexOf( c_endComment,
-				( searchEndFromBegining ? 0 : cs + c_startComment.length() ) );
+			const auto line = stream.readLine();
+
+			// Lines without comments are not copied.
+			if( !commentFound && !line.contains( c_startComment ) )
+				return line;
 
-			searchEndFromBegining = false;
+			// Parts of the line out of comments, the line is scanned once.
+			Lines parts;
+			int pos = 0;
 
-			if( ce > -1 )
+			while( pos < line.length() )
 			{
-				if( cs + c_startComment.length() < ce )
+				if( commentFound )
 				{
-					line.remove( cs, ce + c_endComment.length() - cs );
+					const int end = line.indexOf( c_endComment, pos );
+
+					if( end < 0 )
+						break;
 
 					commentFound = false;
+					pos = end + c_endComment.length();
 				}
-				else if( commentFound )
+				else
 				{
-					line.remove( 0, ce + c_endComment.length() );
+					const int start = line.indexOf( c_startComment, pos );
 
-					commentFound = false;
+					if( start < 0 )
+					{
+						parts.append( line.mid( pos ) );
+
+						break;
+					}
+
+					if( start > pos )
+						parts.append( line.mid( pos, start - pos ) );
+
+					commentFound = true;
+					pos = start + c_startComment.length();
 				}
 			}
-			else if( cs > 0 )
-				return line.left( cs );
-			else
-				return readLine( stream, commentFound );
 
-			cs = line.indexOf( c_startComment );
+			if( parts.isEmpty() )
+			{
+				if( commentFound && !stream.atEnd() )
+					continue;
 
-			if( !commentFound && cs > -1 )
-				commentFound = true;
-		}
+				return Line();
+			}
+			else if( parts.size() == 1 )
+				return parts.first();
+
+			QString res;
 
-		if( commentFound )
-			return QString();
-		else
-			return line;
+			for( const auto & part : qAsConst( parts ) )
+				res.append( part );
+
+			return state.keep( res );
+		}
 	};
 
+	//! Parse lines of the stream into \a parent. Top-level items get source spans.
+	//! If \a resync is given parsing stops at the first of these lines that starts
+	//! a new block.
 	template< typename STREAM >
 	void parse( STREAM & stream, QSharedPointer< Block > parent,
 		QSharedPointer< Document > doc, QStringList & linksToParse,
 		const QString & workingPath, const QString & fileName,
-		bool skipSpacesAtStartOfLine = false )
+		const QSet< int > * resync = nullptr )
 	{
-		QStringList fragment;
+		ParseState state;
+		Grouping grouping;
 
-		BlockType type = BlockType::Unknown;
-		bool emptyLineInList = false;
-		bool firstLine = true;
-		int spaces = 0;
+		// First line of the current fragment and of the last read line.
+		int fragmentStart = stream.pos();
+		int lineStart = fragmentStart;
+		// Items of the previous fragment, they end where the next one starts.
+		QVector< QSharedPointer< Item > > opened;
 
-		// Parse fragment and clear internal cache.
+		// Parse fragment with its nested blocks.
 		auto pf = [&]()
 			{
-				parseFragment( fragment, parent, doc, linksToParse, workingPath, fileName );
-				fragment.clear();
-				type = BlockType::Unknown;
-				emptyLineInList = false;
-			};
-
-		bool commentFound = false;
-
-		auto rl = [&]() -> QString
-		{
-			auto line = readLine( stream, commentFound );
-
-			if( skipSpacesAtStartOfLine )
-			{
-				line.replace( QLatin1Char( '\t' ), QLatin1String( "    " ) );
+				closeSourceSpans( opened, fragmentStart - 1 );
 
-				if( firstLine )
-				{
-					static const QRegExp s( QLatin1String( "[^\\s]" ) );
-
-					spaces = s.indexIn( line );
+				const int itemsCount = parent->items().size();
+				const int definitions = definitionsCount( *doc );
 
-					firstLine = false;
-				}
-
-				line = line.right( line.length() - spaces );
-			}
+				parseFragment( grouping.m_fragment, parent, doc, linksToParse,
+					workingPath, fileName, state );
 
-			return line;
-		};
+				parseNestedBlocks( parent, doc, linksToParse, workingPath, fileName, state );
 
-		// Eat footnote.
-		auto eatFootnote = [&]()
-			{
-				while( !stream.atEnd() )
-				{
-					auto line = rl();
+				setSourceSpans( *doc, itemsCount,
+					( state.m_footnotesAdded ? -1 : definitions ),
+					{ workingPath + fileName, fragmentStart, -1 }, opened );
 
-					if( line.isEmpty() || line.startsWith( QLatin1String( "    " ) ) ||
-						line.startsWith( QLatin1Char( '\t' ) ) )
-					{
-						fragment.append( line );
-					}
-					else
-					{
-						pf();
+				state.m_footnotesAdded = false;
 
-						type = whatIsTheLine( line );
-						fragment.append( line );
+				if( m_streamedDoc && parent.data() == m_streamedDoc )
+					flushStreamedItems();
 
-						break;
-					}
-				}
-
-				if( stream.atEnd() && !fragment.isEmpty() )
-					pf();
+				fragmentStart = lineStart;
 			};
 
-		static const QRegExp footnoteRegExp( QLatin1String( "\\s*\\[\\^[^\\s]*\\]:.*" ) );
-
+		bool commentFound = false;
 
 		while( !stream.atEnd() )
 		{
-			auto line = rl();
-
-			auto simplified = line.simplified();
-
-			BlockType lineType = whatIsTheLine( line, emptyLineInList );
-
-			// First line of the fragment.
-			if( !simplified.isEmpty() && type == BlockType::Unknown )
-			{
-				type = lineType;
-
-				fragment.append( line );
-
-				if( type == BlockType::Heading )
-					pf();
-
-				continue;
-			}
-			else if( simplified.isEmpty() && type == BlockType::Unknown )
-				continue;
-
-			// Got new empty line.
-			if( simplified.isEmpty() )
-			{
-				switch( type )
-				{
-					case BlockType::Text :
-					{
-						if( footnoteRegExp.exactMatch( fragment.first() ) )
-						{
-							fragment.append( QString() );
-
-							eatFootnote();
-						}
-						else
-							pf();
-
-						continue;
-					}
-
-					case BlockType::Blockquote :
-					{
-						pf();
-
-						continue;
-					}
-
-					case BlockType::CodeIndentedBySpaces :
-					{
-						if( line.startsWith( QLatin1String( "    " ) ) ||
-							line.startsWith( QLatin1Char( '\t' ) ) )
-						{
-							fragment.append( line );
-						}
-						else
-							pf();
-
-						continue;
-					}
-
-					case BlockType::Code :
-					{
-						fragment.append( line );
-
-						continue;
-					}
-
-					case BlockType::List :
-					{
-						emptyLineInList = true;
-
-						continue;
-					}
-
-					default :
-						break;
-				}
-			}
-			//! Empty new line in list.
-			else if( emptyLineInList )
+			if( grouping.m_fragment.isEmpty() && grouping.m_type == BlockType::Unknown )
 			{
-				if( line.startsWith( QLatin1String( "    " ) ) ||
-					line.startsWith( QLatin1Char( '\t' ) )  ||
-					lineType == BlockType::List )
-				{
-					fragment.append( QString() );
-					fragment.append( line );
-
-					emptyLineInList = false;
-
-					continue;
-				}
-				else
-				{
-					pf();
-
-					type = lineType;
-					fragment.append( line );
+				fragmentStart = stream.pos();
 
-					continue;
-				}
+				// Here the parser is in the same state as at the start of the stream.
+				if( resync && !commentFound && resync->contains( fragmentStart ) )
+					break;
 			}
 
-			// Something new and this is not a code block or a list.
-			if( type != lineType && type != BlockType::Code && type != BlockType::List )
-			{
-				pf();
-
-				type = lineType;
-
-				if( !line.isEmpty() )
-					fragment.append( line );
-			}
-			// End of code block.
-			else if( type == BlockType::Code && type == lineType )
-			{
-				fragment.append( line );
+			lineStart = stream.pos();
 
-				pf();
-			}
-			else
-				fragment.append( line );
+			groupLine( grouping, readLine( stream, commentFound, state ), pf );
 		}
 
-		if( !fragment.isEmpty() )
-			pf();
+		finishGrouping( grouping, pf );
+
+		closeSourceSpans( opened, stream.pos() - 1 );
 	}
 
-	//! Wrapper for QStringList to be behaved like a stream.
-	class StringListStream final
+	//! Stream of lines of the file that is loaded and decoded at once.
+	class FileStream final
 	{
 	public:
-		StringListStream( QStringList & stream )
-			:	m_stream( stream )
-			,	m_pos( 0 )
+		FileStream()
+			:	m_pos( 0 )
 		{
 		}
 
-		bool atEnd() const { return ( m_pos >= m_stream.size() ); }
-		QString readLine() { return m_stream.at( m_pos++ ); }
+		//! Load file. \return false if the file can't be read.
+		bool load( const QString & fileName, QTextCodec * codec );
 
-	private:
-		QStringList & m_stream;
-		int m_pos;
-	}; // class StringListStream
+		//! \return Decoded content of the file.
+		const QString & text() const { return m_text; }
 
-	//! Wrapper for QTextStream.
-	class TextStream final
-	{
-	public:
-		TextStream( QTextStream & stream )
-			:	m_stream( stream )
-		{
-		}
+		bool atEnd() const { return ( m_pos >= m_lines.size() ); }
+		//! \return Index of the next line.
+		int pos() const { return m_pos; }
+		void seek( int pos ) { m_pos = pos; }
+		//! \return Count of lines.
+		int size() const { return m_lines.size(); }
 
-		bool atEnd() const { return ( m_stream.atEnd() ); }
-		QString readLine()
+		//! \return Line that refers to the decoded text.
+		Line readLine()
 		{
-			QString line;
-			bool rFound = false;
-
-			QChar c = m_buf;
-			m_buf = QChar();
-
-			if( !c.isNull() && c != QLatin1Char( '\r' ) )
-				line.append( c );
-
-			if( c == QLatin1Char( '\r' ) )
-				rFound = true;
-
-			while( !m_stream.atEnd() )
-			{
-				m_stream >> c;
-
-				if( rFound && c != QLatin1Char( '\n' ) )
-				{
-					m_buf = c;
+			const auto & l = m_lines.at( m_pos++ );
 
-					return line;
-				}
-
-				if( c == QLatin1Char( '\r' ) )
-				{
-					rFound = true;
-
-					continue;
-				}
-				else if( c == QLatin1Char( '\n' ) )
-					return line;
-
-				if( !c.isNull() )
-					line.append( c );
-			}
-
-			return line;
+			return m_text.midRef( l.first, l.second );
 		}
 
 	private:
-		QTextStream & m_stream;
-		QChar m_buf;
-	}; // class QTextStream
+		//! Decoded content of the file.
+		QString m_text;
+		//! Offset and length of every line in the text.
+		QVector< QPair< int, int > > m_lines;
+		int m_pos;
+	}; // class FileStream
 
 private:
-	QStringList m_parsedFiles;
+	//! Parsed file.
+	struct Fragment {
+		//! Items and maps of the single file.
+		QSharedPointer< Document > m_doc;
+		//! Absolute paths of linked files in the order of appearance.
+		QStringList m_links;
+	}; // struct Fragment
+
+	//! Inline content of a block which is parsed after the whole file.
+	struct InlineJob {
+		QStringList m_lines;
+		//! Block where inline items go.
+		QSharedPointer< Block > m_target;
+		//! Paragraph, heading or table of the content. Paragraph and heading
+		//! are removed if they end up empty.
+		QSharedPointer< Item > m_item;
+		//! Heading which text is taken from inline items of the target.
+		QSharedPointer< Heading > m_heading;
+		//! Block the item is in.
+		Block * m_parent = nullptr;
+		//! Top-level item or footnote which span definitions of the job take.
+		QSharedPointer< Item > m_spanItem;
+		QString m_workingPath;
+		QString m_fileName;
+		//! Position in list of linked files where links of the paragraph go.
+		int m_linksPos = 0;
+		//! Linked files found in the paragraph.
+		QStringList m_links;
+		//! Labeled links defined in the paragraph.
+		QSharedPointer< Document > m_labels;
+	}; // struct InlineJob
+
+	//! Container with deferred inline content, it's removed if it ends up empty.
+	struct InlineContainer {
+		//! The container, it's kept even if it's replaced with a footnote with
+		//! the same ID.
+		QSharedPointer< Block > m_block;
+		//! Block the container is in, null for a footnote.
+		Block * m_parent = nullptr;
+		//! ID of the footnote.
+		QString m_footnote;
+		//! Footnote with the same ID replaced by this one.
+		QSharedPointer< Footnote > m_replaced;
+	}; // struct InlineContainer
+
+	//! Deferred inline content of the file.
+	struct InlineJobs {
+		QVector< InlineJob > m_jobs;
+		QHash< const Block*, InlineContainer > m_containers;
+	}; // struct InlineJobs
+
+	QMutex m_mutex;
+	QWaitCondition m_fileFinished;
+	//! Files scheduled for parsing.
+	QSet< QString > m_parsedFiles;
+	//! Files that are parsed or failed.
+	QSet< QString > m_finishedFiles;
+	QHash< QString, Fragment > m_fragments;
+	//! Deferred inline content of files being parsed.
+	QHash< const Document*, InlineJobs > m_inlineJobs;
+	bool m_sourceViews = false;
+	//! Directory of on-disk cache of parsed files, empty if there is no cache.
+	QString m_cacheDir;
+	//! Targets of links and images looked for in files being parsed, by paths of
+	//! the files. They are collected only if there is a cache.
+	QHash< QString, DocumentCache::Targets > m_targets;
+	BlockHandler * m_handler = nullptr;
+	//! Fragment of the main file which items are handed to the handler.
+	Document * m_streamedDoc = nullptr;
+	//! Type of the last top-level item, ItemType::Unknown if there is no one yet.
+	ItemType m_lastItemType = ItemType::Unknown;
+	//! Limit of threads, 0 if there is no limit.
+	int m_threadsCount = 0;
+	//! Pool of the current parsing, null if it's parsed in the calling thread only.
+	QThreadPool * m_pool = nullptr;
+
+	//! Benchmark of line classification against the regexp-based one.
+	friend struct LineClassifierBench;
 
 	Q_DISABLE_COPY( Parser )
 }; // class Parser
@@ -49,14 +49,39 @@ private:
 }; // class PdfRendererError
 
 
+namespace /* anonymous */ {
+
+//! \return Store of fonts shared by all renderers that don't have their own.
+FontStore &
+defaultFontStore()
+{
+	static FontStore store;
+
+	return store;
+}
+
+//! \return Store of hyphenation patterns shared by all renderers.
+HyphenationStore &
+defaultHyphenationStore()
+{
+	static HyphenationStore store;
+
+	return store;
+}
+
+} /* namespace anonymous */
+
+
 //
 // PdfRenderer
 //
 
 PdfRenderer::PdfRenderer()
 	:	m_terminate( false )
+	,	m_fontStore( nullptr )
+	,	m_pagesCount( 0 )
 {
-	connect( this, &PdfRenderer::start, this, &PdfRenderer::renderImpl,
+	connect( this, &PdfRenderer::start, this, &PdfRenderer::renderAsync,
 		Qt::QueuedConnection );
 }
 
@@ -71,6 +96,29 @@ PdfRenderer::render( const QString & fileName, QSharedPointer< MD::Document > do
 	emit start();
 }
 
+void
+PdfRenderer::renderSync( const QString & fileName, QSharedPointer< MD::Document > doc,
+	const RenderOpts & opts )
+{
+	m_fileName = fileName;
+	m_doc = doc;
+	m_opts = opts;
+
+	renderImpl();
+}
+
+void
+PdfRenderer::setFontStore( FontStore * store )
+{
+	m_fontStore = store;
+}
+
+int
+PdfRenderer::pagesCount() const
+{
+	return m_pagesCount;
+}
+
 void
 PdfRenderer::terminate()
 {
@@ -79,14 +127,28 @@ PdfRenderer::terminate()
 	m_terminate = true;
 }
 
+void
+PdfRenderer::renderAsync()
+{
+	renderImpl();
+
+	deleteLater();
+}
+
 void
 PdfRenderer::renderImpl()
 {
 	{
+		// Document may be built or changed without the parser, so IDs of its
+		// labels are set here.
+		m_doc->internLabels();
+
 		const int itemsCount = m_doc->items().size();
 
 		emit progress( 0 );
 
+		m_pagesCount = 0;
+
 		PdfMemDocument document;
 
 		PdfPainter painter;
@@ -103,8 +165,19 @@ PdfRenderer::renderImpl()
 			pdfData.coords.margins.top = m_opts.m_top;
 			pdfData.coords.margins.bottom = m_opts.m_bottom;
 
+			if( !m_opts.m_hyphenationPatterns.isEmpty() )
+			{
+				m_hyphenator = defaultHyphenationStore().hyphenator( m_opts.m_hyphenationPatterns );
+
+				if( m_hyphenator.isEmpty() )
+					throw PdfRendererError( tr( "Unable to load hyphenation patterns: %1." )
+						.arg( m_opts.m_hyphenationPatterns ) );
+			}
+
 			createPage( pdfData );
 
+			m_dests.resize( m_doc->labelsCount() );
+
 			for( const auto & i : m_doc->items() )
 			{
 				++itemIdx;
@@ -172,7 +245,7 @@ PdfRenderer::renderImpl()
 					case MD::ItemType::Anchor :
 					{
 						auto * a = static_cast< MD::Anchor* > ( i.data() );
-						m_dests.insert( a->label(), PdfDestination( pdfData.page ) );
+						addDest( a->labelId(), PdfDestination( pdfData.page ) );
 					}
 						break;
 
@@ -188,6 +261,8 @@ PdfRenderer::renderImpl()
 
 			resolveLinks( pdfData );
 
+			m_pagesCount = document.GetPageCount();
+
 			document.Write( m_fileName.toLocal8Bit().data() );
 
 			emit done( m_terminate );
@@ -225,53 +300,80 @@ PdfRenderer::renderImpl()
 	{
 		emit error( QString::fromLatin1( PdfError::ErrorMessage( e.GetError() ) ) );
 	}
-
-	deleteLater();
 }
 
 void
 PdfRenderer::clean()
 {
+	m_fonts.clear();
+	m_widths.clear();
 	m_dests.clear();
 	m_unresolvedLinks.clear();
-	PdfEncodingFactory::FreeGlobalEncodingInstances();
+	// Patterns stay in the store, only the memo of this renderer is dropped.
+	m_hyphenator = Hyphenator();
 }
 
 void
 PdfRenderer::resolveLinks( PdfAuxData & pdfData )
 {
-	for( auto it = m_unresolvedLinks.cbegin(), last = m_unresolvedLinks.cend(); it != last; ++it )
+	for( const auto & link : qAsConst( m_unresolvedLinks ) )
 	{
-		if( m_dests.contains( it.key() ) )
+		if( link.first >= 0 && link.first < m_dests.size() && !m_dests.at( link.first ).isNull() )
 		{
-			for( const auto & r : qAsConst( it.value() ) )
+			const auto & dest = *m_dests.at( link.first );
+
+			for( const auto & r : qAsConst( link.second ) )
 			{
 				auto * page = pdfData.doc->GetPage( r.second );
 				auto * annot = page->CreateAnnotation( ePdfAnnotation_Link,
 					PdfRect( r.first.x(), r.first.y(), r.first.width(), r.first.height() ) );
 				annot->SetBorderStyle( 0.0, 0.0, 0.0 );
-				annot->SetDestination( m_dests.value( it.key(), PdfDestination( pdfData.page ) ) );
+				annot->SetDestination( dest );
 				annot->SetFlags( ePdfAnnotationFlags_NoZoom );
 			}
 		}
 	}
 }
 
+void
+PdfRenderer::addDest( int id, const PdfDestination & dest )
+{
+	if( id >= 0 && id < m_dests.size() )
+		m_dests[ id ].reset( new PdfDestination( dest ) );
+}
+
 PdfFont *
 PdfRenderer::createFont( const QString & name, bool bold, bool italic, float size,
 	PdfMemDocument * doc )
 {
-	auto * font = doc->CreateFont( name.toLocal8Bit().data(), bold, italic , false,
-		PdfEncodingFactory::GlobalIdentityEncodingInstance(),
-		PdfFontCache::eFontCreationFlags_None );
+	const QPair< QString, int > key( name, ( bold ? 1 : 0 ) | ( italic ? 2 : 0 ) );
+
+	auto * font = m_fonts.value( key, nullptr );
 
 	if( !font )
-		throw PdfRendererError( tr( "Unable to create font: %1. Please choose another one.\n\n"
-			"This application uses PoDoFo C++ library to create PDF. And not all fonts supported by Qt "
-			"are supported by PoDoFo. I'm sorry for the inconvenience." )
-				.arg( name ) );
+	{
+		const auto path = ( m_fontStore ? m_fontStore : &defaultFontStore() )->fontPath(
+			name, bold, italic ).toLocal8Bit();
 
+		font = doc->CreateFont( name.toLocal8Bit().data(), bold, italic , false,
+			PdfEncodingFactory::GlobalIdentityEncodingInstance(),
+			PdfFontCache::eFontCreationFlags_None, true,
+			( path.isEmpty() ? nullptr : path.data() ) );
+
+		if( !font )
+			throw PdfRendererError( tr( "Unable to create font: %1. Please choose another one.\n\n"
+				"This application uses PoDoFo C++ library to create PDF. And not all fonts supported by Qt "
+				"are supported by PoDoFo. I'm sorry for the inconvenience." )
+					.arg( name ) );
+
+		m_fonts.insert( key, font );
+	}
+
+	// PoDoFo has one font object for all sizes of the face, so size and strikeout
+	// are state of the current use and set every time. Size is valid till the next
+	// creation of the font, fonts kept for later use keep their size too (FontUse, CellItem).
 	font->SetFontSize( size );
+	font->SetStrikeOut( false );
 
 	return font;
 }
@@ -305,6 +407,12 @@ PdfRenderer::createPdfString( const QString & text )
 	return PdfString( reinterpret_cast< pdf_utf8* > ( text.toUtf8().data() ) );
 }
 
+PdfString
+PdfRenderer::createPdfString( const QStringRef & text )
+{
+	return PdfString( reinterpret_cast< pdf_utf8* > ( text.toUtf8().data() ) );
+}
+
 QString
 PdfRenderer::createQString( const PdfString & str )
 {
@@ -312,6 +420,79 @@ PdfRenderer::createQString( const PdfString & str )
 		static_cast< int > ( str.GetCharacterLength() ) );
 }
 
+double
+PdfRenderer::stringWidth( PdfFont * font, const QStringRef & str )
+{
+	auto * fm = font->GetFontMetrics();
+
+	// Strings are measured with scale of 100%, the font is scaled only to draw spaces.
+	auto & widths = m_widths[ qMakePair( font, fm->GetFontSize() ) ];
+
+	if( widths.m_ascii.isEmpty() )
+	{
+		widths.m_ascii.resize( 128 );
+
+		for( int c = 0; c < 128; ++c )
+			widths.m_ascii[ c ] = fm->UnicodeCharWidth( static_cast< unsigned short > ( c ) );
+
+		widths.m_ascii[ 0x20 ] += fm->GetWordSpace() * fm->GetFontScale() / 100.0;
+	}
+
+	const QChar * data = str.unicode();
+	const int length = str.length();
+
+	double w = 0.0;
+	int i = 0;
+
+	for( ; i < length && data[ i ].unicode() < 128; ++i )
+		w += widths.m_ascii[ data[ i ].unicode() ];
+
+	if( i == length )
+		return w;
+
+	const auto key = str.toString();
+
+	const auto it = widths.m_words.constFind( key );
+
+	if( it != widths.m_words.constEnd() )
+		return it.value();
+
+	// PoDoFo measures Unicode string by UTF-16 code units, the same as QChar.
+	for( ; i < length; ++i )
+	{
+		if( data[ i ].unicode() < 128 )
+			w += widths.m_ascii[ data[ i ].unicode() ];
+		else
+			w += fm->UnicodeCharWidth( data[ i ].unicode() );
+	}
+
+	widths.m_words.insert( key, w );
+
+	return w;
+}
+
+double
+PdfRenderer::stringWidth( PdfFont * font, const QString & str )
+{
+	return stringWidth( font, QStringRef( &str ) );
+}
+
+PdfRenderer::Metrics::Metrics( PdfRenderer * renderer, const QVector< FontUse > & fonts )
+	:	m_renderer( renderer )
+	,	m_fonts( fonts )
+{
+}
+
+double
+PdfRenderer::Metrics::stringWidth( int font, const QStringRef & str )
+{
+	const auto & f = m_fonts.at( font );
+
+	f.font->SetFontSize( f.size );
+
+	return m_renderer->stringWidth( f.font, str );
+}
+
 QVector< WhereDrawn >
 PdfRenderer::drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 	MD::Heading * item, QSharedPointer< MD::Document > doc, double offset )
@@ -327,7 +508,7 @@ PdfRenderer::drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 
 	emit status( tr( "Drawing heading." ) );
 
-	PdfFont * font = createFont( renderOpts.m_textFont.toLocal8Bit().data(),
+	PdfFont * font = createFont( renderOpts.m_textFont,
 		true, false, renderOpts.m_textFontSize + 16 - ( item->level() < 7 ? item->level() * 2 : 12 ),
 		pdfData.doc );
 
@@ -353,7 +534,7 @@ PdfRenderer::drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 			width, height, createPdfString( item->text() ) );
 
 		if( !item->label().isEmpty() )
-			m_dests.insert( item->label(), PdfDestination( pdfData.page,
+			addDest( item->labelId(), PdfDestination( pdfData.page,
 				PdfRect( pdfData.coords.margins.left + offset,
 					pdfData.coords.y - font->GetFontMetrics()->GetLineSpacing(),
 					width, font->GetFontMetrics()->GetLineSpacing() ) ) );
@@ -402,7 +583,7 @@ PdfRenderer::drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 			width, h, createPdfString( text ) );
 
 		if( !item->label().isEmpty() )
-			m_dests.insert( item->label(), PdfDestination( pdfData.page,
+			addDest( item->labelId(), PdfDestination( pdfData.page,
 				PdfRect( pdfData.coords.margins.left + offset,
 					pdfData.coords.y - font->GetFontMetrics()->GetLineSpacing(),
 					width, font->GetFontMetrics()->GetLineSpacing() ) ) );
@@ -421,26 +602,6 @@ PdfRenderer::drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 	}
 }
 
-QVector< QPair< QRectF, int > >
-PdfRenderer::drawText( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	MD::Text * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-	bool firstInParagraph, CustomWidth * cw )
-{
-	auto * spaceFont = createFont( renderOpts.m_textFont, false, false,
-		renderOpts.m_textFontSize, pdfData.doc );
-
-	auto * font = createFont( renderOpts.m_textFont, item->opts() & MD::TextOption::BoldText,
-		item->opts() & MD::TextOption::ItalicText,
-		renderOpts.m_textFontSize, pdfData.doc );
-
-	if( item->opts() & MD::TextOption::StrikethroughText )
-		font->SetStrikeOut( true );
-
-	return drawString( pdfData, renderOpts, item->text(),
-		spaceFont, font, font->GetFontMetrics()->GetLineSpacing(),
-		doc, newLine, offset, firstInParagraph, cw );
-}
-
 namespace /* anonymous */ {
 
 QVector< QPair< QRectF, int > >
@@ -475,297 +636,6 @@ normalizeRects( const QVector< QPair< QRectF, int > > & rects )
 
 } /* namespace anonymous */
 
-QVector< QPair< QRectF, int > >
-PdfRenderer::drawLink( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	MD::Link * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-	bool firstInParagraph, CustomWidth * cw )
-{
-	QVector< QPair< QRectF, int > > rects;
-
-	QString url = item->url();
-
-	if( doc->labeledLinks().contains( url ) )
-		url = doc->labeledLinks()[ url ]->url();
-
-	bool draw = true;
-
-	if( cw && !cw->isDrawing() )
-		draw = false;
-
-	if( item->img()->isEmpty() )
-	{
-		pdfData.painter->Save();
-		pdfData.painter->SetColor( renderOpts.m_linkColor.redF(),
-			renderOpts.m_linkColor.greenF(),
-			renderOpts.m_linkColor.blueF() );
-
-		auto * font = createFont( renderOpts.m_textFont, item->textOptions() & MD::TextOption::BoldText,
-			item->textOptions() & MD::TextOption::ItalicText, renderOpts.m_textFontSize,
-			pdfData.doc );
-
-		if( item->textOptions() & MD::TextOption::StrikethroughText )
-			font->SetStrikeOut( true );
-
-		rects = normalizeRects( drawString( pdfData, renderOpts,
-			( !item->text().isEmpty() ? item->text() : url ),
-			createFont( renderOpts.m_textFont, false, false, renderOpts.m_textFontSize,
-				pdfData.doc ),
-			font, font->GetFontMetrics()->GetLineSpacing(),
-			doc, newLine, offset, firstInParagraph, cw ) );
-
-		pdfData.painter->Restore();
-	}
-	else
-		rects.append( drawImage( pdfData, renderOpts, item->img().data(), doc, newLine, offset,
-			firstInParagraph, cw ) );
-
-	if( draw )
-	{
-		if( !QUrl( url ).isRelative() )
-		{
-			for( const auto & r : qAsConst( rects ) )
-			{
-				auto * annot = pdfData.doc->GetPage( r.second )->CreateAnnotation( ePdfAnnotation_Link,
-					PdfRect( r.first.x(), r.first.y(), r.first.width(), r.first.height() ) );
-				annot->SetBorderStyle( 0.0, 0.0, 0.0 );
-
-				PdfAction action( ePdfAction_URI, pdfData.doc );
-				action.SetURI( PdfString( url.toLatin1().data() ) );
-
-				annot->SetAction( action );
-				annot->SetFlags( ePdfAnnotationFlags_NoZoom );
-			}
-		}
-		else
-			m_unresolvedLinks.insert( url, rects );
-	}
-
-	return rects;
-}
-
-QVector< QPair< QRectF, int > >
-PdfRenderer::drawString( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	const QString & str, PdfFont * spaceFont, PdfFont * font, double lineHeight,
-	QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-	bool firstInParagraph, CustomWidth * cw, const QColor & background )
-{
-	Q_UNUSED( doc )
-	Q_UNUSED( renderOpts )
-
-	bool draw = true;
-
-	if( cw && !cw->isDrawing() )
-		draw = false;
-
-	auto newLineFn = [&] ()
-	{
-		newLine = true;
-
-		if( draw )
-		{
-			moveToNewLine( pdfData, offset, lineHeight, 1.0 );
-
-			if( cw )
-				cw->moveToNextLine();
-		}
-		else if( cw )
-		{
-			cw->append( { 0.0, false, true, true, "" } );
-			pdfData.coords.x = pdfData.coords.margins.left + offset;
-		}
-	};
-
-	QVector< QPair< QRectF, int > > ret;
-
-	{
-		QMutexLocker lock( &m_mutex );
-
-		if( m_terminate )
-			return ret;
-	}
-
-	static const QString charsWithoutSpaceBefore = QLatin1String( ".,;" );
-
-	const auto words = str.split( QLatin1Char( ' ' ), QString::SkipEmptyParts );
-
-	const auto wv = pdfData.coords.pageWidth - pdfData.coords.margins.right;
-
-	if( !firstInParagraph && !newLine && !words.isEmpty() &&
-		!charsWithoutSpaceBefore.contains( words.first() ) )
-	{
-		pdfData.painter->SetFont( spaceFont );
-
-		const auto w = spaceFont->GetFontMetrics()->StringWidth( " " );
-
-		auto scale = 1.0;
-
-		if( draw && cw )
-			scale = cw->scale();
-
-		const auto xv = pdfData.coords.x + w * scale / 100.0 + font->GetFontMetrics()->StringWidth(
-			createPdfString( words.first() ) );
-
-		if( xv < wv || qAbs( xv - wv ) < 0.01 )
-		{
-			if( draw )
-			{
-				spaceFont->SetFontScale( scale );
-
-				pdfData.painter->DrawText( pdfData.coords.x, pdfData.coords.y, " " );
-
-				spaceFont->SetFontScale( 100.0 );
-			}
-			else if( cw )
-				cw->append( { w, true, false, true, " " } );
-
-			ret.append( qMakePair( QRectF( pdfData.coords.x, pdfData.coords.y,
-				w * scale / 100.0, lineHeight ), pdfData.currentPageIdx ) );
-
-			pdfData.coords.x += w * scale / 100.0;
-		}
-		else
-			newLineFn();
-	}
-
-	pdfData.painter->SetFont( font );
-
-	for( auto it = words.begin(), last = words.end(); it != last; ++it )
-	{
-		{
-			QMutexLocker lock( &m_mutex );
-
-			if( m_terminate )
-				return ret;
-		}
-
-		const auto str = createPdfString( *it );
-
-		const auto length = font->GetFontMetrics()->StringWidth( str );
-
-		const auto xv = pdfData.coords.x + length;
-
-		if( xv < wv || qAbs( xv - wv ) < 0.01 )
-		{
-			newLine = false;
-
-			if( draw )
-			{
-				if( background.isValid() )
-				{
-					pdfData.painter->Save();
-					pdfData.painter->SetColor( background.redF(),
-						background.greenF(), background.blueF() );
-					pdfData.painter->Rectangle( pdfData.coords.x, pdfData.coords.y +
-						font->GetFontMetrics()->GetDescent(), length,
-						font->GetFontMetrics()->GetLineSpacing() );
-					pdfData.painter->Fill();
-					pdfData.painter->Restore();
-				}
-
-				pdfData.painter->DrawText( pdfData.coords.x, pdfData.coords.y, str );
-				ret.append( qMakePair( QRectF( pdfData.coords.x, pdfData.coords.y,
-					length, lineHeight ), pdfData.currentPageIdx ) );
-			}
-			else if( cw )
-				cw->append( { length, false, false, true, *it } );
-
-			pdfData.coords.x += length;
-
-			if( it + 1 != last )
-			{
-				const auto spaceWidth = font->GetFontMetrics()->StringWidth( " " );
-				const auto nextLength = font->GetFontMetrics()->StringWidth( createPdfString(
-					*( it + 1 ) ) );
-
-				auto scale = 100.0;
-
-				if( draw && cw )
-					scale = cw->scale();
-
-				const auto xv = pdfData.coords.x + spaceWidth * scale / 100.0 + nextLength;
-
-				if( xv < wv || qAbs( xv - wv ) < 0.01 )
-				{
-					if( draw )
-					{
-						font->SetFontScale( scale );
-
-						ret.append( qMakePair( QRectF( pdfData.coords.x, pdfData.coords.y,
-							spaceWidth * scale / 100.0, lineHeight ), pdfData.currentPageIdx ) );
-
-						if( background.isValid() )
-						{
-							pdfData.painter->Save();
-							pdfData.painter->SetColor( background.redF(),
-								background.greenF(), background.blueF() );
-							pdfData.painter->Rectangle( pdfData.coords.x, pdfData.coords.y +
-								font->GetFontMetrics()->GetDescent(), spaceWidth * scale / 100.0,
-								font->GetFontMetrics()->GetLineSpacing() );
-							pdfData.painter->Fill();
-							pdfData.painter->Restore();
-						}
-
-						pdfData.painter->DrawText( pdfData.coords.x, pdfData.coords.y, " " );
-
-						font->SetFontScale( 100.0 );
-					}
-					else if( cw )
-						cw->append( { spaceWidth, true, false, true, " " } );
-
-					pdfData.coords.x += spaceWidth * scale / 100.0;
-				}
-				else
-					newLineFn();
-			}
-		}
-		else
-		{
-			const auto xv = pdfData.coords.margins.left + offset + length;
-
-			if( xv < wv || qAbs( xv - wv ) < 0.01 )
-			{
-				newLineFn();
-
-				--it;
-			}
-			else
-			{
-				newLineFn();
-
-				if( draw )
-				{
-					pdfData.painter->DrawText( pdfData.coords.x, pdfData.coords.y, str );
-					ret.append( qMakePair( QRectF( pdfData.coords.x, pdfData.coords.y,
-							font->GetFontMetrics()->StringWidth( str ), lineHeight ),
-						pdfData.currentPageIdx ) );
-				}
-				else if( cw )
-					cw->append( { font->GetFontMetrics()->StringWidth( str ), false, false, true, *it } );
-
-				newLineFn();
-			}
-		}
-	}
-
-	return ret;
-}
-
-QVector< QPair< QRectF, int > >
-PdfRenderer::drawInlinedCode( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	MD::Code * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-	bool firstInParagraph, CustomWidth * cw )
-{
-	auto * textFont = createFont( renderOpts.m_textFont, false, false, renderOpts.m_textFontSize,
-		pdfData.doc );
-
-	auto * font = createFont( renderOpts.m_codeFont, false, false, renderOpts.m_codeFontSize,
-		pdfData.doc );
-
-	return drawString( pdfData, renderOpts, item->text(), font, font,
-		textFont->GetFontMetrics()->GetLineSpacing(),
-		doc, newLine, offset, firstInParagraph, cw, renderOpts.m_codeBackground );
-}
-
 void
 PdfRenderer::moveToNewLine( PdfAuxData & pdfData, double xOffset, double yOffset,
 	double yOffsetMultiplier )
@@ -819,8 +689,6 @@ QVector< WhereDrawn >
 PdfRenderer::drawParagraph( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 	MD::Paragraph * item, QSharedPointer< MD::Document > doc, double offset, bool withNewLine )
 {
-	QVector< QPair< QRectF, int > > rects;
-
 	{
 		QMutexLocker lock( &m_mutex );
 
@@ -851,65 +719,131 @@ PdfRenderer::drawParagraph( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 		pdfData.coords.x = pdfData.coords.margins.left + offset;
 	}
 
-	bool newLine = false;
-	CustomWidth cw;
-	auto y = pdfData.coords.y;
+	QVector< FontUse > fonts;
+	QVector< LayoutRun > runs;
+	QVector< RunStyle > styles;
+
+	const int textFont = fontId( fonts, font, renderOpts.m_textFontSize, false );
 
 	for( auto it = item->items().begin(), last = item->items().end(); it != last; ++it )
 	{
-		{
-			QMutexLocker lock( &m_mutex );
-
-			if( m_terminate )
-				return QVector< WhereDrawn > ();
-		}
+		LayoutRun run;
+		RunStyle style;
 
 		switch( (*it)->type() )
 		{
 			case MD::ItemType::Text :
-				drawText( pdfData, renderOpts, static_cast< MD::Text* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw );
+			{
+				auto * t = static_cast< MD::Text* > ( it->data() );
+
+				auto * f = createFont( renderOpts.m_textFont, t->opts() & MD::TextOption::BoldText,
+					t->opts() & MD::TextOption::ItalicText, renderOpts.m_textFontSize,
+					pdfData.doc );
+
+				run.m_text = t->text();
+				run.m_words = t->words();
+				run.m_font = fontId( fonts, f, renderOpts.m_textFontSize,
+					t->opts() & MD::TextOption::StrikethroughText );
+				run.m_spaceFont = textFont;
+				run.m_lineHeight = f->GetFontMetrics()->GetLineSpacing();
+			}
 				break;
 
 			case MD::ItemType::Code :
-				drawInlinedCode( pdfData, renderOpts, static_cast< MD::Code* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw );
+			{
+				auto * c = static_cast< MD::Code* > ( it->data() );
+
+				auto * f = createFont( renderOpts.m_codeFont, false, false,
+					renderOpts.m_codeFontSize, pdfData.doc );
+
+				run.m_text = c->text();
+				run.m_words = c->words();
+				run.m_font = fontId( fonts, f, renderOpts.m_codeFontSize, false );
+				run.m_spaceFont = run.m_font;
+				run.m_lineHeight = lineHeight;
+				style.background = renderOpts.m_codeBackground;
+			}
 				break;
 
 			case MD::ItemType::Link :
-				drawLink( pdfData, renderOpts, static_cast< MD::Link* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw );
+			{
+				auto * l = static_cast< MD::Link* > ( it->data() );
+
+				style.link = l;
+				style.url = l->url();
+
+				const auto lit = doc->labeledLinks().constFind( style.url );
+
+				if( lit != doc->labeledLinks().constEnd() )
+					style.url = lit.value()->url();
+
+				if( l->img()->isEmpty() )
+				{
+					auto * f = createFont( renderOpts.m_textFont,
+						l->textOptions() & MD::TextOption::BoldText,
+						l->textOptions() & MD::TextOption::ItalicText, renderOpts.m_textFontSize,
+						pdfData.doc );
+
+					const bool urlAsText = l->text().isEmpty();
+
+					run.m_text = ( urlAsText ? style.url : l->text() );
+					run.m_words = ( urlAsText ? MD::splitWords( style.url ) : l->words() );
+					run.m_font = fontId( fonts, f, renderOpts.m_textFontSize,
+						l->textOptions() & MD::TextOption::StrikethroughText );
+					run.m_spaceFont = textFont;
+					run.m_lineHeight = f->GetFontMetrics()->GetLineSpacing();
+					style.color = renderOpts.m_linkColor;
+				}
+				else
+				{
+					run.m_type = LayoutRun::Type::Image;
+					run.m_lineHeight = lineHeight;
+					style.image = l->img().data();
+				}
+			}
 				break;
 
 			case MD::ItemType::Image :
-				drawImage( pdfData, renderOpts, static_cast< MD::Image* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw );
+			{
+				run.m_type = LayoutRun::Type::Image;
+				run.m_lineHeight = lineHeight;
+				style.image = static_cast< MD::Image* > ( it->data() );
+			}
 				break;
 
 			case MD::ItemType::LineBreak :
 			{
-				cw.append( { 0.0, false, true, false, "" } );
-				pdfData.coords.x = pdfData.coords.margins.left + offset;
+				run.m_type = LayoutRun::Type::LineBreak;
+				run.m_lineHeight = lineHeight;
 			}
 				break;
 
 			default :
-				break;
+				continue;
 		}
+
+		runs.append( run );
+		styles.append( style );
 	}
 
-	cw.append( { 0.0, false, true, false, "" } );
+	// Paragraph is laid out at once, then the lines are painted.
+	ParagraphLayout layout;
+	layout.setBreaking( renderOpts.m_totalFitBreaking ? ParagraphLayout::Breaking::TotalFit :
+		ParagraphLayout::Breaking::Greedy );
 
-	cw.calcScale( pdfData.coords.pageWidth - pdfData.coords.margins.left -
-		pdfData.coords.margins.right - offset );
+	if( !m_hyphenator.isEmpty() )
+		layout.setHyphenator( &m_hyphenator );
 
-	cw.setDrawing();
+	Metrics metrics( this, fonts );
 
-	newLine = false;
-	pdfData.coords.y = y;
-	pdfData.coords.x = pdfData.coords.margins.left + offset;
+	layout.layout( runs, pdfData.coords.pageWidth - pdfData.coords.margins.left -
+		pdfData.coords.margins.right - offset, metrics );
 
-	for( auto it = item->items().begin(), last = item->items().end(); it != last; ++it )
+	QVector< QVector< QPair< QRectF, int > > > rects( runs.size() );
+
+	const auto & lines = layout.lines();
+
+	for( int l = 0; l < lines.size(); ++l )
 	{
 		{
 			QMutexLocker lock( &m_mutex );
@@ -918,144 +852,212 @@ PdfRenderer::drawParagraph( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 				return QVector< WhereDrawn > ();
 		}
 
-		switch( (*it)->type() )
+		const auto & line = lines.at( l );
+
+		if( line.m_image > -1 )
 		{
-			case MD::ItemType::Text :
-				rects.append( drawText( pdfData, renderOpts, static_cast< MD::Text* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw ) );
-				break;
+			rects[ line.m_image ].append( drawImage( pdfData, renderOpts,
+				styles.at( line.m_image ).image, doc, offset, l == 0 ) );
 
-			case MD::ItemType::Code :
-				rects.append( drawInlinedCode( pdfData, renderOpts, static_cast< MD::Code* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw ) );
-				break;
+			continue;
+		}
 
-			case MD::ItemType::Link :
-				rects.append(drawLink( pdfData, renderOpts, static_cast< MD::Link* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw ) );
-				break;
+		// Image moves to the next line by itself.
+		if( l > 0 && lines.at( l - 1 ).m_image < 0 )
+			moveToNewLine( pdfData, offset, lines.at( l - 1 ).m_height );
 
-			case MD::ItemType::Image :
-				rects.append( drawImage( pdfData, renderOpts, static_cast< MD::Image* > ( it->data() ),
-					doc, newLine, offset, it == item->items().begin(), &cw ) );
-				break;
+		for( int b = line.m_first, lastBox = line.m_first + line.m_count; b < lastBox; ++b )
+		{
+			const auto & box = layout.boxes().at( b );
+			const auto & run = runs.at( box.m_run );
+			const auto & style = styles.at( box.m_run );
+			const auto & f = fonts.at( box.m_leading ? run.m_spaceFont : run.m_font );
 
-			case MD::ItemType::LineBreak :
-				moveToNewLine( pdfData, offset, lineHeight );
-				break;
+			f.font->SetFontSize( f.size );
+			f.font->SetStrikeOut( f.strikeout );
 
-			default :
-				break;
+			const auto x = pdfData.coords.margins.left + offset + box.m_x;
+
+			if( style.background.isValid() && !box.m_leading )
+			{
+				pdfData.painter->Save();
+				pdfData.painter->SetColor( style.background.redF(),
+					style.background.greenF(), style.background.blueF() );
+				pdfData.painter->Rectangle( x, pdfData.coords.y +
+					f.font->GetFontMetrics()->GetDescent(), box.m_width,
+					f.font->GetFontMetrics()->GetLineSpacing() );
+				pdfData.painter->Fill();
+				pdfData.painter->Restore();
+			}
+
+			pdfData.painter->Save();
+
+			if( style.color.isValid() )
+				pdfData.painter->SetColor( style.color.redF(),
+					style.color.greenF(), style.color.blueF() );
+
+			pdfData.painter->SetFont( f.font );
+
+			if( box.m_word > -1 )
+				pdfData.painter->DrawText( x, pdfData.coords.y,
+					createPdfString( ParagraphLayout::text( run, box ) ) );
+			else
+			{
+				f.font->SetFontScale( line.m_scale );
+
+				pdfData.painter->DrawText( x, pdfData.coords.y, " " );
+
+				f.font->SetFontScale( 100.0 );
+			}
+
+			pdfData.painter->Restore();
+
+			rects[ box.m_run ].append( qMakePair( QRectF( x, pdfData.coords.y,
+				box.m_width, run.m_lineHeight ), pdfData.currentPageIdx ) );
 		}
 	}
 
-	return toWhereDrawn( normalizeRects( rects ), pdfData.coords.pageHeight );
+	QVector< QPair< QRectF, int > > ret;
+
+	for( int r = 0; r < runs.size(); ++r )
+	{
+		if( styles.at( r ).link )
+			addLink( pdfData, styles.at( r ).link, styles.at( r ).url,
+				normalizeRects( rects.at( r ) ) );
+
+		ret.append( rects.at( r ) );
+	}
+
+	return toWhereDrawn( normalizeRects( ret ), pdfData.coords.pageHeight );
 }
 
-QPair< QRectF, int >
-PdfRenderer::drawImage( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	MD::Image * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-	bool firstInParagraph, CustomWidth * cw )
+int
+PdfRenderer::fontId( QVector< FontUse > & fonts, PdfFont * font, float size, bool strikeout )
 {
-	Q_UNUSED( doc )
+	for( int i = 0; i < fonts.size(); ++i )
+	{
+		if( fonts.at( i ).font == font && fonts.at( i ).size == size &&
+			fonts.at( i ).strikeout == strikeout )
+		{
+			return i;
+		}
+	}
 
-	bool draw = true;
+	fonts.append( { font, size, strikeout } );
 
-	if( cw && !cw->isDrawing() )
-		draw = false;
+	return fonts.size() - 1;
+}
 
-	if( draw )
+void
+PdfRenderer::addLink( PdfAuxData & pdfData, MD::Link * item, const QString & url,
+	const QVector< QPair< QRectF, int > > & rects )
+{
+	if( !QUrl( url ).isRelative() )
 	{
-		emit status( tr( "Loading image." ) );
+		for( const auto & r : rects )
+		{
+			auto * annot = pdfData.doc->GetPage( r.second )->CreateAnnotation( ePdfAnnotation_Link,
+				PdfRect( r.first.x(), r.first.y(), r.first.width(), r.first.height() ) );
+			annot->SetBorderStyle( 0.0, 0.0, 0.0 );
 
-		const auto img = loadImage( item );
+			PdfAction action( ePdfAction_URI, pdfData.doc );
+			action.SetURI( PdfString( url.toLatin1().data() ) );
 
-		if( !img.isNull() )
-		{
-			QByteArray data;
-			QBuffer buf( &data );
+			annot->SetAction( action );
+			annot->SetFlags( ePdfAnnotationFlags_NoZoom );
+		}
+	}
+	else
+		m_unresolvedLinks.append( qMakePair( item->targetId(), rects ) );
+}
 
-			img.save( &buf, "jpg" );
+QPair< QRectF, int >
+PdfRenderer::drawImage( PdfAuxData & pdfData, const RenderOpts & renderOpts,
+	MD::Image * item, QSharedPointer< MD::Document > doc, double offset,
+	bool firstInParagraph )
+{
+	Q_UNUSED( doc )
 
-			PdfImage pdfImg( pdfData.doc );
-			pdfImg.LoadFromData( reinterpret_cast< unsigned char * >( data.data() ), data.size() );
+	emit status( tr( "Loading image." ) );
 
-			newLine = true;
+	const auto img = loadImage( item );
 
-			auto * font = createFont( renderOpts.m_textFont, false, false,
-				renderOpts.m_textFontSize, pdfData.doc );
+	if( !img.isNull() )
+	{
+		QByteArray data;
+		QBuffer buf( &data );
 
-			const auto lineHeight = font->GetFontMetrics()->GetLineSpacing();
+		img.save( &buf, "jpg" );
 
-			if( !firstInParagraph )
-				moveToNewLine( pdfData, offset, lineHeight, 1.0 );
-			else
-				pdfData.coords.x += offset;
+		PdfImage pdfImg( pdfData.doc );
+		pdfImg.LoadFromData( reinterpret_cast< unsigned char * >( data.data() ), data.size() );
 
-			double x = 0.0;
-			double scale = 1.0;
-			const double availableWidth = pdfData.coords.pageWidth - pdfData.coords.margins.left -
-				pdfData.coords.margins.right - offset;
-			double availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
+		auto * font = createFont( renderOpts.m_textFont, false, false,
+			renderOpts.m_textFontSize, pdfData.doc );
 
-			if( pdfImg.GetWidth() > availableWidth )
-				scale = availableWidth / pdfImg.GetWidth();
+		const auto lineHeight = font->GetFontMetrics()->GetLineSpacing();
 
-			const double pageHeight = pdfData.coords.pageHeight - pdfData.coords.margins.top -
-				pdfData.coords.margins.bottom;
+		if( !firstInParagraph )
+			moveToNewLine( pdfData, offset, lineHeight, 1.0 );
+		else
+			pdfData.coords.x += offset;
 
-			if( pdfImg.GetHeight() * scale > pageHeight )
-			{
-				scale = pageHeight / ( pdfImg.GetHeight() * scale );
+		double x = 0.0;
+		double scale = 1.0;
+		const double availableWidth = pdfData.coords.pageWidth - pdfData.coords.margins.left -
+			pdfData.coords.margins.right - offset;
+		double availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
 
-				pdfData.painter->FinishPage();
+		if( pdfImg.GetWidth() > availableWidth )
+			scale = availableWidth / pdfImg.GetWidth();
 
-				createPage( pdfData );
+		const double pageHeight = pdfData.coords.pageHeight - pdfData.coords.margins.top -
+			pdfData.coords.margins.bottom;
 
-				availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
+		if( pdfImg.GetHeight() * scale > pageHeight )
+		{
+			scale = pageHeight / ( pdfImg.GetHeight() * scale );
 
-				pdfData.coords.x += offset;
-			}
-			else if( pdfImg.GetHeight() * scale > availableHeight )
-			{
-				pdfData.painter->FinishPage();
+			pdfData.painter->FinishPage();
 
-				createPage( pdfData );
+			createPage( pdfData );
 
-				availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
+			availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
 
-				pdfData.coords.x += offset;
-			}
+			pdfData.coords.x += offset;
+		}
+		else if( pdfImg.GetHeight() * scale > availableHeight )
+		{
+			pdfData.painter->FinishPage();
 
-			if( pdfImg.GetWidth() * scale < availableWidth )
-				x = ( availableWidth - pdfImg.GetWidth() * scale ) / 2.0;
+			createPage( pdfData );
 
-			pdfData.painter->DrawImage( pdfData.coords.x + x,
-				pdfData.coords.y - pdfImg.GetHeight() * scale,
-				&pdfImg, scale, scale );
+			availableHeight = pdfData.coords.y - pdfData.coords.margins.bottom;
 
-			pdfData.coords.y -= pdfImg.GetHeight() * scale;
+			pdfData.coords.x += offset;
+		}
 
-			QRectF r( pdfData.coords.x + x, pdfData.coords.y,
-				pdfImg.GetWidth() * scale, pdfImg.GetHeight() * scale );
+		if( pdfImg.GetWidth() * scale < availableWidth )
+			x = ( availableWidth - pdfImg.GetWidth() * scale ) / 2.0;
 
-			moveToNewLine( pdfData, offset, lineHeight, 1.0 );
+		pdfData.painter->DrawImage( pdfData.coords.x + x,
+			pdfData.coords.y - pdfImg.GetHeight() * scale,
+			&pdfImg, scale, scale );
 
-			return qMakePair( r, pdfData.currentPageIdx );
-		}
-		else
-			throw PdfRendererError( tr( "Unable to load image: %1.\n\n"
-				"If this image is in Web, please be sure you are connected to the Internet. I'm "
-				"sorry for the inconvenience." )
-					.arg( item->url() ) );
-	}
-	else
-	{
-		pdfData.coords.x = pdfData.coords.margins.left + offset;
-		cw->append( { 0.0, false, true, false, "" } );
+		pdfData.coords.y -= pdfImg.GetHeight() * scale;
+
+		QRectF r( pdfData.coords.x + x, pdfData.coords.y,
+			pdfImg.GetWidth() * scale, pdfImg.GetHeight() * scale );
+
+		moveToNewLine( pdfData, offset, lineHeight, 1.0 );
 
-		return qMakePair( QRectF(), pdfData.currentPageIdx );
+		return qMakePair( r, pdfData.currentPageIdx );
 	}
+	else
+		throw PdfRendererError( tr( "Unable to load image: %1.\n\n"
+			"If this image is in Web, please be sure you are connected to the Internet. I'm "
+			"sorry for the inconvenience." )
+				.arg( item->url() ) );
 }
 
 //
@@ -1507,14 +1509,18 @@ PdfRenderer::maxListNumberWidth( MD::List * list ) const
 
 QVector< QVector< PdfRenderer::CellData > >
 PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-	MD::Table * item, QSharedPointer< MD::Document > doc )
+	MD::Table * item, QSharedPointer< MD::Document > doc, int firstRow, int lastRow )
 {
 	const auto columnsCount = item->columnsCount();
 
 	QVector< QVector< CellData > > auxTable;
 	auxTable.resize( columnsCount );
 
-	for( auto rit = item->rows().cbegin(), rlast = item->rows().cend(); rit != rlast; ++rit )
+	for( auto it = auxTable.begin(), last = auxTable.end(); it != last; ++it )
+		it->reserve( lastRow - firstRow );
+
+	for( auto rit = item->rows().cbegin() + firstRow, rlast = item->rows().cbegin() + lastRow;
+		rit != rlast; ++rit )
 	{
 		int i = 0;
 
@@ -1539,17 +1545,14 @@ PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts
 							t->opts() & MD::TextOption::ItalicText,
 							renderOpts.m_textFontSize, pdfData.doc );
 
-						if( t->opts() & MD::TextOption::StrikethroughText )
-							font->SetStrikeOut( true );
-
-						const auto words = t->text().split( QLatin1Char( ' ' ),
-							QString::SkipEmptyParts );
-
-						for( const auto & w : words )
+						for( const auto & w : t->words() )
 						{
 							CellItem item;
-							item.word = w;
+							item.word = t->text().mid( w.first, w.second );
 							item.font = font;
+							item.fontSize = renderOpts.m_textFontSize;
+							item.textWidth = stringWidth( font, item.word );
+							item.strikeout = t->opts() & MD::TextOption::StrikethroughText;
 
 							data.items.append( item );
 						}
@@ -1563,14 +1566,13 @@ PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts
 						auto * font = createFont( renderOpts.m_codeFont, false, false,
 							renderOpts.m_codeFontSize, pdfData.doc );
 
-						const auto words = c->text().split( QLatin1Char( ' ' ),
-							QString::SkipEmptyParts );
-
-						for( const auto & w : words )
+						for( const auto & w : c->words() )
 						{
 							CellItem item;
-							item.word = w;
+							item.word = c->text().mid( w.first, w.second );
 							item.font = font;
+							item.fontSize = renderOpts.m_codeFontSize;
+							item.textWidth = stringWidth( font, item.word );
 							item.background = renderOpts.m_codeBackground;
 
 							data.items.append( item );
@@ -1587,34 +1589,35 @@ PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts
 							l->textOptions() & MD::TextOption::ItalicText,
 							renderOpts.m_textFontSize, pdfData.doc );
 
-						if( l->textOptions() & MD::TextOption::StrikethroughText )
-							font->SetStrikeOut( true );
-
 						QString url = l->url();
 
-						if( doc->labeledLinks().contains( url ) )
-							url = doc->labeledLinks()[ url ]->url();
+						const auto lit = doc->labeledLinks().constFind( url );
+
+						if( lit != doc->labeledLinks().constEnd() )
+							url = lit.value()->url();
 
 						if( !l->img()->isEmpty() )
 						{
 							CellItem item;
 							item.image = loadImage( l->img().data() );
 							item.url = url;
+							item.targetId = l->targetId();
 
 							data.items.append( item );
 						}
 						else if( !l->text().isEmpty() )
 						{
-							const auto words = l->text().split( QLatin1Char( ' ' ),
-								QString::SkipEmptyParts );
-
-							for( const auto & w : words )
+							for( const auto & w : l->words() )
 							{
 								CellItem item;
-								item.word = w;
+								item.word = l->text().mid( w.first, w.second );
 								item.font = font;
+								item.fontSize = renderOpts.m_textFontSize;
+								item.textWidth = stringWidth( font, item.word );
 								item.url = url;
+								item.targetId = l->targetId();
 								item.color = renderOpts.m_linkColor;
+								item.strikeout = l->textOptions() & MD::TextOption::StrikethroughText;
 
 								data.items.append( item );
 							}
@@ -1623,8 +1626,12 @@ PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts
 						{
 							CellItem item;
 							item.font = font;
+							item.fontSize = renderOpts.m_textFontSize;
 							item.url = url;
+							item.targetId = l->targetId();
+							item.textWidth = stringWidth( font, url );
 							item.color = renderOpts.m_linkColor;
+							item.strikeout = l->textOptions() & MD::TextOption::StrikethroughText;
 
 							data.items.append( item );
 						}
@@ -1656,7 +1663,12 @@ PdfRenderer::createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts
 		}
 
 		for( ; i < columnsCount; ++i )
-			auxTable[ i ].append( CellData() );
+		{
+			CellData data;
+			data.alignment = item->columnAlignment( i );
+
+			auxTable[ i ].append( data );
+		}
 	}
 
 	return auxTable;
@@ -1705,27 +1717,64 @@ PdfRenderer::drawTable( PdfAuxData & pdfData, const RenderOpts & renderOpts,
 	const auto lineHeight = font->GetFontMetrics()->GetLineSpacing();
 	const auto spaceWidth = font->GetFontMetrics()->StringWidth( PdfString( " " ) );
 
-	auto auxTable = createAuxTable( pdfData, renderOpts, item, doc );
+	const int rowsCount = item->rows().size();
+
+	if( !item->columnsCount() || !rowsCount )
+		return ret;
+
+	const auto pageHeight = pdfData.coords.pageHeight -
+		pdfData.coords.margins.top - pdfData.coords.margins.bottom;
+
+	// Header is kept for the whole table to repeat it on every page the table continues on,
+	// body rows are prepared and drawn by chunks, so memory doesn't depend on count of rows.
+	auto header = createAuxTable( pdfData, renderOpts, item, doc, 0, 1 );
+	calculateCellsSize( pdfData, header, spaceWidth, offset, lineHeight );
 
-	calculateCellsSize( pdfData, auxTable, spaceWidth, offset, lineHeight );
+	const auto r0h = rowHeight( header, 0 ) + c_tableMargin * 2.0;
 
-	const auto r0h = rowHeight( auxTable, 0 );
-	const auto r1h = rowHeight( auxTable, 1 );
+	auto chunk = createAuxTable( pdfData, renderOpts, item, doc, 1,
+		qMin( 1 + c_tableRowsChunk, rowsCount ) );
+	calculateCellsSize( pdfData, chunk, spaceWidth, offset, lineHeight );
 
-	if( pdfData.coords.y - ( r0h + r1h + c_tableMargin * 4.0 ) < pdfData.coords.margins.bottom )
+	const auto r1h = ( chunk[ 0 ].isEmpty() ? 0.0 : rowHeight( chunk, 0 ) + c_tableMargin * 2.0 );
+
+	if( pdfData.coords.y - ( r0h + r1h ) < pdfData.coords.margins.bottom )
 	{
-		if( r0h + r1h + c_tableMargin * 4.0 <= pdfData.coords.pageHeight -
-			pdfData.coords.margins.top - pdfData.coords.margins.bottom )
-		{
+		if( r0h + r1h <= pageHeight )
 			createPage( pdfData );
-		}
 	}
 
 	moveToNewLine( pdfData, offset, lineHeight, 1.0 );
 
-	for( int row = 0; row < auxTable[ 0 ].size(); ++row )
-		ret.append( drawTableRow( auxTable, row, pdfData, offset, lineHeight, renderOpts,
-			doc ) );
+	ret.append( drawTableRow( header, 0, pdfData, offset, lineHeight, renderOpts, doc ) );
+
+	for( int first = 1; first < rowsCount; first += c_tableRowsChunk )
+	{
+		if( first > 1 )
+		{
+			chunk = createAuxTable( pdfData, renderOpts, item, doc, first,
+				qMin( first + c_tableRowsChunk, rowsCount ) );
+			calculateCellsSize( pdfData, chunk, spaceWidth, offset, lineHeight );
+		}
+
+		for( int row = 0; row < chunk[ 0 ].size(); ++row )
+		{
+			const auto h = rowHeight( chunk, row ) + c_tableMargin * 2.0;
+
+			// Row that doesn't fit the rest of the page but fits a new one goes to the
+			// next page under repeated header, huge rows are split between pages as before.
+			if( pdfData.coords.y - h < pdfData.coords.margins.bottom && r0h + h <= pageHeight )
+			{
+				createPage( pdfData );
+
+				ret.append( drawTableRow( header, 0, pdfData, offset, lineHeight,
+					renderOpts, doc ) );
+			}
+
+			ret.append( drawTableRow( chunk, row, pdfData, offset, lineHeight, renderOpts,
+				doc ) );
+		}
+	}
 
 	return ret;
 }
@@ -1735,6 +1784,8 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 	double offset, double lineHeight, const RenderOpts & renderOpts,
 	QSharedPointer< MD::Document > doc )
 {
+	Q_UNUSED( doc )
+
 	QVector< WhereDrawn > ret;
 
 	{
@@ -1746,8 +1797,11 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 
 	emit status( tr( "Drawing table row." ) );
 
+	// Metrics of the text font are taken at once, cells resize the shared font object.
 	auto * font = createFont( renderOpts.m_textFont, false, false, renderOpts.m_textFontSize,
 		pdfData.doc );
+	const auto spaceWidth = font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+	const auto descent = font->GetFontMetrics()->GetDescent();
 
 	const auto startPage = pdfData.currentPageIdx;
 	const auto startY = pdfData.coords.y;
@@ -1756,7 +1810,7 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 	int currentPage = startPage;
 
 	TextToDraw text;
-	QMap< QString, QVector< QPair< QRectF, int > > > links;
+	QMap< QString, TableLink > links;
 
 	int column = 0;
 
@@ -1802,8 +1856,8 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 		for( auto c = it->at( row ).items.cbegin(), clast = it->at( row ).items.cend(); c != clast; ++c )
 		{
 			if( !c->image.isNull() && !text.text.isEmpty() )
-				drawTextLineInTable( x, y, text, lineHeight, pdfData, links, font, currentPage,
-					endPage, endY );
+				drawTextLineInTable( x, y, text, lineHeight, pdfData, links, spaceWidth,
+					currentPage, endPage, endY );
 
 			if( !c->image.isNull() )
 			{
@@ -1850,16 +1904,15 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 			}
 			else
 			{
-				const auto w = c->font->GetFontMetrics()->StringWidth(
-					createPdfString( c->word.isEmpty() ? c->url : c->word ) );
+				const auto w = c->width();
 				double s = 0.0;
 
 				if( !text.text.isEmpty() )
 				{
-					if( text.text.last().font == c->font )
-						s = c->font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+					if( text.text.last().sameFont( *c ) )
+						s = c->sizedFont()->GetFontMetrics()->StringWidth( PdfString( " " ) );
 					else
-						s = font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+						s = spaceWidth;
 				}
 
 				if( text.width + s + w <= it->at( 0 ).width )
@@ -1872,7 +1925,7 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 					if( !text.text.isEmpty() )
 					{
 						drawTextLineInTable( x, y, text, lineHeight, pdfData, links,
-							font, currentPage, endPage, endY );
+							spaceWidth, currentPage, endPage, endY );
 						text.text.append( *c );
 						text.width += w;
 					}
@@ -1881,7 +1934,7 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 						text.text.append( *c );
 						text.width += w;
 						drawTextLineInTable( x, y, text, lineHeight, pdfData, links,
-							font, currentPage, endPage, endY  );
+							spaceWidth, currentPage, endPage, endY  );
 					}
 				}
 
@@ -1890,10 +1943,10 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 		}
 
 		if( !text.text.isEmpty() )
-			drawTextLineInTable( x, y, text, lineHeight, pdfData, links, font, currentPage,
-				endPage, endY );
+			drawTextLineInTable( x, y, text, lineHeight, pdfData, links, spaceWidth,
+				currentPage, endPage, endY );
 
-		y -= c_tableMargin - font->GetFontMetrics()->GetDescent();
+		y -= c_tableMargin - descent;
 
 		if( y < endY  && currentPage == pdfData.currentPageIdx )
 			endY = y;
@@ -1906,7 +1959,7 @@ PdfRenderer::drawTableRow( QVector< QVector< CellData > > & table, int row, PdfA
 	pdfData.coords.y = endY;
 	pdfData.painter->SetPage( pdfData.doc->GetPage( pdfData.currentPageIdx ) );
 
-	processLinksInTable( pdfData, links, doc );
+	processLinksInTable( pdfData, links );
 
 	return ret;
 }
@@ -2006,8 +2059,8 @@ PdfRenderer::drawTableBorder( PdfAuxData & pdfData, int startPage, QVector< Wher
 
 void
 PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, double lineHeight,
-	PdfAuxData & pdfData, QMap< QString, QVector< QPair< QRectF, int > > > & links,
-	PdfFont * font, int & currentPage, int & endPage, double & endY )
+	PdfAuxData & pdfData, QMap< QString, TableLink > & links,
+	double spaceWidth, int & currentPage, int & endPage, double & endY )
 {
 	y -= lineHeight;
 
@@ -2043,7 +2096,7 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 
 		double w = 0.0;
 
-		auto * fm = text.text.first().font->GetFontMetrics();
+		auto * fm = text.text.first().sizedFont()->GetFontMetrics();
 
 		for( const auto & ch : str )
 		{
@@ -2056,10 +2109,13 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 		}
 
 		text.text.first().word = res;
+		text.text.first().textWidth = stringWidth( text.text.first().sizedFont(), res );
 	}
 
 	for( auto it = text.text.cbegin(), last = text.text.cend(); it != last; ++it )
 	{
+		auto * font = it->sizedFont();
+
 		if( it->background.isValid() )
 		{
 			pdfData.painter->Save();
@@ -2068,8 +2124,8 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 				it->background.greenF(),
 				it->background.redF() );
 
-			pdfData.painter->Rectangle( x, y + it->font->GetFontMetrics()->GetDescent(),
-				it->width(), it->font->GetFontMetrics()->GetLineSpacing() );
+			pdfData.painter->Rectangle( x, y + font->GetFontMetrics()->GetDescent(),
+				it->width(), font->GetFontMetrics()->GetLineSpacing() );
 
 			pdfData.painter->Fill();
 
@@ -2082,15 +2138,20 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 			pdfData.painter->SetColor( it->color.redF(),
 				it->color.greenF(), it->color.blueF() );
 
-		pdfData.painter->SetFont( it->font );
+		font->SetStrikeOut( it->strikeout );
+		pdfData.painter->SetFont( font );
 		pdfData.painter->DrawText( x, y, createPdfString( it->word.isEmpty() ?
 			it->url : it->word ) );
 
 		pdfData.painter->Restore();
 
 		if( !it->url.isEmpty() )
-			links[ it->url ].append( qMakePair( QRectF( x, y, it->width(), lineHeight ),
+		{
+			auto & link = links[ it->url ];
+			link.targetId = it->targetId;
+			link.rects.append( qMakePair( QRectF( x, y, it->width(), lineHeight ),
 				currentPage ) );
+		}
 
 		x += it->width();
 
@@ -2098,7 +2159,7 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 		{
 			auto tmpX = x;
 
-			if( it->background.isValid() && it->font == ( it + 1 )->font )
+			if( it->background.isValid() && it->sameFont( *( it + 1 ) ) )
 			{
 				pdfData.painter->Save();
 
@@ -2106,10 +2167,10 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 					it->background.greenF(),
 					it->background.redF() );
 
-				const auto sw = it->font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+				const auto sw = font->GetFontMetrics()->StringWidth( PdfString( " " ) );
 
-				pdfData.painter->Rectangle( x, y + it->font->GetFontMetrics()->GetDescent(),
-					sw, it->font->GetFontMetrics()->GetLineSpacing() );
+				pdfData.painter->Rectangle( x, y + font->GetFontMetrics()->GetDescent(),
+					sw, font->GetFontMetrics()->GetLineSpacing() );
 
 				x += sw;
 
@@ -2118,10 +2179,10 @@ PdfRenderer::drawTextLineInTable( double x, double & y, TextToDraw & text, doubl
 				pdfData.painter->Restore();
 			}
 			else
-				x += font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+				x += spaceWidth;
 
 			if( !( it + 1 )->url.isEmpty() && it->url == ( it + 1 )->url )
-				links[ it->url ].append( qMakePair( QRectF( tmpX, y, x - tmpX, lineHeight ),
+				links[ it->url ].rects.append( qMakePair( QRectF( tmpX, y, x - tmpX, lineHeight ),
 					currentPage ) );
 		}
 	}
@@ -2155,17 +2216,13 @@ PdfRenderer::newPageInTable( PdfAuxData & pdfData, int & currentPage, int & endP
 
 void
 PdfRenderer::processLinksInTable( PdfAuxData & pdfData,
-	const QMap< QString, QVector< QPair< QRectF, int > > > & links,
-	QSharedPointer< MD::Document > doc )
+	const QMap< QString, TableLink > & links )
 {
+	// URLs of labeled links are resolved when cells are prepared.
 	for( auto it = links.cbegin(), last = links.cend(); it != last; ++it )
 	{
-		QString url = it.key();
-
-		if( doc->labeledLinks().contains( url ) )
-			url = doc->labeledLinks()[ url ]->url();
-
-		auto tmp = it.value();
+		const auto & url = it.key();
+		const auto & tmp = it.value().rects;
 
 		if( !tmp.isEmpty() )
 		{
@@ -2205,7 +2262,7 @@ PdfRenderer::processLinksInTable( PdfAuxData & pdfData,
 				}
 			}
 			else
-				m_unresolvedLinks.insert( url, rects );
+				m_unresolvedLinks.append( qMakePair( it.value().targetId, rects ) );
 		}
 	}
 }
@@ -25,11 +25,14 @@
 
 // md-pdf include.
 #include "md_doc.hpp"
+#include "font_store.hpp"
+#include "layout.hpp"
 
 // Qt include.
 #include <QColor>
 #include <QObject>
 #include <QMutex>
+#include <QHash>
 #include <QImage>
 #include <QNetworkReply>
 
@@ -57,6 +60,10 @@ struct RenderOpts
 	double m_right;
 	double m_top;
 	double m_bottom;
+	//! Break lines of paragraphs with total-fit (Knuth-Plass) algorithm, not greedy.
+	bool m_totalFitBreaking = false;
+	//! File of TeX hyphenation patterns, words aren't hyphenated if it's empty.
+	QString m_hyphenationPatterns;
 }; // struct RenderOpts
 
 
@@ -91,6 +98,8 @@ static const double c_beforeHeading = 15.0;
 static const double c_blockquoteBaseOffset = 10.0;
 static const double c_blockquoteMarkWidth = 3.0;
 static const double c_tableMargin = 2.0;
+//! Count of rows of the table prepared for drawing at once.
+static const int c_tableRowsChunk = 64;
 
 struct PageMargins {
 	double left = c_margin;
@@ -147,21 +156,40 @@ public slots:
 	//! Terminate rendering.
 	void terminate();
 
+public:
+	//! Render document synchronously in the calling thread, no event loop is needed.
+	//! \note Unlike render() renderer is not deleted after rendering.
+	void renderSync( const QString & fileName, QSharedPointer< MD::Document > doc,
+		const RenderOpts & opts );
+	//! Set storage of fonts shared with another renderers. Store should
+	//! outlive rendering. By default all renderers share one store of the process.
+	void setFontStore( FontStore * store );
+	//! \return Count of pages in the last rendered PDF.
+	int pagesCount() const;
+
 private slots:
-	void renderImpl();
+	void renderAsync();
 	void clean() override;
 
 private:
+	void renderImpl();
 	PdfFont * createFont( const QString & name, bool bold, bool italic, float size,
 		PdfMemDocument * doc );
 	void createPage( PdfAuxData & pdfData );
 	static PdfString createPdfString( const QString & text );
+	static PdfString createPdfString( const QStringRef & text );
 	static QString createQString( const PdfString & str );
+	//! \return Width of the string drawn with the font, the same as
+	//! StringWidth() of metrics of the font, but memoised.
+	double stringWidth( PdfFont * font, const QStringRef & str );
+	double stringWidth( PdfFont * font, const QString & str );
 
 	void moveToNewLine( PdfAuxData & pdfData, double xOffset, double yOffset,
 		double yOffsetMultiplier = 1.0 );
 	QImage loadImage( MD::Image * item );
 	void resolveLinks( PdfAuxData & pdfData );
+	//! Set destination of the label with the given ID.
+	void addDest( int id, const PdfDestination & dest );
 	int maxListNumberWidth( MD::List * list ) const;
 
 	QVector< WhereDrawn > drawHeading( PdfAuxData & pdfData, const RenderOpts & renderOpts,
@@ -190,80 +218,44 @@ private:
 		MD::ListItem * item, QSharedPointer< MD::Document > doc, int & idx,
 		ListItemType & prevListItemType, int bulletWidth, double offset = 0.0 );
 
-	struct CustomWidth {
-		struct Width {
-			double width = 0.0;
-			bool isSpace = false;
-			bool isNewLine = false;
-			bool shrink = true;
-			QString word;
-		}; // struct Width
-
-		void append( const Width & w ) { m_width.append( w ); }
-		double scale() { return m_scale.at( m_pos ); }
-		void moveToNextLine() { ++m_pos; }
-		bool isDrawing() const { return m_drawing; }
-		void setDrawing( bool on = true ) { m_drawing = on; }
-
-		void calcScale( double lineWidth )
-		{
-			double w = 0.0;
-			double sw = 0.0;
-			double ww = 0.0;
-
-			for( int i = 0, last = m_width.size(); i < last; ++i )
-			{
-				w += m_width.at( i ).width;
-
-				if( m_width.at( i ).isSpace )
-					sw += m_width.at( i ).width;
-				else
-					ww += m_width.at( i ).width;
-
-				if( m_width.at( i ).isNewLine )
-				{
-					if( m_width.at( i ).shrink )
-					{
-						auto ss = ( lineWidth - w + sw ) / sw;
-
-						while( ww + sw * ss > lineWidth )
-							ss -= 0.001;
+	//! Font of the paragraph with size and strikeout it's drawn with.
+	struct FontUse {
+		PdfFont * font = nullptr;
+		float size = 0.0;
+		bool strikeout = false;
+	}; // struct FontUse
 
-						m_scale.append( 100.0 * ss );
-					}
-					else
-						m_scale.append( 100.0 );
+	//! Metrics of fonts of the paragraph for the layout, font ID is index of FontUse.
+	class Metrics final
+		:	public LayoutMetrics
+	{
+	public:
+		Metrics( PdfRenderer * renderer, const QVector< FontUse > & fonts );
 
-					w = 0.0;
-					sw = 0.0;
-					ww = 0.0;
-				}
-			}
-		}
+		double stringWidth( int font, const QStringRef & str ) override;
 
 	private:
-		bool m_drawing = false;
-		QVector< Width > m_width;
-		QVector< double > m_scale;
-		int m_pos = 0;
-	}; // struct CustomWidth
-
-	QVector< QPair< QRectF, int > > drawText( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		MD::Text * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset = 0.0,
-		bool firstInParagraph = false, CustomWidth * cw = nullptr );
-	QVector< QPair< QRectF, int > > drawInlinedCode( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		MD::Code * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-		bool firstInParagraph, CustomWidth * cw = nullptr );
-	QVector< QPair< QRectF, int > > drawString( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		const QString & str, PdfFont * spaceFont, PdfFont * font, double lineHeight,
-		QSharedPointer< MD::Document > doc, bool & newLine, double offset,
-		bool firstInParagraph, CustomWidth * cw = nullptr, const QColor & background = QColor() );
-	QVector< QPair< QRectF, int > > drawLink( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		MD::Link * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset = 0.0,
-		bool firstInParagraph = false, CustomWidth * cw = nullptr );
+		PdfRenderer * m_renderer;
+		const QVector< FontUse > & m_fonts;
+	}; // class Metrics
+
+	//! How the run of the paragraph is painted.
+	struct RunStyle {
+		QColor color;
+		QColor background;
+		MD::Link * link = nullptr;
+		QString url;
+		MD::Image * image = nullptr;
+	}; // struct RunStyle
+
+	//! \return Index of the font in \a fonts, font is appended if it's not there.
+	static int fontId( QVector< FontUse > & fonts, PdfFont * font, float size, bool strikeout );
+	//! Add annotations of the link drawn in the given rectangles.
+	void addLink( PdfAuxData & pdfData, MD::Link * item, const QString & url,
+		const QVector< QPair< QRectF, int > > & rects );
 	QPair< QRectF, int > drawImage( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		MD::Image * item, QSharedPointer< MD::Document > doc, bool & newLine, double offset = 0.0,
-		bool firstInParagraph = false, CustomWidth * cw = nullptr );
+		MD::Image * item, QSharedPointer< MD::Document > doc, double offset = 0.0,
+		bool firstInParagraph = false );
 
 	struct CellItem {
 		QString word;
@@ -272,18 +264,37 @@ private:
 		QColor color;
 		QColor background;
 		PdfFont * font = nullptr;
+		float fontSize = 0.0;
+		bool strikeout = false;
+		//! ID of the label the link targets, -1 if the link is external.
+		int targetId = -1;
+		//! Width of the word, or of URL without word, measured once.
+		double textWidth = 0.0;
 
 		double width() const
 		{
 			if( !word.isEmpty() )
-				return font->GetFontMetrics()->StringWidth( createPdfString( word ) );
+				return textWidth;
 			else if( !image.isNull() )
 				return image.width();
 			else if( !url.isEmpty() )
-				return font->GetFontMetrics()->StringWidth( createPdfString( url ) );
+				return textWidth;
 			else
 				return 0.0;
 		}
+
+		//! \return Font of the item set to its size, font object is shared by all sizes.
+		PdfFont * sizedFont() const
+		{
+			font->SetFontSize( fontSize );
+
+			return font;
+		}
+
+		bool sameFont( const CellItem & other ) const
+		{
+			return ( font == other.font && fontSize == other.fontSize );
+		}
 	}; // struct CellItem
 
 	struct CellData {
@@ -319,8 +330,8 @@ private:
 
 					double sw = spaceWidth;
 
-					if( it != items.cbegin() && it->font == ( it - 1 )->font )
-						sw = it->font->GetFontMetrics()->StringWidth( PdfString( " " ) );
+					if( it != items.cbegin() && it->sameFont( *( it - 1 ) ) )
+						sw = it->sizedFont()->GetFontMetrics()->StringWidth( PdfString( " " ) );
 
 					if( it + 1 != last )
 					{
@@ -342,6 +353,14 @@ private:
 		}
 	}; //  struct CellData
 
+	//! Link drawn in the table.
+	struct TableLink {
+		//! ID of the label the link targets, -1 if the link is external.
+		int targetId = -1;
+		//! Rectangles of the link and indexes of their pages.
+		QVector< QPair< QRectF, int > > rects;
+	}; // struct TableLink
+
 	double rowHeight( const QVector< QVector< CellData > > & table, int row )
 	{
 		double h = 0.0;
@@ -355,9 +374,10 @@ private:
 		return  h;
 	}
 
+	//! \return Cells of rows [firstRow, lastRow) of the table, column by column.
 	QVector< QVector< CellData > >
 	createAuxTable( PdfAuxData & pdfData, const RenderOpts & renderOpts,
-		MD::Table * item, QSharedPointer< MD::Document > doc );
+		MD::Table * item, QSharedPointer< MD::Document > doc, int firstRow, int lastRow );
 	void calculateCellsSize( PdfAuxData & pdfData, QVector< QVector< CellData > > & auxTable,
 		double spaceWidth, double offset, double lineHeight );
 	QVector< WhereDrawn > drawTableRow( QVector< QVector< CellData > > & table, int row,
@@ -383,13 +403,12 @@ private:
 	}; // struct TextToDraw
 
 	void drawTextLineInTable( double x, double & y, TextToDraw & text, double lineHeight,
-		PdfAuxData & pdfData, QMap< QString, QVector< QPair< QRectF, int > > > & links,
-		PdfFont * font, int & currentPage, int & endPage, double & endY );
+		PdfAuxData & pdfData, QMap< QString, TableLink > & links,
+		double spaceWidth, int & currentPage, int & endPage, double & endY );
 	void newPageInTable( PdfAuxData & pdfData, int & currentPage, int & endPage,
 		double & endY );
 	void processLinksInTable( PdfAuxData & pdfData,
-		const QMap< QString, QVector< QPair< QRectF, int > > > & links,
-		QSharedPointer< MD::Document > doc );
+		const QMap< QString, TableLink > & links );
 
 private:
 	QString m_fileName;
@@ -397,8 +416,28 @@ private:
 	RenderOpts m_opts;
 	QMutex m_mutex;
 	bool m_terminate;
-	QMap< QString, PdfDestination > m_dests;
-	QMultiMap< QString, QVector< QPair< QRectF, int > > > m_unresolvedLinks;
+	FontStore * m_fontStore;
+	//! Fonts of the current PDF by family and style, bold is 1 and italic is 2.
+	QHash< QPair< QString, int >, PdfFont* > m_fonts;
+
+	//! Widths of text of one font of one size.
+	struct Widths {
+		//! Widths of ASCII characters, most of words are measured with them.
+		QVector< double > m_ascii;
+		//! Widths of words with another characters.
+		QHash< QString, double > m_words;
+	}; // struct Widths
+
+	//! Widths of text by font and its size.
+	QHash< QPair< PdfFont*, float >, Widths > m_widths;
+	int m_pagesCount;
+	//! Destinations indexed by IDs of labels in the document.
+	QVector< QSharedPointer< PdfDestination > > m_dests;
+	//! Links to destinations with IDs of their labels.
+	QVector< QPair< int, QVector< QPair< QRectF, int > > > > m_unresolvedLinks;
+	//! Hyphenator with patterns of RenderOpts shared by all renderers,
+	//! words hyphenated by this renderer are memoised in it.
+	Hyphenator m_hyphenator;
 }; // class Renderer
 
 
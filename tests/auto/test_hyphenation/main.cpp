@@ -0,0 +1,226 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <md-pdf/hyphenation.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+// doctest include.
+#include <doctest/doctest.h>
+
+#include <QStringList>
+
+#include <random>
+
+
+//! \return Positions of hyphens in the word, found by every pattern straightforwardly.
+QVector< int >
+hyphenateNaive( const QStringList & patterns, const QString & word )
+{
+	const auto dotted = QStringLiteral( "." ) + word + QStringLiteral( "." );
+	QVector< int > values( dotted.size() + 1, 0 );
+
+	for( const auto & p : patterns )
+	{
+		QString letters;
+		QVector< int > v( 1, 0 );
+
+		for( const auto & c : p )
+		{
+			if( c.isDigit() )
+				v.last() = c.digitValue();
+			else
+			{
+				letters.append( c );
+				v.append( 0 );
+			}
+		}
+
+		for( int i = dotted.indexOf( letters ); i > -1; i = dotted.indexOf( letters, i + 1 ) )
+		{
+			for( int k = 0; k < v.size(); ++k )
+				values[ i + k ] = qMax( values.at( i + k ), v.at( k ) );
+		}
+	}
+
+	QVector< int > points;
+
+	for( int p = Hyphenator::c_leftMin; p <= word.size() - Hyphenator::c_rightMin; ++p )
+	{
+		if( values.at( p + 1 ) % 2 )
+			points.append( p );
+	}
+
+	return points;
+}
+
+
+TEST_CASE( "empty hyphenator" )
+{
+	Hyphenator h;
+
+	REQUIRE( h.isEmpty() );
+
+	const auto word = QStringLiteral( "hyphenation" );
+
+	REQUIRE( h.hyphenate( QStringRef( &word ) ).isEmpty() );
+	REQUIRE( !h.parse( QStringLiteral( "% Nothing here." ) ) );
+	REQUIRE( !h.load( QStringLiteral( "./absent.tex" ) ) );
+}
+
+TEST_CASE( "patterns from TeX file" )
+{
+	Hyphenator h;
+
+	REQUIRE( h.load( QStringLiteral( "./test.tex" ) ) );
+	REQUIRE( !h.isEmpty() );
+
+	const QString words[] = { QStringLiteral( "hyphenation" ),
+		QStringLiteral( "Hyphenation," ), QStringLiteral( "table" ),
+		QStringLiteral( "nation" ), QStringLiteral( "on" ),
+		QStringLiteral( "hyphenation_nation" ) };
+
+	const QVector< int > hyphenation = { 2, 6 };
+	const QVector< int > second = { 2 };
+	const QVector< int > identifier = { 2, 6, 14 };
+
+	REQUIRE( h.hyphenate( QStringRef( &words[ 0 ] ) ) == hyphenation );
+	REQUIRE( h.hyphenate( QStringRef( &words[ 1 ] ) ) == hyphenation );
+	REQUIRE( h.hyphenate( QStringRef( &words[ 2 ] ) ) == second );
+	REQUIRE( h.hyphenate( QStringRef( &words[ 3 ] ) ) == second );
+	REQUIRE( h.hyphenate( QStringRef( &words[ 4 ] ) ).isEmpty() );
+	REQUIRE( h.hyphenate( QStringRef( &words[ 5 ] ) ) == identifier );
+
+	// Memoised.
+	REQUIRE( h.hyphenate( QStringRef( &words[ 0 ] ) ) == hyphenation );
+}
+
+TEST_CASE( "pattern per line" )
+{
+	Hyphenator h;
+
+	REQUIRE( h.parse( QStringLiteral( ".hy3ph\nhe2n\nhena4\nhen5at\n1na\nn2at\n1tio\n2io\no2n\n" ) ) );
+
+	const auto word = QStringLiteral( "hyphenation" );
+
+	const QVector< int > hyphenation = { 2, 6 };
+
+	REQUIRE( h.hyphenate( QStringRef( &word ) ) == hyphenation );
+}
+
+TEST_CASE( "short exception" )
+{
+	Hyphenator h;
+
+	REQUIRE( h.parse( QStringLiteral( "\\patterns{ 1na }\n\\hyphenation{ o-ne }" ) ) );
+
+	const auto word = QStringLiteral( "One" );
+	const auto nana = QStringLiteral( "nana" );
+
+	const QVector< int > one = { 1 };
+
+	REQUIRE( h.hyphenate( QStringRef( &word ) ) == one );
+	REQUIRE( h.hyphenate( QStringRef( &nana ) ).isEmpty() );
+}
+
+TEST_CASE( "packed trie gives the same as patterns" )
+{
+	std::mt19937 gen( 2019 );
+	std::uniform_int_distribution< int > letter( 0, 5 );
+	std::uniform_int_distribution< int > digit( 0, 5 );
+	std::uniform_int_distribution< int > length( 1, 5 );
+
+	auto randomLetters = [&] ( int count )
+	{
+		QString s;
+
+		for( int i = 0; i < count; ++i )
+			s.append( QLatin1Char( static_cast< char > ( 'a' + letter( gen ) ) ) );
+
+		return s;
+	};
+
+	QStringList patterns;
+	QStringList letters;
+
+	while( patterns.size() < 1000 )
+	{
+		auto l = randomLetters( length( gen ) );
+
+		if( digit( gen ) == 0 )
+			l.prepend( QLatin1Char( '.' ) );
+
+		if( letters.contains( l ) )
+			continue;
+
+		QString p;
+
+		for( const auto & c : l )
+		{
+			const int d = digit( gen );
+
+			if( d > 0 )
+				p.append( QString::number( d ) );
+
+			p.append( c );
+		}
+
+		letters.append( l );
+		patterns.append( p );
+	}
+
+	Hyphenator h;
+
+	REQUIRE( h.parse( patterns.join( QLatin1Char( ' ' ) ) ) );
+
+	for( int i = 0; i < 1000; ++i )
+	{
+		const auto word = randomLetters( 3 + length( gen ) * 2 );
+
+		REQUIRE( h.hyphenate( QStringRef( &word ) ) == hyphenateNaive( patterns, word ) );
+	}
+}
+
+TEST_CASE( "store of patterns" )
+{
+	HyphenationStore store;
+
+	REQUIRE( store.hyphenator( QStringLiteral( "./absent.tex" ) ).isEmpty() );
+
+	auto first = store.hyphenator( QStringLiteral( "./test.tex" ) );
+	auto second = store.hyphenator( QStringLiteral( "./test.tex" ) );
+
+	REQUIRE( !first.isEmpty() );
+	REQUIRE( !second.isEmpty() );
+
+	const auto word = QStringLiteral( "hyphenation" );
+
+	const QVector< int > hyphenation = { 2, 6 };
+
+	REQUIRE( first.hyphenate( QStringRef( &word ) ) == hyphenation );
+
+	// Copy gets its own patterns on parsing, patterns of the store stay.
+	REQUIRE( !first.parse( QStringLiteral( "% Nothing here." ) ) );
+	REQUIRE( first.hyphenate( QStringRef( &word ) ).isEmpty() );
+	REQUIRE( second.hyphenate( QStringRef( &word ) ) == hyphenation );
+	REQUIRE( store.hyphenator( QStringLiteral( "./test.tex" ) ).hyphenate(
+		QStringRef( &word ) ) == hyphenation );
+}
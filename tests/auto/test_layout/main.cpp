@@ -0,0 +1,302 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <md-pdf/layout.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+// doctest include.
+#include <doctest/doctest.h>
+
+
+//
+// FixedMetrics
+//
+
+//! Every character of font N is N + 1 points wide.
+class FixedMetrics final
+	:	public LayoutMetrics
+{
+public:
+	double stringWidth( int font, const QStringRef & str ) override
+	{
+		++m_calls;
+
+		return str.length() * ( font + 1 );
+	}
+
+	int m_calls = 0;
+}; // class FixedMetrics
+
+//! \return Run of text.
+LayoutRun
+textRun( const QString & text, int font = 0 )
+{
+	LayoutRun run;
+	run.m_text = text;
+	run.m_words = MD::splitWords( text );
+	run.m_font = font;
+	run.m_spaceFont = 0;
+	run.m_lineHeight = 10.0;
+
+	return run;
+}
+
+//! \return Run of the given type without text.
+LayoutRun
+emptyRun( LayoutRun::Type type )
+{
+	LayoutRun run;
+	run.m_type = type;
+	run.m_lineHeight = 10.0;
+
+	return run;
+}
+
+//! \return Words of the line joined with spaces.
+QString
+lineText( const ParagraphLayout & layout, const QVector< LayoutRun > & runs, int idx )
+{
+	const auto & line = layout.lines().at( idx );
+
+	QString text;
+
+	for( int i = line.m_first; i < line.m_first + line.m_count; ++i )
+	{
+		const auto & box = layout.boxes().at( i );
+
+		text.append( ParagraphLayout::text( runs.at( box.m_run ), box ) );
+	}
+
+	return text;
+}
+
+//! \return Right edge of the last box of the line.
+double
+lineEnd( const ParagraphLayout & layout, int idx )
+{
+	const auto & line = layout.lines().at( idx );
+	const auto & box = layout.boxes().at( line.m_first + line.m_count - 1 );
+
+	return box.m_x + box.m_width;
+}
+
+
+TEST_CASE( "greedy breaking" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aaa bbb ccc ddd eee" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 8.0, metrics );
+
+	REQUIRE( layout.lines().size() == 3 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "aaa bbb" ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "ccc ddd" ) );
+	REQUIRE( lineText( layout, runs, 2 ) == QStringLiteral( "eee" ) );
+}
+
+TEST_CASE( "justified lines fill the width" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aa bb cc dd ee" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 10.0, metrics );
+
+	REQUIRE( layout.lines().size() == 2 );
+	REQUIRE( layout.lines().at( 0 ).m_scale > 100.0 );
+	REQUIRE( lineEnd( layout, 0 ) == doctest::Approx( 10.0 ) );
+	REQUIRE( layout.lines().at( 1 ).m_scale == 100.0 );
+	REQUIRE( lineEnd( layout, 1 ) == doctest::Approx( 5.0 ) );
+}
+
+TEST_CASE( "every word is measured once" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "a b c d e f g h" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 3.0, metrics );
+
+	// Words and one space of the run.
+	REQUIRE( metrics.m_calls == 9 );
+	REQUIRE( layout.lines().size() == 4 );
+}
+
+TEST_CASE( "no space before punctuation" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "word" ) ),
+		textRun( QStringLiteral( "bold" ), 1 ), textRun( QStringLiteral( ", end" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 100.0, metrics );
+
+	REQUIRE( layout.lines().size() == 1 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "word bold, end" ) );
+	REQUIRE( layout.boxes().at( 1 ).m_leading );
+	// Bold word is twice wider.
+	REQUIRE( layout.boxes().at( 2 ).m_width == 8.0 );
+}
+
+TEST_CASE( "line break and image lines" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aa bb" ) ),
+		emptyRun( LayoutRun::Type::LineBreak ), textRun( QStringLiteral( "cc" ) ),
+		emptyRun( LayoutRun::Type::Image ), textRun( QStringLiteral( "dd" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 100.0, metrics );
+
+	REQUIRE( layout.lines().size() == 4 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "aa bb" ) );
+	REQUIRE( layout.lines().at( 0 ).m_scale == 100.0 );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "cc" ) );
+	REQUIRE( layout.lines().at( 2 ).m_image == 3 );
+	REQUIRE( layout.lines().at( 2 ).m_count == 0 );
+	REQUIRE( lineText( layout, runs, 3 ) == QStringLiteral( "dd" ) );
+}
+
+TEST_CASE( "word wider than line" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "a bbbbbbbbbb c" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.layout( runs, 5.0, metrics );
+
+	REQUIRE( layout.lines().size() == 3 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "a" ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "bbbbbbbbbb" ) );
+	REQUIRE( lineText( layout, runs, 2 ) == QStringLiteral( "c" ) );
+}
+
+TEST_CASE( "total fit evens spaces of lines" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aaaa bb c d eeee ff ggggg" ) ) };
+
+	FixedMetrics greedyMetrics;
+	ParagraphLayout greedy;
+	greedy.layout( runs, 12.0, greedyMetrics );
+
+	REQUIRE( greedy.lines().size() == 3 );
+	REQUIRE( lineText( greedy, runs, 0 ) == QStringLiteral( "aaaa bb c d" ) );
+	REQUIRE( lineText( greedy, runs, 1 ) == QStringLiteral( "eeee ff" ) );
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.setBreaking( ParagraphLayout::Breaking::TotalFit );
+	layout.layout( runs, 12.0, metrics );
+
+	REQUIRE( metrics.m_calls == greedyMetrics.m_calls );
+	REQUIRE( layout.lines().size() == 3 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "aaaa bb c" ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "d eeee ff" ) );
+	REQUIRE( lineText( layout, runs, 2 ) == QStringLiteral( "ggggg" ) );
+	REQUIRE( lineEnd( layout, 0 ) == doctest::Approx( 12.0 ) );
+	REQUIRE( lineEnd( layout, 1 ) == doctest::Approx( 12.0 ) );
+	REQUIRE( layout.lines().at( 2 ).m_scale == 100.0 );
+}
+
+TEST_CASE( "total fit keeps hard breaks and long words" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "a bbbbbbbbbb c" ) ),
+		emptyRun( LayoutRun::Type::LineBreak ), emptyRun( LayoutRun::Type::LineBreak ),
+		textRun( QStringLiteral( "dd" ) ) };
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.setBreaking( ParagraphLayout::Breaking::TotalFit );
+	layout.layout( runs, 5.0, metrics );
+
+	REQUIRE( layout.lines().size() == 5 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "a" ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "bbbbbbbbbb" ) );
+	REQUIRE( lineText( layout, runs, 2 ) == QStringLiteral( "c" ) );
+	REQUIRE( layout.lines().at( 3 ).m_count == 0 );
+	REQUIRE( lineText( layout, runs, 4 ) == QStringLiteral( "dd" ) );
+}
+
+//! \return Hyphenator that knows "hyphenation".
+Hyphenator
+hyphenator()
+{
+	Hyphenator h;
+	h.parse( QStringLiteral( ".hy3ph he2n hena4 hen5at 1na n2at 1tio 2io o2n" ) );
+
+	return h;
+}
+
+TEST_CASE( "greedy breaking hyphenates words at ends of lines" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aa hyphenation" ) ) };
+
+	auto h = hyphenator();
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.setHyphenator( &h );
+	layout.layout( runs, 8.0, metrics );
+
+	REQUIRE( layout.lines().size() == 3 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "aa hy-" ) );
+	REQUIRE( lineEnd( layout, 0 ) == doctest::Approx( 8.0 ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "phen-" ) );
+	REQUIRE( lineText( layout, runs, 2 ) == QStringLiteral( "ation" ) );
+	REQUIRE( layout.boxes().last().m_width == 5.0 );
+}
+
+TEST_CASE( "total fit hyphenates words after loose lines" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "aaaa hyphenation" ) ) };
+
+	auto h = hyphenator();
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.setBreaking( ParagraphLayout::Breaking::TotalFit );
+	layout.setHyphenator( &h );
+	layout.layout( runs, 12.0, metrics );
+
+	REQUIRE( layout.lines().size() == 2 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "aaaa hyphen-" ) );
+	REQUIRE( lineEnd( layout, 0 ) == doctest::Approx( 12.0 ) );
+	REQUIRE( lineText( layout, runs, 1 ) == QStringLiteral( "ation" ) );
+}
+
+TEST_CASE( "words that fit are not hyphenated" )
+{
+	const QVector< LayoutRun > runs = { textRun( QStringLiteral( "hyphenation nation" ) ) };
+
+	auto h = hyphenator();
+
+	FixedMetrics metrics;
+	ParagraphLayout layout;
+	layout.setHyphenator( &h );
+	layout.layout( runs, 20.0, metrics );
+
+	REQUIRE( layout.lines().size() == 1 );
+	REQUIRE( lineText( layout, runs, 0 ) == QStringLiteral( "hyphenation nation" ) );
+	// Words and one space.
+	REQUIRE( metrics.m_calls == 3 );
+}
@@ -21,6 +21,7 @@
 */
 
 #include <md-pdf/md_parser.hpp>
+#include <md-pdf/md_cache.hpp>
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 // doctest include.
@@ -28,6 +29,8 @@
 
 #include <QFile>
 #include <QDir>
+#include <QDataStream>
+#include <QFileInfo>
 
 
 TEST_CASE( "empty" )
@@ -2593,3 +2596,758 @@ TEST_CASE( "comments" )
 	auto * t = static_cast< MD::Text* > ( p->items().at( 0 ).data() );
 	REQUIRE( t->text() == QLatin1String( "--> # Heading 1" ) );
 }
+
+TEST_CASE( "linked md order" )
+{
+	MD::Parser parser;
+
+	auto doc = parser.parse( QLatin1String( "./test50.md" ) );
+
+	REQUIRE( doc->isEmpty() == false );
+	REQUIRE( doc->items().size() == 11 );
+
+	const QString wd = QDir().absolutePath() + QDir::separator();
+
+	const QStringList files = { QLatin1String( "test50.md" ), QLatin1String( "test50-1.md" ),
+		QLatin1String( "test50-2.md" ), QLatin1String( "test50-3.md" ) };
+
+	for( int i = 0; i < files.size(); ++i )
+	{
+		REQUIRE( doc->items().at( i * 3 )->type() == MD::ItemType::Anchor );
+		REQUIRE( static_cast< MD::Anchor* > ( doc->items().at( i * 3 ).data() )->label() ==
+			wd + files.at( i ) );
+
+		REQUIRE( doc->items().at( i * 3 + 1 )->type() == MD::ItemType::Paragraph );
+
+		if( i < files.size() - 1 )
+			REQUIRE( doc->items().at( i * 3 + 2 )->type() == MD::ItemType::PageBreak );
+	}
+}
+
+TEST_CASE( "source views" )
+{
+	MD::Parser parser;
+	auto copied = parser.parse( QLatin1String( "./test8.md" ) );
+
+	parser.setSourceViews();
+	auto doc = parser.parse( QLatin1String( "./test8.md" ) );
+
+	REQUIRE( copied->sources().isEmpty() );
+	REQUIRE( doc->sources().size() == 1 );
+	REQUIRE( doc->items().size() == 2 );
+	REQUIRE( doc->items().at( 1 )->type() == MD::ItemType::Paragraph );
+
+	auto * p = static_cast< MD::Paragraph* > ( doc->items().at( 1 ).data() );
+	auto * cp = static_cast< MD::Paragraph* > ( copied->items().at( 1 ).data() );
+	REQUIRE( p->items().size() == 3 );
+	REQUIRE( cp->items().size() == 3 );
+
+	const auto & src = doc->sources().first();
+
+	for( int i = 0; i < 3; ++i )
+	{
+		REQUIRE( p->items().at( i )->type() == MD::ItemType::Text );
+		auto * t = static_cast< MD::Text* > ( p->items().at( i ).data() );
+		auto * ct = static_cast< MD::Text* > ( cp->items().at( i ).data() );
+		REQUIRE( t->text() == QString::fromLatin1( "Line %1..." ).arg( i + 1 ) );
+		REQUIRE( t->text() == ct->text() );
+		REQUIRE( t->opts() == ct->opts() );
+
+		// Plain text is not copied out of the source.
+		REQUIRE( t->text().constData() >= src.constData() );
+		REQUIRE( t->text().constData() < src.constData() + src.size() );
+	}
+}
+
+//! Collect texts of all nested items.
+void
+collectTexts( MD::Block * block, QVector< MD::Text* > & texts )
+{
+	for( const auto & item : block->items() )
+	{
+		switch( item->type() )
+		{
+			case MD::ItemType::Text :
+				texts.append( static_cast< MD::Text* > ( item.data() ) );
+				break;
+
+			case MD::ItemType::Paragraph :
+			case MD::ItemType::Blockquote :
+			case MD::ItemType::List :
+			case MD::ItemType::ListItem :
+				collectTexts( static_cast< MD::Block* > ( item.data() ), texts );
+				break;
+
+			default :
+				break;
+		}
+	}
+}
+
+TEST_CASE( "nested source views" )
+{
+	MD::Parser parser;
+	auto copied = parser.parse( QLatin1String( "./test51.md" ) );
+
+	parser.setSourceViews();
+	auto doc = parser.parse( QLatin1String( "./test51.md" ) );
+
+	QVector< MD::Text* > texts, copiedTexts;
+	collectTexts( doc.data(), texts );
+	collectTexts( copied.data(), copiedTexts );
+
+	REQUIRE( texts.size() == copiedTexts.size() );
+	REQUIRE( texts.size() > 3 );
+
+	const auto & src = doc->sources().first();
+
+	for( int i = 0; i < texts.size(); ++i )
+	{
+		REQUIRE( texts.at( i )->text() == copiedTexts.at( i )->text() );
+		REQUIRE( texts.at( i )->opts() == copiedTexts.at( i )->opts() );
+
+		// Nested text is not copied out of the source.
+		REQUIRE( texts.at( i )->text().constData() >= src.constData() );
+		REQUIRE( texts.at( i )->text().constData() < src.constData() + src.size() );
+	}
+}
+
+TEST_CASE( "long comment and deep blockquote" )
+{
+	const int depth = 2000;
+	const int commentLines = 100000;
+
+	{
+		QFile file( QLatin1String( "./deep.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+
+		file.write( "<!--\n" );
+
+		for( int i = 0; i < commentLines; ++i )
+			file.write( "Commented out line.\n" );
+
+		file.write( "-->\n" );
+
+		const QByteArray prefix( depth, '>' );
+		file.write( prefix + " Deep text\n" );
+		file.write( prefix + " continues.\n" );
+	}
+
+	MD::Parser parser;
+	auto doc = parser.parse( QLatin1String( "./deep.md" ) );
+
+	QFile::remove( QLatin1String( "./deep.md" ) );
+
+	REQUIRE( doc->items().size() == 2 );
+
+	auto * item = doc->items().at( 1 ).data();
+
+	for( int i = 0; i < depth; ++i )
+	{
+		REQUIRE( item->type() == MD::ItemType::Blockquote );
+		auto * bq = static_cast< MD::Blockquote* > ( item );
+		REQUIRE( bq->items().size() == 1 );
+		item = bq->items().first().data();
+	}
+
+	REQUIRE( item->type() == MD::ItemType::Paragraph );
+	auto * p = static_cast< MD::Paragraph* > ( item );
+	REQUIRE( p->items().size() == 2 );
+	REQUIRE( static_cast< MD::Text* > ( p->items().at( 0 ).data() )->text() ==
+		QLatin1String( "Deep text" ) );
+	REQUIRE( static_cast< MD::Text* > ( p->items().at( 1 ).data() )->text() ==
+		QLatin1String( "continues." ) );
+}
+
+TEST_CASE( "very deep blockquote" )
+{
+	const int depth = 20000;
+
+	{
+		QFile file( QLatin1String( "./very-deep.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+
+		const QByteArray prefix( depth, '>' );
+		file.write( prefix + " Text\n" );
+		file.write( prefix + "\n" );
+		file.write( prefix + " * Item\n" );
+	}
+
+	MD::Parser parser;
+	auto doc = parser.parse( QLatin1String( "./very-deep.md" ) );
+
+	QFile::remove( QLatin1String( "./very-deep.md" ) );
+
+	REQUIRE( doc->items().size() == 2 );
+
+	auto * item = doc->items().at( 1 ).data();
+
+	for( int i = 0; i < depth - 1; ++i )
+	{
+		REQUIRE( item->type() == MD::ItemType::Blockquote );
+		auto * bq = static_cast< MD::Blockquote* > ( item );
+		REQUIRE( bq->items().size() == 1 );
+		item = bq->items().first().data();
+	}
+
+	REQUIRE( item->type() == MD::ItemType::Blockquote );
+	auto * bq = static_cast< MD::Blockquote* > ( item );
+	REQUIRE( bq->items().size() == 2 );
+	REQUIRE( bq->items().at( 0 )->type() == MD::ItemType::Paragraph );
+	REQUIRE( bq->items().at( 1 )->type() == MD::ItemType::List );
+}
+
+//! Collects streamed items.
+class CollectItems final
+	:	public MD::BlockHandler
+{
+public:
+	void onItem( QSharedPointer< MD::Item > item ) override
+	{
+		m_items.append( item );
+	}
+
+	MD::Block::Items m_items;
+}; // class CollectItems
+
+TEST_CASE( "streamed items" )
+{
+	MD::Parser parser;
+
+	auto doc = parser.parse( QLatin1String( "./test50.md" ) );
+
+	CollectItems handler;
+
+	auto streamed = parser.parse( QLatin1String( "./test50.md" ), &handler );
+
+	REQUIRE( streamed->items().isEmpty() );
+	REQUIRE( handler.m_items.size() == doc->items().size() );
+
+	for( int i = 0; i < doc->items().size(); ++i )
+		REQUIRE( handler.m_items.at( i )->type() == doc->items().at( i )->type() );
+
+	REQUIRE( static_cast< MD::Anchor* > ( handler.m_items.at( 3 ).data() )->label() ==
+		static_cast< MD::Anchor* > ( doc->items().at( 3 ).data() )->label() );
+
+	REQUIRE( streamed->labeledLinks().keys() == doc->labeledLinks().keys() );
+	REQUIRE( streamed->footnotesMap().keys() == doc->footnotesMap().keys() );
+}
+
+TEST_CASE( "many paragraphs" )
+{
+	const int count = 500;
+
+	{
+		QFile file( QLatin1String( "./many.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+
+		for( int i = 0; i < count; ++i )
+		{
+			file.write( QString::fromLatin1( "Paragraph %1 with [link %1][label%1].\n\n" )
+				.arg( i ).toLatin1() );
+			file.write( QString::fromLatin1( "[label%1]: http://www.where.com/%1\n\n" )
+				.arg( i ).toLatin1() );
+			file.write( "***\n\n" );
+		}
+	}
+
+	MD::Parser parser;
+	auto doc = parser.parse( QLatin1String( "./many.md" ), false );
+
+	QFile::remove( QLatin1String( "./many.md" ) );
+
+	REQUIRE( doc->items().size() == count + 1 );
+	REQUIRE( doc->labeledLinks().size() == count );
+
+	for( int i = 0; i < count; ++i )
+	{
+		REQUIRE( doc->items().at( i + 1 )->type() == MD::ItemType::Paragraph );
+		auto * p = static_cast< MD::Paragraph* > ( doc->items().at( i + 1 ).data() );
+		REQUIRE( p->items().size() == 3 );
+		REQUIRE( p->items().at( 0 )->type() == MD::ItemType::Text );
+		REQUIRE( static_cast< MD::Text* > ( p->items().at( 0 ).data() )->text() ==
+			QString::fromLatin1( "Paragraph %1 with" ).arg( i ) );
+		REQUIRE( p->items().at( 1 )->type() == MD::ItemType::Link );
+		REQUIRE( static_cast< MD::Link* > ( p->items().at( 1 ).data() )->text() ==
+			QString::fromLatin1( "link %1" ).arg( i ) );
+	}
+}
+
+//! \return Serialized document.
+QByteArray
+serialize( const MD::Document & doc )
+{
+	QByteArray data;
+
+	{
+		QDataStream s( &data, QIODevice::WriteOnly );
+		MD::DocumentCache::writeDocument( s, doc );
+	}
+
+	return data;
+}
+
+TEST_CASE( "cache of parsed files" )
+{
+	const QString cacheDir = QLatin1String( "./cache" );
+
+	QDir( cacheDir ).removeRecursively();
+
+	MD::Parser parser;
+	auto doc = parser.parse( QLatin1String( "./test50.md" ) );
+
+	parser.setCacheDir( cacheDir );
+	auto stored = parser.parse( QLatin1String( "./test50.md" ) );
+
+	REQUIRE( QDir( cacheDir ).entryList( QDir::Files ).size() == 4 );
+
+	auto cached = parser.parse( QLatin1String( "./test50.md" ) );
+
+	REQUIRE( serialize( *stored ) == serialize( *doc ) );
+	REQUIRE( serialize( *cached ) == serialize( *doc ) );
+	REQUIRE( cached->items().size() == 11 );
+
+	// Changed file is parsed again.
+	{
+		QFile file( QLatin1String( "./changed.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+		file.write( "Old text.\n" );
+	}
+
+	parser.parse( QLatin1String( "./changed.md" ) );
+
+	{
+		QFile file( QLatin1String( "./changed.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+		file.write( "New text.\n" );
+	}
+
+	auto changed = parser.parse( QLatin1String( "./changed.md" ) );
+
+	QFile::remove( QLatin1String( "./changed.md" ) );
+	QDir( cacheDir ).removeRecursively();
+
+	REQUIRE( changed->items().size() == 2 );
+	REQUIRE( changed->items().at( 1 )->type() == MD::ItemType::Paragraph );
+	auto * p = static_cast< MD::Paragraph* > ( changed->items().at( 1 ).data() );
+	REQUIRE( p->items().size() == 1 );
+	REQUIRE( static_cast< MD::Text* > ( p->items().at( 0 ).data() )->text() ==
+		QLatin1String( "New text." ) );
+}
+
+TEST_CASE( "cache of file with appeared image" )
+{
+	const QString cacheDir = QLatin1String( "./cache" );
+	const QString fileName = QLatin1String( "./targets.md" );
+	const QString image = QLatin1String( "./appeared.png" );
+
+	QDir( cacheDir ).removeRecursively();
+	QFile::remove( image );
+
+	{
+		QFile file( fileName );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+		file.write( "![image](appeared.png)\n" );
+	}
+
+	MD::Parser parser;
+	parser.setCacheDir( cacheDir );
+
+	auto imageUrl = [&] ()
+	{
+		auto doc = parser.parse( fileName, false );
+
+		REQUIRE( doc->items().size() == 2 );
+		REQUIRE( doc->items().at( 1 )->type() == MD::ItemType::Paragraph );
+		auto * p = static_cast< MD::Paragraph* > ( doc->items().at( 1 ).data() );
+		REQUIRE( p->items().size() == 1 );
+		REQUIRE( p->items().at( 0 )->type() == MD::ItemType::Image );
+
+		return static_cast< MD::Image* > ( p->items().at( 0 ).data() )->url();
+	};
+
+	REQUIRE( imageUrl() == QLatin1String( "appeared.png" ) );
+	REQUIRE( imageUrl() == QLatin1String( "appeared.png" ) );
+
+	{
+		QFile file( image );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+	}
+
+	// The file is not changed, but its image is resolved differently now.
+	const auto url = imageUrl();
+
+	QFile::remove( image );
+	QFile::remove( fileName );
+	QDir( cacheDir ).removeRecursively();
+
+	REQUIRE( url == QFileInfo( image ).absoluteFilePath() );
+}
+
+//! Write lines to the file.
+void
+writeLines( const QString & fileName, const QStringList & lines )
+{
+	QFile file( fileName );
+	REQUIRE( file.open( QIODevice::WriteOnly ) );
+
+	for( const auto & line : lines )
+		file.write( line.toUtf8() + "\n" );
+}
+
+TEST_CASE( "reparse edited blocks" )
+{
+	const QString fileName = QLatin1String( "./reparse.md" );
+
+	QStringList lines = { QLatin1String( "# Heading {#heading}" ),
+		QString(),
+		QLatin1String( "First paragraph" ),
+		QLatin1String( "with two lines." ),
+		QString(),
+		QLatin1String( "Second [link][label]." ),
+		QString(),
+		QLatin1String( "[label]: http://www.where.com" ),
+		QString(),
+		QLatin1String( "> Quote" ),
+		QString(),
+		QLatin1String( "Third paragraph[^1]." ),
+		QString(),
+		QLatin1String( "[^1]: Footnote." ) };
+
+	writeLines( fileName, lines );
+
+	MD::Parser parser;
+	auto doc = parser.parse( fileName, false );
+
+	REQUIRE( doc->items().size() == 6 );
+	REQUIRE( doc->items().at( 2 )->sourceSpan().m_fileName ==
+		QFileInfo( fileName ).absoluteFilePath() );
+	REQUIRE( doc->items().at( 2 )->sourceSpan().m_startLine == 2 );
+	REQUIRE( doc->items().at( 2 )->sourceSpan().m_endLine == 4 );
+	REQUIRE( doc->items().at( 5 )->sourceSpan().m_endLine == 13 );
+
+	// Changed line.
+	lines[ 3 ] = QLatin1String( "with *three* lines." );
+	writeLines( fileName, lines );
+
+	REQUIRE( parser.reparse( doc, fileName, 3, 3 ) );
+	REQUIRE( serialize( *doc ) == serialize( *parser.parse( fileName, false ) ) );
+
+	// Inserted lines.
+	lines.insert( 5, QLatin1String( "Inserted paragraph." ) );
+	lines.insert( 6, QString() );
+	writeLines( fileName, lines );
+
+	REQUIRE( parser.reparse( doc, fileName, 5, 6 ) );
+	REQUIRE( serialize( *doc ) == serialize( *parser.parse( fileName, false ) ) );
+	REQUIRE( doc->items().size() == 7 );
+
+	// Removed lines.
+	lines.removeAt( 11 );
+	lines.removeAt( 11 );
+	writeLines( fileName, lines );
+
+	REQUIRE( parser.reparse( doc, fileName, 11, 10 ) );
+	REQUIRE( serialize( *doc ) == serialize( *parser.parse( fileName, false ) ) );
+	REQUIRE( doc->items().size() == 6 );
+
+	// Changed definitions.
+	lines[ 9 ] = QLatin1String( "[other]: http://www.where.com" );
+	lines[ 13 ] = QLatin1String( "[^1]: Changed footnote." );
+	writeLines( fileName, lines );
+
+	REQUIRE( parser.reparse( doc, fileName, 9, 13 ) );
+	REQUIRE( serialize( *doc ) == serialize( *parser.parse( fileName, false ) ) );
+	REQUIRE( doc->labeledLinks().size() == 1 );
+	REQUIRE( doc->labeledLinks().firstKey().startsWith( QLatin1String( "#other" ) ) );
+
+	QFile::remove( fileName );
+}
+
+//! \return Is the string in one of source buffers of the document.
+bool
+isInSources( const MD::Document & doc, const QString & str )
+{
+	for( const auto & src : doc.sources() )
+	{
+		if( str.constData() >= src.constData() && str.constData() < src.constData() + src.size() )
+			return true;
+	}
+
+	return false;
+}
+
+TEST_CASE( "reparse with source views" )
+{
+	const QString fileName = QLatin1String( "./reparse-views.md" );
+
+	QStringList lines = { QLatin1String( "First paragraph." ),
+		QString(),
+		QLatin1String( "Second paragraph." ),
+		QString(),
+		QLatin1String( "Third paragraph." ) };
+
+	writeLines( fileName, lines );
+
+	MD::Parser parser;
+	parser.setSourceViews();
+	auto doc = parser.parse( fileName, false );
+
+	REQUIRE( doc->sources().size() == 1 );
+
+	for( int i = 0; i < 10; ++i )
+	{
+		lines[ 2 ] = QString::fromLatin1( "Edited paragraph %1." ).arg( i );
+		writeLines( fileName, lines );
+
+		REQUIRE( parser.reparse( doc, fileName, 2, 2 ) );
+		REQUIRE( serialize( *doc ) == serialize( *parser.parse( fileName, false ) ) );
+
+		// Untouched paragraphs keep the first text, reparsed ones refer to the last one.
+		REQUIRE( doc->sources().size() <= 2 );
+
+		REQUIRE( doc->items().size() == 4 );
+		REQUIRE( doc->items().at( 2 )->type() == MD::ItemType::Paragraph );
+
+		auto * p = static_cast< MD::Paragraph* > ( doc->items().at( 2 ).data() );
+		REQUIRE( p->items().size() == 1 );
+		REQUIRE( p->items().at( 0 )->type() == MD::ItemType::Text );
+
+		auto * t = static_cast< MD::Text* > ( p->items().at( 0 ).data() );
+		REQUIRE( t->text() == lines.at( 2 ) );
+		REQUIRE( isInSources( *doc, t->text() ) );
+	}
+
+	// The whole file is reparsed, so the first text isn't needed any more.
+	REQUIRE( parser.reparse( doc, fileName, 0, 4 ) );
+	REQUIRE( doc->sources().size() == 1 );
+
+	QFile::remove( fileName );
+}
+
+TEST_CASE( "limited threads of parsing" )
+{
+	MD::Parser concurrent;
+	const auto expected = concurrent.parse( QLatin1String( "./test50.md" ) );
+
+	MD::Parser parser;
+	parser.setThreadsCount( 1 );
+
+	REQUIRE( parser.threadsCount() == 1 );
+
+	auto doc = parser.parse( QLatin1String( "./test50.md" ) );
+
+	REQUIRE( doc->items().size() == 11 );
+	REQUIRE( serialize( *doc ) == serialize( *expected ) );
+
+	parser.setThreadsCount( 0 );
+
+	REQUIRE( parser.threadsCount() >= 1 );
+}
+
+TEST_CASE( "deferred nested inline content" )
+{
+	const QString fileName = QLatin1String( "./nested-inlines.md" );
+
+	writeLines( fileName, { QLatin1String( "> [a]: http://www.where.com" ),
+		QString(),
+		QLatin1String( "* # `code`" ),
+		QString(),
+		QLatin1String( "[^1]: [b]: http://www.where.org" ),
+		QString(),
+		QLatin1String( "> # Nested heading {#nested}" ),
+		QString(),
+		QLatin1String( "| Column |" ),
+		QLatin1String( "|---|" ),
+		QLatin1String( "| *cell* |" ),
+		QString(),
+		QLatin1String( "Text [a][a] [b][b]." ) } );
+
+	MD::Parser parser;
+	auto doc = parser.parse( fileName, false );
+
+	QFile::remove( fileName );
+
+	// Containers with definitions only, or with heading without text, are removed.
+	REQUIRE( doc->items().size() == 4 );
+	REQUIRE( doc->footnotesMap().isEmpty() );
+
+	REQUIRE( doc->items().at( 1 )->type() == MD::ItemType::Blockquote );
+	auto * bq = static_cast< MD::Blockquote* > ( doc->items().at( 1 ).data() );
+	REQUIRE( bq->items().size() == 1 );
+	REQUIRE( bq->items().at( 0 )->type() == MD::ItemType::Heading );
+	auto * h = static_cast< MD::Heading* > ( bq->items().at( 0 ).data() );
+	REQUIRE( h->text() == QLatin1String( "Nested heading" ) );
+	REQUIRE( doc->labeledHeadings().size() == 1 );
+	REQUIRE( doc->labeledHeadings().cbegin().value().data() == h );
+	REQUIRE( h->sourceSpan().m_startLine == 6 );
+
+	REQUIRE( doc->items().at( 2 )->type() == MD::ItemType::Table );
+	auto * t = static_cast< MD::Table* > ( doc->items().at( 2 ).data() );
+	REQUIRE( t->rows().size() == 2 );
+	auto * c = static_cast< MD::TableCell* > ( t->rows().at( 1 )->cells().at( 0 ).data() );
+	REQUIRE( c->items().size() == 1 );
+	REQUIRE( c->items().at( 0 )->type() == MD::ItemType::Text );
+	REQUIRE( static_cast< MD::Text* > ( c->items().at( 0 ).data() )->opts() ==
+		MD::TextOption::ItalicText );
+
+	REQUIRE( doc->items().at( 3 )->type() == MD::ItemType::Paragraph );
+
+	// Definitions take lines of their fragments.
+	REQUIRE( doc->labeledLinks().size() == 2 );
+
+	for( auto it = doc->labeledLinks().cbegin(), last = doc->labeledLinks().cend();
+		it != last; ++it )
+	{
+		REQUIRE( it.value()->sourceSpan().m_startLine ==
+			( it.key().startsWith( QLatin1String( "#a" ) ) ? 0 : 4 ) );
+	}
+}
+
+TEST_CASE( "interned labels" )
+{
+	const QString fileName = QLatin1String( "./labels.md" );
+
+	writeLines( fileName, { QLatin1String( "# Heading {#heading}" ),
+		QString(),
+		QLatin1String( "[Link](#heading) and [one more](#heading), [file](labels.md)" ),
+		QLatin1String( "and [external](http://www.where.com)." ) } );
+
+	MD::Parser parser;
+	auto doc = parser.parse( fileName, false );
+
+	QFile::remove( fileName );
+
+	REQUIRE( doc->items().size() == 3 );
+	REQUIRE( doc->labelsCount() == 2 );
+
+	auto * a = static_cast< MD::Anchor* > ( doc->items().at( 0 ).data() );
+	REQUIRE( a->labelId() == doc->findLabel( a->label() ) );
+
+	auto * h = static_cast< MD::Heading* > ( doc->items().at( 1 ).data() );
+	REQUIRE( h->labelId() >= 0 );
+	REQUIRE( h->labelId() != a->labelId() );
+	REQUIRE( h->labelId() == doc->findLabel( h->label() ) );
+
+	auto * p = static_cast< MD::Paragraph* > ( doc->items().at( 2 ).data() );
+
+	QVector< int > targets;
+
+	for( const auto & item : p->items() )
+	{
+		if( item->type() == MD::ItemType::Link )
+			targets.append( static_cast< MD::Link* > ( item.data() )->targetId() );
+	}
+
+	REQUIRE( targets == QVector< int > { h->labelId(), h->labelId(), a->labelId(), -1 } );
+}
+
+TEST_CASE( "word runs" )
+{
+	const QString text = QLatin1String( "  One two   three " );
+	const auto words = MD::splitWords( text );
+
+	REQUIRE( words.size() == 3 );
+
+	QStringList split;
+
+	for( const auto & w : words )
+		split.append( text.mid( w.first, w.second ) );
+
+	REQUIRE( split == text.split( QLatin1Char( ' ' ), QString::SkipEmptyParts ) );
+	REQUIRE( MD::splitWords( QLatin1String( "   " ) ).isEmpty() );
+
+	MD::Parser parser;
+	auto doc = parser.parse( QLatin1String( "./test8.md" ) );
+
+	auto * t = static_cast< MD::Text* > (
+		static_cast< MD::Paragraph* > ( doc->items().at( 1 ).data() )->items().at( 0 ).data() );
+
+	REQUIRE( t->words() == MD::splitWords( t->text() ) );
+	REQUIRE( t->words().size() == 2 );
+}
+
+//! \return Texts of the paragraph.
+QStringList
+paragraphTexts( const MD::Item * item )
+{
+	QStringList res;
+
+	for( const auto & i : static_cast< const MD::Paragraph* > ( item )->items() )
+	{
+		if( i->type() == MD::ItemType::Text )
+			res.append( static_cast< MD::Text* > ( i.data() )->text() );
+	}
+
+	return res;
+}
+
+TEST_CASE( "line endings, BOM and NUL" )
+{
+	const QString fileName = QLatin1String( "./endings.md" );
+
+	{
+		QFile file( fileName );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+		file.write( QByteArray( "\xEF\xBB\xBFLine 1\r\nLine 2\rLine 3\nLi\0ne 4\r\n\r\r\nLast", 41 ) );
+	}
+
+	MD::Parser parser;
+	auto doc = parser.parse( fileName, false );
+
+	parser.setSourceViews();
+	auto viewed = parser.parse( fileName, false );
+
+	QFile::remove( fileName );
+
+	const QStringList first = { QLatin1String( "Line 1" ), QLatin1String( "Line 2" ),
+		QLatin1String( "Line 3" ), QLatin1String( "Line 4" ) };
+	const QStringList last = { QLatin1String( "Last" ) };
+
+	for( const auto & d : { doc, viewed } )
+	{
+		REQUIRE( d->items().size() == 3 );
+		REQUIRE( d->items().at( 1 )->type() == MD::ItemType::Paragraph );
+		REQUIRE( d->items().at( 2 )->type() == MD::ItemType::Paragraph );
+
+		// "\r\n", "\r" and "\n" end lines, "\r\r\n" is two lines.
+		REQUIRE( paragraphTexts( d->items().at( 1 ).data() ) == first );
+		REQUIRE( d->items().at( 1 )->sourceSpan().m_startLine == 0 );
+		REQUIRE( paragraphTexts( d->items().at( 2 ).data() ) == last );
+		REQUIRE( d->items().at( 2 )->sourceSpan().m_startLine == 6 );
+		REQUIRE( d->items().at( 2 )->sourceSpan().m_endLine == 6 );
+	}
+}
+
+TEST_CASE( "UTF-16 with BOM" )
+{
+	const QString fileName = QLatin1String( "./utf16.md" );
+	const QString text = QLatin1String( "First\r\n\r\nSecond" );
+
+	{
+		QByteArray data( "\xFF\xFE" );
+
+		for( const auto & c : text )
+		{
+			data.append( static_cast< char > ( c.unicode() & 0xFF ) );
+			data.append( static_cast< char > ( c.unicode() >> 8 ) );
+		}
+
+		QFile file( fileName );
+		REQUIRE( file.open( QIODevice::WriteOnly ) );
+		file.write( data );
+	}
+
+	MD::Parser parser;
+	auto doc = parser.parse( fileName, false );
+
+	QFile::remove( fileName );
+
+	const QStringList first = { QLatin1String( "First" ) };
+	const QStringList second = { QLatin1String( "Second" ) };
+
+	REQUIRE( doc->items().size() == 3 );
+	REQUIRE( paragraphTexts( doc->items().at( 1 ).data() ) == first );
+	REQUIRE( paragraphTexts( doc->items().at( 2 ).data() ) == second );
+	REQUIRE( doc->items().at( 2 )->sourceSpan().m_startLine == 2 );
+}
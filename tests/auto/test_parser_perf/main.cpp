@@ -0,0 +1,294 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <md-pdf/md_parser.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+// doctest include.
+#include <doctest/doctest.h>
+
+#include <QFile>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QRegExp>
+
+#include <limits>
+
+
+//! Initial count of repetitions of the pattern in the small input.
+static const int c_smallSize = 1000;
+//! How many times the large input is bigger than the small one.
+static const int c_factor = 16;
+//! Minimal time of parsing of the small input to be measured precisely, in nanoseconds.
+static const qint64 c_minTime = 5000000;
+
+
+//! Write generated Markdown to the file.
+void
+writeFile( const QString & fileName, const QString & data )
+{
+	QFile file( fileName );
+	REQUIRE( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+
+	QTextStream stream( &file );
+	stream.setCodec( "UTF-8" );
+	stream << data;
+}
+
+//! \return The best time of a few parsings of the file, in nanoseconds.
+qint64
+parseTime( const QString & fileName )
+{
+	qint64 best = std::numeric_limits< qint64 >::max();
+
+	for( int i = 0; i < 3; ++i )
+	{
+		MD::Parser parser;
+
+		QElapsedTimer timer;
+		timer.start();
+
+		auto doc = parser.parse( fileName, false );
+
+		best = qMin( best, timer.nsecsElapsed() );
+
+		REQUIRE( !doc->isEmpty() );
+	}
+
+	return best;
+}
+
+//! Check that time of parsing of the input grows linearly with its size.
+template< typename Generator >
+void
+checkLinear( const QString & name, Generator generate )
+{
+	const QString small = QStringLiteral( "./%1-small.md" ).arg( name );
+	const QString large = QStringLiteral( "./%1-large.md" ).arg( name );
+
+	int size = c_smallSize;
+	qint64 smallTime = 0;
+
+	// Small input grows till its parsing is long enough to be a baseline for the large one.
+	for( ; ; size *= 2 )
+	{
+		writeFile( small, generate( size ) );
+		smallTime = parseTime( small );
+
+		if( smallTime >= c_minTime )
+			break;
+	}
+
+	writeFile( large, generate( size * c_factor ) );
+
+	const auto largeTime = parseTime( large );
+
+	// Quadratic parsing would be c_factor times slower than linear one,
+	// so a few times of slack for noise of timers is safe.
+	REQUIRE( largeTime <= smallTime * c_factor * 4 );
+
+	QFile::remove( small );
+	QFile::remove( large );
+}
+
+
+TEST_CASE( "unmatched emphasis" )
+{
+	checkLinear( QStringLiteral( "emphasis" ), [] ( int n )
+		{ return QStringLiteral( "Text *a _b **c __d ~~e " ).repeated( n ); } );
+
+	checkLinear( QStringLiteral( "emphasis-run" ), [] ( int n )
+		{ return QStringLiteral( "Text " ) + QStringLiteral( "*_" ).repeated( n ); } );
+}
+
+TEST_CASE( "unclosed brackets" )
+{
+	checkLinear( QStringLiteral( "brackets" ), [] ( int n )
+		{ return QStringLiteral( "Text [a ![b [^c " ).repeated( n ); } );
+
+	checkLinear( QStringLiteral( "brackets-closed" ), [] ( int n )
+		{ return QStringLiteral( "Text " ) + QStringLiteral( "[" ).repeated( n ) +
+			QStringLiteral( "a]" ); } );
+
+	checkLinear( QStringLiteral( "brackets-escaped" ), [] ( int n )
+		{ return QStringLiteral( "Text " ) + QStringLiteral( "[a\\] " ).repeated( n ); } );
+
+	checkLinear( QStringLiteral( "links" ), [] ( int n )
+		{ return QStringLiteral( "Text [a](b \"c\" [d](#e) <f " ).repeated( n ); } );
+}
+
+TEST_CASE( "huge single-line table" )
+{
+	checkLinear( QStringLiteral( "table" ), [] ( int n )
+		{ return QStringLiteral( "| a | b |\n|---|---|\n| " ) +
+			QStringLiteral( "*x* | " ).repeated( n ); } );
+
+	checkLinear( QStringLiteral( "table-columns" ), [] ( int n )
+		{ return QStringLiteral( "| a |\n" ) + QStringLiteral( "|---" ).repeated( n ) +
+			QStringLiteral( "|\n| " ) + QStringLiteral( "x | " ).repeated( n ); } );
+}
+
+TEST_CASE( "deeply nested list" )
+{
+	checkLinear( QStringLiteral( "list" ), [] ( int n )
+		{ return QStringLiteral( "* " ).repeated( n ) + QStringLiteral( "text" ); } );
+}
+
+TEST_CASE( "a lot of headings in one paragraph" )
+{
+	checkLinear( QStringLiteral( "headings" ), [] ( int n )
+		{ return QStringLiteral( "Heading\n===\n" ).repeated( n ); } );
+}
+
+TEST_CASE( "code on a lot of lines" )
+{
+	checkLinear( QStringLiteral( "code" ), [] ( int n )
+		{ return QStringLiteral( "Text `" ) + QStringLiteral( "code line\n" ).repeated( n ) +
+			QStringLiteral( "end`" ); } );
+}
+
+
+namespace MD {
+
+//
+// LineClassifierBench
+//
+
+//! Compares classification of lines with the one that used simplified() and QRegExp.
+struct LineClassifierBench {
+	using BlockType = Parser::BlockType;
+
+	//! Former Parser::whatIsTheLine().
+	static BlockType
+	regExpType( const QString & str, bool inList )
+	{
+		const auto s = str.simplified();
+		static const QRegExp olr( QLatin1String( "^\\d+\\.\\s+.*" ) );
+
+		if( ( ( s.startsWith( QLatin1Char( '-' ) ) ||
+			s.startsWith( QLatin1Char( '+' ) ) ||
+			s.startsWith( QLatin1Char( '*' ) ) ) && s.length() > 1 && s[ 1 ].isSpace() ) ||
+				olr.exactMatch( s ) )
+		{
+			return BlockType::List;
+		}
+		else if( str.startsWith( QLatin1String( "    " ) ) ||
+			str.startsWith( QLatin1Char( '\t' ) ) )
+		{
+			if( !inList )
+				return BlockType::CodeIndentedBySpaces;
+			else if( str.startsWith( QLatin1String( "        " ) ) ||
+				str.startsWith( QLatin1String( "\t\t" ) ) )
+			{
+				return BlockType::CodeIndentedBySpaces;
+			}
+		}
+		else if( inList )
+			return BlockType::Text;
+
+		if( s.startsWith( QLatin1Char( '>' ) ) )
+			return BlockType::Blockquote;
+		else if( s.startsWith( QLatin1String( "```" ) ) ||
+			s.startsWith( QLatin1String( "~~~" ) ) )
+		{
+			return BlockType::Code;
+		}
+		else if( s.isEmpty() )
+			return BlockType::Unknown;
+		else if( s.startsWith( QLatin1Char( '#' ) ) )
+			return BlockType::Heading;
+		else
+			return BlockType::Text;
+	}
+
+	//! \return Time of classification of all lines, in nanoseconds.
+	template< typename Classify >
+	static qint64
+	time( const QStringList & lines, QVector< BlockType > & types, Classify classify )
+	{
+		qint64 best = std::numeric_limits< qint64 >::max();
+
+		for( int i = 0; i < 3; ++i )
+		{
+			types.clear();
+			types.reserve( lines.size() * 2 );
+
+			QElapsedTimer timer;
+			timer.start();
+
+			for( const auto & line : lines )
+			{
+				types.append( classify( line, false ) );
+				types.append( classify( line, true ) );
+			}
+
+			best = qMin( best, timer.nsecsElapsed() );
+		}
+
+		return best;
+	}
+
+	static void
+	run()
+	{
+		static const int c_lines = 200000;
+
+		const QStringList shapes = {
+			QLatin1String( "Some text of the paragraph, long enough to be a real one." ),
+			QLatin1String( "  * unordered item" ), QLatin1String( "- item" ),
+			QLatin1String( "+\titem" ), QLatin1String( "12. ordered item" ),
+			QLatin1String( "1." ), QLatin1String( "- " ), QLatin1String( "*emphasis*" ),
+			QLatin1String( "    code" ), QLatin1String( "\tcode" ),
+			QLatin1String( "        deep code" ), QLatin1String( "\t\tdeep code" ),
+			QLatin1String( "    > quote in list" ), QLatin1String( "> quote" ),
+			QLatin1String( "```cpp" ), QLatin1String( "  ~~~" ), QLatin1String( "    ```" ),
+			QLatin1String( "# Heading" ), QLatin1String( "    # heading in list" ),
+			QString(), QLatin1String( "   " ), QLatin1String( "        " ) };
+
+		QStringList lines;
+		lines.reserve( c_lines );
+
+		for( int i = 0; i < c_lines; ++i )
+			lines.append( shapes.at( i % shapes.size() ) + QString( i % 3, QLatin1Char( ' ' ) ) );
+
+		Parser parser;
+		QVector< BlockType > types, expected;
+
+		const auto handWritten = time( lines, types,
+			[&parser] ( const QString & line, bool inList )
+				{ return parser.whatIsTheLine( QStringRef( &line ), inList ); } );
+		const auto regExp = time( lines, expected, &LineClassifierBench::regExpType );
+
+		MESSAGE( "Classification of " << c_lines << " lines: " << handWritten / 1000000 <<
+			" ms, with QRegExp: " << regExp / 1000000 << " ms." );
+
+		REQUIRE( types == expected );
+		REQUIRE( handWritten < regExp );
+	}
+}; // struct LineClassifierBench
+
+} /* namespace MD */
+
+TEST_CASE( "line classifier against regexps" )
+{
+	MD::LineClassifierBench::run();
+}
@@ -0,0 +1,173 @@
+
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2019 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <md-pdf/md_parser.hpp>
+#include <md-pdf/renderer.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+// doctest include.
+#include <doctest/doctest.h>
+
+#include <QFileInfo>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+
+#include <vector>
+#include <memory>
+
+
+//
+// RenderThread
+//
+
+//! Thread that parses and renders test document.
+class RenderThread final
+	:	public QThread
+{
+public:
+	explicit RenderThread( const QString & fileName,
+		const QString & input = QStringLiteral( "./test.md" ) )
+		:	m_fileName( fileName )
+		,	m_input( input )
+		,	m_pages( 0 )
+	{
+	}
+
+	void run() override
+	{
+		RenderOpts opts;
+		opts.m_textFont = QStringLiteral( "Arial" );
+		opts.m_textFontSize = 14;
+		opts.m_codeFont = QStringLiteral( "Courier New" );
+		opts.m_codeFontSize = 12;
+		opts.m_linkColor = QColor( 33, 122, 255 );
+		opts.m_borderColor = QColor( 81, 81, 81 );
+		opts.m_codeBackground = QColor( 222, 222, 222 );
+		opts.m_left = 72.0 / 25.4 * 20.0;
+		opts.m_right = opts.m_left;
+		opts.m_top = opts.m_left;
+		opts.m_bottom = opts.m_left;
+
+		MD::Parser parser;
+
+		auto doc = parser.parse( m_input );
+
+		PdfRenderer pdf;
+
+		QObject::connect( &pdf, &PdfRenderer::error,
+			[this] ( const QString & msg ) { m_error = msg; } );
+
+		pdf.renderSync( m_fileName, doc, opts );
+
+		m_pages = pdf.pagesCount();
+	}
+
+	QString m_fileName;
+	QString m_input;
+	QString m_error;
+	int m_pages;
+}; // class RenderThread
+
+
+TEST_CASE( "render in one thread" )
+{
+	RenderThread t( QStringLiteral( "./single.pdf" ) );
+	t.start();
+	t.wait();
+
+	REQUIRE( t.m_error.isEmpty() );
+	REQUIRE( t.m_pages > 0 );
+	REQUIRE( QFileInfo( t.m_fileName ).size() > 0 );
+}
+
+TEST_CASE( "render 16 documents at once" )
+{
+	RenderThread single( QStringLiteral( "./single.pdf" ) );
+	single.start();
+	single.wait();
+
+	REQUIRE( single.m_error.isEmpty() );
+
+	std::vector< std::unique_ptr< RenderThread > > threads;
+
+	for( int i = 0; i < 16; ++i )
+		threads.emplace_back( new RenderThread( QStringLiteral( "./concurrent%1.pdf" ).arg( i ) ) );
+
+	for( auto & t : threads )
+		t->start();
+
+	for( auto & t : threads )
+		t->wait();
+
+	for( const auto & t : threads )
+	{
+		REQUIRE( t->m_error.isEmpty() );
+		REQUIRE( t->m_pages == single.m_pages );
+		REQUIRE( QFileInfo( t->m_fileName ).size() > 0 );
+	}
+
+	// And once again, global data of PoDoFo should be still alive.
+	RenderThread after( QStringLiteral( "./after.pdf" ) );
+	after.start();
+	after.wait();
+
+	REQUIRE( after.m_error.isEmpty() );
+	REQUIRE( after.m_pages == single.m_pages );
+}
+
+TEST_CASE( "render large table" )
+{
+	{
+		QFile file( QStringLiteral( "./table.md" ) );
+		REQUIRE( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+
+		QTextStream stream( &file );
+		stream << "| [Name](https://github.com/igormironchik/md-pdf) | Value | Description |\n"
+			"|:-----|:-----:|------------:|\n";
+
+		for( int i = 0; i < 5000; ++i )
+			stream << "| Row " << i << " | " << i * 2 << " | Some **bold** text and `code` |\n";
+	}
+
+	RenderThread t( QStringLiteral( "./table.pdf" ), QStringLiteral( "./table.md" ) );
+	t.start();
+	t.wait();
+
+	REQUIRE( t.m_error.isEmpty() );
+	REQUIRE( t.m_pages > 1 );
+	REQUIRE( QFileInfo( t.m_fileName ).size() > 0 );
+
+	// Only the header has a link, so each page with the repeated header has its annotation.
+	{
+		PoDoFo::PdfMemDocument pdf;
+		pdf.Load( QFile::encodeName( t.m_fileName ).constData() );
+
+		REQUIRE( pdf.GetPageCount() == t.m_pages );
+
+		for( int i = 0; i < pdf.GetPageCount(); ++i )
+			REQUIRE( pdf.GetPage( i )->GetNumAnnots() == 1 );
+	}
+
+	QFile::remove( QStringLiteral( "./table.md" ) );
+	QFile::remove( QStringLiteral( "./table.pdf" ) );
+}